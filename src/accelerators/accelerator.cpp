@@ -0,0 +1,89 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <accelerators/accelerator.hpp>
+#include <accelerators/bvh.hpp>
+#include <accelerators/compressed_bvh.hpp>
+#include <accelerators/grid.hpp>
+#include <accelerators/wide_bvh.hpp>
+#include <hittable.hpp>
+
+// Build a BVH of the given type and log its statistics
+template <class T>
+static std::unique_ptr<Hittable>
+    build_bvh(const std::vector<std::shared_ptr<Hittable>> & objects,
+              const std::string & name) {
+    std::unique_ptr<T> bvh = std::make_unique<T>(objects);
+    const auto & tree = bvh->get_tree();
+    const double bytes_per_prim =
+        bvh->bounded_count() != 0
+            ? double(tree.memory_usage()) / double(bvh->bounded_count())
+            : 0.0;
+    console::log("Built " + name + " over "
+                 + std::to_string(bvh->bounded_count()) + " objects in "
+                 + std::to_string(tree.build_time()) + "ms ("
+                 + std::to_string(tree.build_throughput() * 1e-6)
+                 + " Mprims/s): " + std::to_string(tree.node_count())
+                 + " nodes, depth " + std::to_string(tree.depth()) + ", "
+                 + std::to_string(tree.memory_usage() / 1024) + " KiB ("
+                 + std::to_string(bytes_per_prim) + " B/prim)");
+    return bvh;
+}
+
+// Build a grid and log its statistics
+static std::unique_ptr<Hittable>
+    build_grid(const std::vector<std::shared_ptr<Hittable>> & objects,
+               const double density) {
+    std::unique_ptr<Grid> grid = std::make_unique<Grid>(objects, density);
+    const GridTree & tree = grid->get_tree();
+    const int * resolution = tree.get_resolution();
+    const double bytes_per_prim =
+        grid->bounded_count() != 0
+            ? double(tree.memory_usage()) / double(grid->bounded_count())
+            : 0.0;
+    console::log("Built grid over " + std::to_string(grid->bounded_count())
+                 + " objects in " + std::to_string(tree.build_time()) + "ms ("
+                 + std::to_string(tree.build_throughput() * 1e-6)
+                 + " Mprims/s): " + std::to_string(resolution[0]) + "x"
+                 + std::to_string(resolution[1]) + "x"
+                 + std::to_string(resolution[2]) + " cells, "
+                 + std::to_string(tree.reference_count()) + " references, "
+                 + std::to_string(tree.memory_usage() / 1024) + " KiB ("
+                 + std::to_string(bytes_per_prim) + " B/prim)");
+    return grid;
+}
+
+std::unique_ptr<Hittable>
+    make_accelerator(const std::vector<std::shared_ptr<Hittable>> & objects,
+                     const AccelerationInfo & info) {
+    switch (info.structure) {
+        case AccelerationStructure::WideBvh:
+            if (info.quantization == 8) {
+                if (info.width == 4) {
+                    return build_bvh<CompressedBvh<4, uint8_t>>(
+                        objects, "4-wide BVH (8-bit boxes)");
+                }
+                return build_bvh<CompressedBvh<8, uint8_t>>(
+                    objects, "8-wide BVH (8-bit boxes)");
+            }
+            if (info.quantization == 16) {
+                if (info.width == 4) {
+                    return build_bvh<CompressedBvh<4, uint16_t>>(
+                        objects, "4-wide BVH (16-bit boxes)");
+                }
+                return build_bvh<CompressedBvh<8, uint16_t>>(
+                    objects, "8-wide BVH (16-bit boxes)");
+            }
+            if (info.width == 4) {
+                return build_bvh<WideBvh<4>>(objects, "4-wide BVH");
+            }
+            return build_bvh<WideBvh<8>>(objects, "8-wide BVH");
+        case AccelerationStructure::Grid:
+            return build_grid(objects, info.density);
+        case AccelerationStructure::Bvh:
+        default: return build_bvh<Bvh>(objects, "BVH");
+    }
+}
@@ -0,0 +1,385 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <hittable.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+// Number of bins used to evaluate the SAH
+constexpr size_t BIN_COUNT = 32;
+// Ranges with less primitives are built serially by a single task
+constexpr size_t TASK_THRESHOLD = 4096;
+// Depth from which ranges are split at their median, to bound the tree depth
+constexpr size_t MEDIAN_SPLIT_DEPTH = BvhTree::MAX_DEPTH - 32;
+
+// Primitive reference used during the construction of the tree
+struct BuildPrimitive {
+    // Bounding box of the primitive
+    Aabb box;
+    // Index of the primitive
+    uint32_t index;
+
+    // Centre of the bounding box
+    constexpr Point3 centroid() const noexcept { return box.centroid(); }
+};
+
+// Range of primitive references covered by a node
+struct BuildRange {
+    // First primitive of the range
+    size_t begin;
+    // One past the last primitive of the range
+    size_t end;
+    // Bounding box of the primitives
+    Aabb box;
+    // Bounding box of the primitive centroids
+    Aabb centroids;
+
+    // Number of primitives in the range
+    constexpr size_t count() const noexcept { return end - begin; }
+};
+
+// SAH bin
+struct Bin {
+    // Bounding box of the primitives in the bin
+    Aabb box;
+    // Bounding box of their centroids
+    Aabb centroids;
+    // Number of primitives in the bin
+    size_t count = 0;
+};
+
+// Part of the tree during a parallel build. The upper nodes, split in
+// parallel, form a small explicit tree; ranges below the task threshold are
+// built serially in their own depth-first node array.
+struct BuildSubtree {
+    // Upper node, the offset is filled when flattening the tree
+    BvhNode node;
+    // Children of an upper node
+    std::unique_ptr<BuildSubtree> children[2];
+    // Serially built subtree, with node offsets relative to the array
+    std::vector<BvhNode> nodes;
+    // Number of nodes of the flattened subtree
+    size_t size = 0;
+    // Depth of the subtree
+    size_t depth = 0;
+};
+
+// Parallel binned SAH builder. Primitive references are partitioned in place
+// and the top levels of the tree are built by OpenMP tasks.
+class BinnedSahBuilder {
+private:
+    // Primitive references, reordered during the build
+    std::vector<BuildPrimitive> & prims;
+    // Number of primitives intersected at a time in a leaf
+    size_t leaf_batch_size;
+    // Maximum number of primitives in a leaf
+    size_t max_leaf_size;
+
+public:
+    BinnedSahBuilder(std::vector<BuildPrimitive> & prims,
+                     const size_t leaf_batch_size)
+        : prims(prims), leaf_batch_size(leaf_batch_size),
+          max_leaf_size(BvhTree::max_leaf_size(leaf_batch_size)) {}
+
+    // Build the tree over all primitives
+    std::unique_ptr<BuildSubtree> build() {
+        BuildRange range { 0, prims.size(), Aabb(), Aabb() };
+        for (const BuildPrimitive & prim : prims) {
+            range.box.extend(prim.box);
+            range.centroids.extend(prim.centroid());
+        }
+
+        std::unique_ptr<BuildSubtree> root;
+#pragma omp parallel
+#pragma omp single
+        root = build_parallel(range, 0);
+        return root;
+    }
+
+    // Flatten a subtree in depth-first order, starting at `base`
+    static void flatten(const BuildSubtree & subtree,
+                        BvhNode * out,
+                        const uint32_t base) noexcept {
+        if (!subtree.nodes.empty()) {
+            for (size_t i = 0; i < subtree.nodes.size(); ++i) {
+                out[base + i] = subtree.nodes[i];
+                if (!out[base + i].is_leaf()) {
+                    out[base + i].offset += base;
+                }
+            }
+            return;
+        }
+
+        const uint32_t second_child = base + 1 + subtree.children[0]->size;
+        out[base] = subtree.node;
+        out[base].offset = second_child;
+        const BuildSubtree * const first_child = subtree.children[0].get();
+#pragma omp task firstprivate(first_child, out, base)
+        flatten(*first_child, out, base + 1);
+        flatten(*subtree.children[1], out, second_child);
+#pragma omp taskwait
+    }
+
+private:
+    // Build the upper levels of the tree, spawning a task for each left child
+    std::unique_ptr<BuildSubtree> build_parallel(const BuildRange & range,
+                                                 const size_t level) {
+        std::unique_ptr<BuildSubtree> subtree =
+            std::make_unique<BuildSubtree>();
+        BuildRange left, right;
+        int axis;
+        Bin bins[BIN_COUNT];
+
+        if (range.count() <= TASK_THRESHOLD
+            || !split(range, level, bins, left, right, axis)) {
+            subtree->depth = build_serial(range, level, bins, subtree->nodes);
+            subtree->size = subtree->nodes.size();
+            return subtree;
+        }
+
+        BuildSubtree * const s = subtree.get();
+#pragma omp task shared(left) firstprivate(s, level)
+        s->children[0] = build_parallel(left, level + 1);
+        s->children[1] = build_parallel(right, level + 1);
+#pragma omp taskwait
+
+        subtree->node.box = range.box;
+        subtree->node.count = 0;
+        subtree->node.axis = axis;
+        subtree->size = 1 + s->children[0]->size + s->children[1]->size;
+        subtree->depth =
+            1 + std::max(s->children[0]->depth, s->children[1]->depth);
+        return subtree;
+    }
+
+    // Build a subtree serially, appending its nodes in depth-first order.
+    // The bins are reused by all the nodes of the subtree.
+    // Returns the depth of the subtree.
+    size_t build_serial(const BuildRange & range,
+                        const size_t level,
+                        Bin * bins,
+                        std::vector<BvhNode> & out) {
+        const uint32_t node_index = out.size();
+        out.emplace_back();
+        out[node_index].box = range.box;
+
+        BuildRange left, right;
+        int axis;
+        if (!split(range, level, bins, left, right, axis)) {
+            out[node_index].offset = range.begin;
+            out[node_index].count = range.count();
+            out[node_index].axis = 0;
+            return 1;
+        }
+
+        const size_t left_depth = build_serial(left, level + 1, bins, out);
+        const uint32_t second_child = out.size();
+        const size_t right_depth = build_serial(right, level + 1, bins, out);
+        out[node_index].offset = second_child;
+        out[node_index].count = 0;
+        out[node_index].axis = axis;
+        return 1 + std::max(left_depth, right_depth);
+    }
+
+    // Split a range of primitives, using `bins` as scratch memory. Returns
+    // false if it should become a leaf, otherwise partitions the primitives in
+    // place.
+    bool split(const BuildRange & range,
+               const size_t level,
+               Bin * bins,
+               BuildRange & left,
+               BuildRange & right,
+               int & axis) {
+        const size_t count = range.count();
+        if (count <= 1) {
+            return false;
+        }
+
+        axis = range.centroids.largest_axis();
+        const double cmin = range.centroids.min[axis];
+        const double extent = range.centroids.max[axis] - cmin;
+
+        if (extent <= 0.0 || level >= MEDIAN_SPLIT_DEPTH) {
+            // Degenerate centroids or deep tree: split at the median
+            if (extent <= 0.0 && count <= max_leaf_size) {
+                return false;
+            }
+            const size_t mid = range.begin + count / 2;
+            std::nth_element(prims.begin() + range.begin, prims.begin() + mid,
+                             prims.begin() + range.end,
+                             [axis](const BuildPrimitive & a,
+                                    const BuildPrimitive & b) {
+                                 return a.centroid()[axis] < b.centroid()[axis];
+                             });
+            left = bounds(range.begin, mid);
+            right = bounds(mid, range.end);
+            return true;
+        }
+
+        // Fill the bins. Small ranges use less bins.
+        const size_t bin_count = std::min(BIN_COUNT, count);
+        const double scale = double(bin_count) * (1.0 - 1e-6) / extent;
+        const auto bin_index = [=](const BuildPrimitive & prim) {
+            return std::min(
+                bin_count - 1,
+                static_cast<size_t>((prim.centroid()[axis] - cmin) * scale));
+        };
+        for (size_t b = 0; b < bin_count; ++b) {
+            bins[b] = Bin();
+        }
+        for (size_t i = range.begin; i < range.end; ++i) {
+            Bin & bin = bins[bin_index(prims[i])];
+            bin.box.extend(prims[i].box);
+            bin.centroids.extend(prims[i].centroid());
+            ++bin.count;
+        }
+
+        // Sweep the bins from right to left, then left to right
+        double right_costs[BIN_COUNT];
+        Aabb acc;
+        size_t acc_count = 0;
+        for (size_t b = bin_count - 1; b > 0; --b) {
+            acc.extend(bins[b].box);
+            acc_count += bins[b].count;
+            right_costs[b] = acc.surface_area()
+                             * BvhTree::leaf_cost(acc_count, leaf_batch_size);
+        }
+
+        const double inv_area =
+            1.0 / std::max(range.box.surface_area(), 1e-300);
+        double best_cost = utils::INF;
+        size_t best_bin = 0;
+        acc = Aabb();
+        acc_count = 0;
+        for (size_t b = 1; b < bin_count; ++b) {
+            acc.extend(bins[b - 1].box);
+            acc_count += bins[b - 1].count;
+            if (acc_count == 0 || acc_count == count) {
+                continue;
+            }
+            const double cost =
+                BvhTree::TRAVERSAL_COST
+                + (acc.surface_area()
+                       * BvhTree::leaf_cost(acc_count, leaf_batch_size)
+                   + right_costs[b])
+                      * inv_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_bin = b;
+            }
+        }
+
+        // Make a leaf if it is cheaper than splitting
+        if (best_bin == 0
+            || (count <= max_leaf_size
+                && BvhTree::leaf_cost(count, leaf_batch_size) <= best_cost)) {
+            return false;
+        }
+
+        const auto middle = std::partition(
+            prims.begin() + range.begin, prims.begin() + range.end,
+            [&](const BuildPrimitive & prim) {
+                return bin_index(prim) < best_bin;
+            });
+        const size_t mid = middle - prims.begin();
+
+        left = BuildRange { range.begin, mid, Aabb(), Aabb() };
+        right = BuildRange { mid, range.end, Aabb(), Aabb() };
+        for (size_t b = 0; b < bin_count; ++b) {
+            BuildRange & side = b < best_bin ? left : right;
+            side.box.extend(bins[b].box);
+            side.centroids.extend(bins[b].centroids);
+        }
+        return true;
+    }
+
+    // Compute the bounds of a range of primitives
+    BuildRange bounds(const size_t begin, const size_t end) const noexcept {
+        BuildRange range { begin, end, Aabb(), Aabb() };
+        for (size_t i = begin; i < end; ++i) {
+            range.box.extend(prims[i].box);
+            range.centroids.extend(prims[i].centroid());
+        }
+        return range;
+    }
+};
+
+BvhTree::BvhTree(const std::vector<Aabb> & boxes,
+                 const size_t leaf_batch_size) {
+    if (boxes.empty()) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<BuildPrimitive> prims(boxes.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        prims[i] = BuildPrimitive { boxes[i], static_cast<uint32_t>(i) };
+    }
+
+    BinnedSahBuilder builder(prims, leaf_batch_size);
+    const std::unique_ptr<BuildSubtree> root = builder.build();
+    tree_depth = root->depth;
+
+    node_storage.resize(root->size);
+#pragma omp parallel
+#pragma omp single
+    BinnedSahBuilder::flatten(*root, node_storage.data(), 0);
+
+    index_storage.resize(prims.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < prims.size(); ++i) {
+        index_storage[i] = prims[i].index;
+    }
+    lay_out_built_nodes(DEFAULT_LAYOUT);
+    use_storage();
+
+    build_millis = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    build_cost = sah_cost();
+}
+
+double BvhTree::sah_cost() const noexcept {
+    if (nodes.empty()) {
+        return 0.0;
+    }
+    double cost = 0.0;
+    for (const BvhNode & node : nodes) {
+        cost += node.box.surface_area()
+                * (node.is_leaf() ? double(node.count) : TRAVERSAL_COST);
+    }
+    return cost / std::max(nodes[0].box.surface_area(), 1e-300);
+}
+
+void BvhTree::refit(const std::vector<Aabb> & boxes) noexcept {
+    // Children are stored after their parent
+    for (size_t i = nodes.size(); i-- > 0;) {
+        BvhNode & node = nodes[i];
+        if (node.is_leaf()) {
+            Aabb box;
+            for (uint32_t k = 0; k < node.count; ++k) {
+                box.extend(boxes[indices[node.offset + k]]);
+            }
+            node.box = box;
+        } else {
+            node.box =
+                nodes[node.offset].box.merge(nodes[node.offset + 1].box);
+        }
+    }
+}
+
+bool BvhTree::update(const std::vector<Aabb> & boxes,
+                     const double max_cost_growth) {
+    refit(boxes);
+    if (cost_growth() <= max_cost_growth) {
+        return false;
+    }
+    *this = BvhTree(boxes);
+    return true;
+}
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <utils.hpp>
+#include <utils/mapped_file.hpp>
+#include <utils/vec3.hpp>
+
+// Version of the cache format and of the builders. Must be increased when
+// either changes, to invalidate the existing cache files.
+constexpr uint32_t BVH_CACHE_VERSION = 2;
+// Magic number at the start of cache files
+constexpr char BVH_CACHE_MAGIC[8] = { 'X', 'T', 'R', 'M', 'B', 'V', 'H', '\0' };
+// Number of triangles hashed by each task
+constexpr size_t HASH_CHUNK_SIZE = 1 << 16;
+
+// Header of a cache file. It is followed by the nodes, then by the primitive
+// indices. All offsets are indices, so the file can be mapped at any address.
+struct BvhCacheHeader {
+    // Magic number
+    char magic[8];
+    // Version of the format
+    uint32_t version;
+    // Size of a node, to reject files written with another layout
+    uint32_t node_size;
+    // Hash of the geometry and build settings
+    uint64_t key;
+    // Number of nodes
+    uint64_t node_count;
+    // Number of primitive indices
+    uint64_t index_count;
+    // Depth of the tree
+    uint64_t depth;
+    // SAH cost of the tree when it was built
+    double build_cost;
+    // Unused, keeps the nodes aligned
+    uint64_t padding;
+};
+
+static_assert(sizeof(BvhCacheHeader) == 64);
+
+uint64_t BvhTree::cache_key(
+    const std::vector<std::array<Point3, 3>> & triangles,
+    const SpatialSplitInfo & info,
+    const size_t leaf_batch_size) noexcept {
+    // Hash fixed size chunks in parallel, then combine them in order, so the
+    // key does not depend on the number of threads
+    const size_t chunk_count =
+        (triangles.size() + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE;
+    std::vector<uint64_t> chunk_hashes(chunk_count);
+#pragma omp parallel for
+    for (size_t c = 0; c < chunk_count; ++c) {
+        const size_t end =
+            std::min(triangles.size(), (c + 1) * HASH_CHUNK_SIZE);
+        uint64_t hash = c;
+        for (size_t i = c * HASH_CHUNK_SIZE; i < end; ++i) {
+            for (const Point3 & p : triangles[i]) {
+                hash = utils::hash_mix(hash, std::bit_cast<uint64_t>(p.x));
+                hash = utils::hash_mix(hash, std::bit_cast<uint64_t>(p.y));
+                hash = utils::hash_mix(hash, std::bit_cast<uint64_t>(p.z));
+            }
+        }
+        chunk_hashes[c] = utils::hash_finalize(hash);
+    }
+
+    uint64_t hash = triangles.size();
+    for (const uint64_t chunk_hash : chunk_hashes) {
+        hash = utils::hash_mix(hash, chunk_hash);
+    }
+    return cache_key(utils::hash_finalize(hash), info, leaf_batch_size);
+}
+
+uint64_t BvhTree::cache_key(const uint64_t geometry_key,
+                            const SpatialSplitInfo & info,
+                            const size_t leaf_batch_size) noexcept {
+    uint64_t hash = BVH_CACHE_VERSION;
+    hash = utils::hash_mix(hash, geometry_key);
+    hash = utils::hash_mix(hash, info.enabled);
+    hash = utils::hash_mix(hash, std::bit_cast<uint64_t>(info.memory_budget));
+    hash = utils::hash_mix(hash,
+                           std::bit_cast<uint64_t>(info.overlap_threshold));
+    hash = utils::hash_mix(hash, MAX_LEAF_SIZE);
+    hash = utils::hash_mix(hash, MAX_LEAF_BATCHES);
+    hash = utils::hash_mix(hash, leaf_batch_size);
+    hash = utils::hash_mix(hash, std::bit_cast<uint64_t>(TRAVERSAL_COST));
+    hash = utils::hash_mix(hash, static_cast<uint64_t>(DEFAULT_LAYOUT));
+    return utils::hash_finalize(hash);
+}
+
+bool BvhTree::load_cache(const std::string & file_name, const uint64_t key) {
+    if (!std::filesystem::exists(file_name)) {
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<MappedFile> file;
+    try {
+        file = std::make_unique<MappedFile>(file_name);
+    } catch (...) {
+        return false;
+    }
+
+    BvhCacheHeader header;
+    if (file->size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != BVH_CACHE_VERSION
+        || header.node_size != sizeof(BvhNode) || header.key != key
+        || file->size()
+               != sizeof(header) + header.node_count * sizeof(BvhNode)
+                      + header.index_count * sizeof(uint32_t)) {
+        return false;
+    }
+
+    // The nodes and indices are used in place, and only read from disk when
+    // first accessed
+    std::byte * const data = file->data() + sizeof(header);
+    nodes = std::span<BvhNode>(reinterpret_cast<BvhNode *>(data),
+                               header.node_count);
+    indices = std::span<uint32_t>(
+        reinterpret_cast<uint32_t *>(data
+                                     + header.node_count * sizeof(BvhNode)),
+        header.index_count);
+    std::vector<BvhNode>().swap(node_storage);
+    std::vector<uint32_t>().swap(index_storage);
+    mapping = std::move(file);
+    tree_depth = header.depth;
+    build_cost = header.build_cost;
+    build_millis = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    return true;
+}
+
+bool BvhTree::save_cache(const std::string & file_name,
+                         const uint64_t key) const {
+    BvhCacheHeader header {};
+    std::memcpy(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = BVH_CACHE_VERSION;
+    header.node_size = sizeof(BvhNode);
+    header.key = key;
+    header.node_count = nodes.size();
+    header.index_count = indices.size();
+    header.depth = tree_depth;
+    header.build_cost = build_cost;
+
+    // Write to a temporary file, then rename it, so that concurrent jobs
+    // never read a partial file
+    const std::string tmp_name =
+        file_name + "."
+        + std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count())
+        + ".tmp";
+    {
+        std::ofstream file(tmp_name, std::ios_base::out
+                                         | std::ios_base::binary
+                                         | std::ios_base::trunc);
+        if (!file) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(nodes.data()),
+                   nodes.size_bytes());
+        file.write(reinterpret_cast<const char *>(indices.data()),
+                   indices.size_bytes());
+        if (!file) {
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(tmp_name, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmp_name, file_name, error);
+    if (error) {
+        std::filesystem::remove(tmp_name, error);
+        return false;
+    }
+    return true;
+}
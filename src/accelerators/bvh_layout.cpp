@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+#include <span>
+#include <utility>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+
+// Maximum number of nodes in a treelet, at least one pair of children
+constexpr size_t TREELET_NODES =
+    std::max<size_t>(2, BvhTree::TREELET_SIZE / sizeof(BvhNode));
+
+// Reorder the nodes of a tree. `children(i)` gives the indices of the two
+// children of an interior node i. The root stays first, and the children of
+// each interior node are placed as a pair after it, the pairs being ordered
+// by the layout. Returns the new nodes, with their offsets updated.
+template <class F>
+static std::vector<BvhNode> lay_out_nodes(const std::span<const BvhNode> nodes,
+                                          F && children,
+                                          const BvhLayout layout) {
+    if (nodes.empty()) {
+        return {};
+    }
+
+    // The pairs are identified by their parent, and are given their new
+    // position in the order they are emitted
+    std::vector<uint32_t> position(nodes.size());
+    position[0] = 0;
+    uint32_t next = 1;
+    const auto emit = [&](const uint32_t parent) {
+        const auto [first, second] = children(parent);
+        position[first] = next;
+        position[second] = next + 1;
+        next += 2;
+    };
+
+    switch (layout) {
+        case BvhLayout::Treelet: {
+            // Each treelet is grown from its root pair by opening the pair
+            // with the largest surface area, as it is the most likely to be
+            // visited. The remaining pairs root the next treelets, laid out
+            // depth-first.
+            const auto area = [&](const uint32_t parent) {
+                return nodes[parent].box.surface_area();
+            };
+            const auto smaller = [&](const uint32_t a, const uint32_t b) {
+                return area(a) < area(b);
+            };
+            std::vector<uint32_t> roots;
+            std::vector<uint32_t> frontier;
+            if (!nodes[0].is_leaf()) {
+                roots.push_back(0);
+            }
+            while (!roots.empty()) {
+                frontier.assign(1, roots.back());
+                roots.pop_back();
+                size_t size = 0;
+                while (!frontier.empty() && size + 2 <= TREELET_NODES) {
+                    std::pop_heap(frontier.begin(), frontier.end(), smaller);
+                    const uint32_t parent = frontier.back();
+                    frontier.pop_back();
+                    emit(parent);
+                    size += 2;
+                    const auto [first, second] = children(parent);
+                    for (const uint32_t child : { first, second }) {
+                        if (!nodes[child].is_leaf()) {
+                            frontier.push_back(child);
+                            std::push_heap(frontier.begin(), frontier.end(),
+                                           smaller);
+                        }
+                    }
+                }
+                // Put the largest remaining pair on top of the stack
+                std::sort(frontier.begin(), frontier.end(), smaller);
+                roots.insert(roots.end(), frontier.begin(), frontier.end());
+            }
+            break;
+        }
+
+        case BvhLayout::VanEmdeBoas: {
+            // Height of the pair tree below each interior node
+            std::vector<uint32_t> height(nodes.size(), 0);
+            std::vector<uint32_t> order;
+            std::vector<uint32_t> stack;
+            if (!nodes[0].is_leaf()) {
+                stack.push_back(0);
+            }
+            while (!stack.empty()) {
+                const uint32_t parent = stack.back();
+                stack.pop_back();
+                order.push_back(parent);
+                const auto [first, second] = children(parent);
+                for (const uint32_t child : { first, second }) {
+                    if (!nodes[child].is_leaf()) {
+                        stack.push_back(child);
+                    }
+                }
+            }
+            for (size_t k = order.size(); k-- > 0;) {
+                const auto [first, second] = children(order[k]);
+                height[order[k]] = 1 + std::max(height[first], height[second]);
+            }
+
+            // Lay out the `levels` top levels of the pair tree below a node,
+            // and append the nodes whose pairs are below them to `bottom`
+            const auto lay_out = [&](const auto & self,
+                                     const uint32_t parent,
+                                     const uint32_t levels,
+                                     std::vector<uint32_t> & bottom) -> void {
+                if (levels == 1) {
+                    emit(parent);
+                    const auto [first, second] = children(parent);
+                    for (const uint32_t child : { first, second }) {
+                        if (!nodes[child].is_leaf()) {
+                            bottom.push_back(child);
+                        }
+                    }
+                    return;
+                }
+                const uint32_t top_levels = levels / 2;
+                std::vector<uint32_t> middle;
+                self(self, parent, top_levels, middle);
+                for (const uint32_t child : middle) {
+                    self(self, child, levels - top_levels, bottom);
+                }
+            };
+            if (!nodes[0].is_leaf()) {
+                std::vector<uint32_t> bottom;
+                lay_out(lay_out, 0, height[0], bottom);
+            }
+            break;
+        }
+
+        case BvhLayout::DepthFirst:
+        default: {
+            std::vector<uint32_t> stack;
+            if (!nodes[0].is_leaf()) {
+                stack.push_back(0);
+            }
+            while (!stack.empty()) {
+                const uint32_t parent = stack.back();
+                stack.pop_back();
+                emit(parent);
+                const auto [first, second] = children(parent);
+                for (const uint32_t child : { second, first }) {
+                    if (!nodes[child].is_leaf()) {
+                        stack.push_back(child);
+                    }
+                }
+            }
+            break;
+        }
+    }
+
+    std::vector<BvhNode> result(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        BvhNode & node = result[position[i]];
+        node = nodes[i];
+        if (!node.is_leaf()) {
+            node.offset = position[children(i).first];
+        }
+    }
+    return result;
+}
+
+void BvhTree::lay_out_built_nodes(const BvhLayout layout) {
+    node_storage = lay_out_nodes(
+        node_storage,
+        [&](const uint32_t i) {
+            return std::pair(i + 1, node_storage[i].offset);
+        },
+        layout);
+}
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// From src/include
+#include <accelerators/compressed_bvh.hpp>
+#include <utils/aabb.hpp>
+
+template <size_t N, class Q>
+void CompressedWideBvhNode<N, Q>::set_boxes(const Aabb * boxes,
+                                            size_t box_count) noexcept {
+    Aabb parent;
+    for (size_t i = 0; i < box_count; ++i) {
+        parent.extend(boxes[i]);
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        // Anchor the grid at the parent minimum, rounded down to a float
+        float o = static_cast<float>(parent.min[axis]);
+        if (double(o) > parent.min[axis]) {
+            o = std::nextafter(o, -INFINITY);
+        }
+        origin[axis] = o;
+
+        // Smallest power of two cell size covering the parent box, keeping a
+        // cell of margin for the outward rounding
+        const double range = parent.max[axis] - double(o);
+        int e = -127;
+        if (range > 0.0) {
+            std::frexp(range / double(Q_MAX - 1), &e);
+        }
+        exponent[axis] = static_cast<int8_t>(std::clamp(e, -127, 127));
+    }
+
+    for (size_t i = 0; i < N; ++i) {
+        for (int plane = 0; plane < 6; ++plane) {
+            bounds[plane][i] = 0;
+        }
+    }
+
+    for (size_t i = 0; i < box_count; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            const double inv_scale = 1.0 / scale(axis);
+            const double lo = boxes[i].min[axis];
+            const double hi = boxes[i].max[axis];
+
+            // Round outwards, then fix the rounding errors of the division
+            unsigned q_lo = static_cast<unsigned>(std::clamp(
+                std::floor((lo - origin[axis]) * inv_scale), 0.0,
+                double(Q_MAX)));
+            while (q_lo > 0 && decode(axis, q_lo) > lo) {
+                --q_lo;
+            }
+            unsigned q_hi = static_cast<unsigned>(std::clamp(
+                std::ceil((hi - origin[axis]) * inv_scale), 0.0,
+                double(Q_MAX)));
+            while (q_hi < Q_MAX && decode(axis, q_hi) < hi) {
+                ++q_hi;
+            }
+
+            bounds[axis][i] = static_cast<Q>(q_lo);
+            bounds[axis + 3][i] = static_cast<Q>(q_hi);
+        }
+    }
+}
+
+template struct CompressedWideBvhNode<4, uint8_t>;
+template struct CompressedWideBvhNode<8, uint8_t>;
+template struct CompressedWideBvhNode<4, uint16_t>;
+template struct CompressedWideBvhNode<8, uint16_t>;
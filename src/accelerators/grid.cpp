@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// From src/include
+#include <accelerators/grid.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+GridTree::GridTree(const std::vector<Aabb> & boxes, const double density)
+    : density(density), primitive_count(boxes.size()) {
+    if (boxes.empty()) {
+        return;
+    }
+    if (boxes.size() > UINT32_MAX) {
+        throw "Too many objects in the grid";
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    for (const Aabb & box : boxes) {
+        root_box.extend(box);
+    }
+
+    // Flat axes are given a small thickness, so that all cells have a
+    // non-zero size
+    Vec3 extent = root_box.max - root_box.min;
+    const double max_extent =
+        std::max(std::max(extent.x, extent.y), std::max(extent.z, 1.0));
+    int flat_axes = 0;
+    double volume = 1.0;
+    for (int a = 0; a < 3; ++a) {
+        if (extent[a] <= utils::EPSILON * max_extent) {
+            ++flat_axes;
+        } else {
+            volume *= extent[a];
+        }
+    }
+
+    // Cubic cells, about `density` of them per primitive, spread over the
+    // axes that are not flat
+    const double cells_per_unit =
+        flat_axes == 3
+            ? 0.0
+            : std::pow(density * double(boxes.size()) / volume,
+                       1.0 / double(3 - flat_axes));
+    for (int a = 0; a < 3; ++a) {
+        if (extent[a] <= utils::EPSILON * max_extent) {
+            root_box.min[a] -= utils::EPSILON * max_extent;
+            root_box.max[a] += utils::EPSILON * max_extent;
+            resolution[a] = 1;
+        } else {
+            const double cells = std::ceil(extent[a] * cells_per_unit);
+            resolution[a] =
+                int(std::clamp(cells, 1.0, double(MAX_RESOLUTION)));
+        }
+    }
+    extent = root_box.max - root_box.min;
+    for (int a = 0; a < 3; ++a) {
+        cell_size[a] = extent[a] / resolution[a];
+        inv_cell_size[a] = 1.0 / cell_size[a];
+    }
+
+    // Range of cells overlapped by each box
+    const auto cell_range = [&](const Aabb & box, int * lo, int * hi) {
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = cell_coordinate(box.min[a], a);
+            hi[a] = cell_coordinate(box.max[a], a);
+        }
+    };
+    const auto for_each_cell = [&](const Aabb & box, auto && f) {
+        int lo[3];
+        int hi[3];
+        cell_range(box, lo, hi);
+        for (int z = lo[2]; z <= hi[2]; ++z) {
+            for (int y = lo[1]; y <= hi[1]; ++y) {
+                const size_t row =
+                    (size_t(z) * resolution[1] + y) * resolution[0];
+                for (int x = lo[0]; x <= hi[0]; ++x) {
+                    f(row + x);
+                }
+            }
+        }
+    };
+
+    // Counting sort of the references by cell
+    const size_t cells =
+        size_t(resolution[0]) * size_t(resolution[1]) * size_t(resolution[2]);
+    std::vector<size_t> counts(cells + 1, 0);
+    for (const Aabb & box : boxes) {
+        for_each_cell(box, [&](size_t cell) { ++counts[cell + 1]; });
+    }
+    for (size_t c = 0; c < cells; ++c) {
+        counts[c + 1] += counts[c];
+    }
+    if (counts[cells] > UINT32_MAX) {
+        throw "Too many references in the grid, lower its density";
+    }
+
+    cell_offsets.assign(counts.begin(), counts.end());
+    cell_objects.resize(counts[cells]);
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        for_each_cell(boxes[i], [&](size_t cell) {
+            cell_objects[counts[cell]++] = static_cast<uint32_t>(i);
+        });
+    }
+
+    build_millis = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+}
+
+bool GridTree::update(const std::vector<Aabb> & boxes, const double) {
+    *this = GridTree(boxes, density);
+    return true;
+}
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <utils.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+// Number of bins of the object and spatial splits
+constexpr size_t SPLIT_BIN_COUNT = 32;
+// Depth from which references are split at their median, to bound the tree
+// depth
+constexpr size_t SBVH_MEDIAN_SPLIT_DEPTH = BvhTree::MAX_DEPTH - 32;
+
+// Reference to a triangle, or to the part of it inside a box
+struct Reference {
+    // Bounding box of the referenced part of the triangle
+    Aabb box;
+    // Index of the triangle
+    uint32_t index;
+
+    // Centre of the bounding box
+    constexpr Point3 centroid() const noexcept { return box.centroid(); }
+};
+
+// Best split found for a node
+struct SplitCandidate {
+    // SAH cost of the split
+    double cost = utils::INF;
+    // Split axis
+    int axis = 0;
+    // Object splits: first centroid bin of the right child.
+    // Spatial splits: unused.
+    size_t bin = 0;
+    // Spatial splits: position of the split plane
+    double position = 0.0;
+    // Bounding boxes of the children
+    Aabb left_box, right_box;
+    // Number of references of the children
+    size_t left_count = 0, right_count = 0;
+};
+
+// Bin of a spatial split
+struct SpatialBin {
+    // Bounding box of the reference parts clipped in the bin
+    Aabb box;
+    // Number of references starting in the bin
+    size_t entries = 0;
+    // Number of references ending in the bin
+    size_t exits = 0;
+};
+
+// Serial spatial split BVH builder (Stich et al., "Spatial Splits in Bounding
+// Volume Hierarchies"). At each node, the best object split is compared to
+// spatial splits, which clip the triangles straddling the split plane. Spatial
+// splits are only tried when the children of the object split overlap, and
+// stop once the reference budget is exhausted.
+class SpatialSplitBuilder {
+private:
+    // Triangles of the tree
+    const std::vector<std::array<Point3, 3>> & triangles;
+    // Output nodes
+    std::vector<BvhNode> & nodes;
+    // Output primitive indices
+    std::vector<uint32_t> & indices;
+    // Minimum overlap area of object split children to try spatial splits
+    double min_overlap;
+    // Number of references that can still be created
+    size_t budget;
+    // Number of triangles intersected at a time in a leaf
+    size_t leaf_batch_size;
+    // Maximum number of triangles in a leaf
+    size_t max_leaf_size;
+
+public:
+    SpatialSplitBuilder(const std::vector<std::array<Point3, 3>> & triangles,
+                        std::vector<BvhNode> & nodes,
+                        std::vector<uint32_t> & indices,
+                        const double min_overlap,
+                        const size_t budget,
+                        const size_t leaf_batch_size)
+        : triangles(triangles), nodes(nodes), indices(indices),
+          min_overlap(min_overlap), budget(budget),
+          leaf_batch_size(leaf_batch_size),
+          max_leaf_size(BvhTree::max_leaf_size(leaf_batch_size)) {}
+
+    // Build the subtree over a set of references, appending its nodes in
+    // depth-first order. Returns the depth of the subtree.
+    size_t build(std::vector<Reference> & refs,
+                 const Aabb & box,
+                 const size_t level) {
+        const uint32_t node_index = nodes.size();
+        nodes.emplace_back();
+        nodes[node_index].box = box;
+
+        const size_t count = refs.size();
+        Aabb centroids;
+        for (const Reference & ref : refs) {
+            centroids.extend(ref.centroid());
+        }
+
+        std::vector<Reference> left, right;
+        int axis;
+        if (!split(refs, box, centroids, level, left, right, axis)) {
+            nodes[node_index].offset = indices.size();
+            nodes[node_index].count = count;
+            nodes[node_index].axis = 0;
+            for (const Reference & ref : refs) {
+                indices.push_back(ref.index);
+            }
+            return 1;
+        }
+        // Release the parent references before going down
+        std::vector<Reference>().swap(refs);
+
+        const Aabb left_box = bounds(left);
+        const Aabb right_box = bounds(right);
+        const size_t left_depth = build(left, left_box, level + 1);
+        const uint32_t second_child = nodes.size();
+        const size_t right_depth = build(right, right_box, level + 1);
+        nodes[node_index].offset = second_child;
+        nodes[node_index].count = 0;
+        nodes[node_index].axis = axis;
+        return 1 + std::max(left_depth, right_depth);
+    }
+
+private:
+    // Bounding box of a set of references
+    static Aabb bounds(const std::vector<Reference> & refs) noexcept {
+        Aabb box;
+        for (const Reference & ref : refs) {
+            box.extend(ref.box);
+        }
+        return box;
+    }
+
+    // Split a reference by an axis aligned plane. The parts are clipped to
+    // the box of the reference, and may be empty.
+    void split_reference(const Reference & ref,
+                         const int axis,
+                         const double position,
+                         Reference & left,
+                         Reference & right) const noexcept {
+        const std::array<Point3, 3> & triangle = triangles[ref.index];
+        Aabb left_box, right_box;
+        for (int i = 0; i < 3; ++i) {
+            const Point3 & v0 = triangle[i];
+            const Point3 & v1 = triangle[(i + 1) % 3];
+            const double p0 = v0[axis];
+            const double p1 = v1[axis];
+            if (p0 <= position) {
+                left_box.extend(v0);
+            }
+            if (p0 >= position) {
+                right_box.extend(v0);
+            }
+            if ((p0 < position && position < p1)
+                || (p1 < position && position < p0)) {
+                // The edge crosses the plane
+                const double t =
+                    std::clamp((position - p0) / (p1 - p0), 0.0, 1.0);
+                Point3 p = v0 + t * (v1 - v0);
+                p[axis] = position;
+                left_box.extend(p);
+                right_box.extend(p);
+            }
+        }
+        left_box.max[axis] = std::min(left_box.max[axis], position);
+        right_box.min[axis] = std::max(right_box.min[axis], position);
+        left = Reference { left_box.intersect(ref.box), ref.index };
+        right = Reference { right_box.intersect(ref.box), ref.index };
+    }
+
+    // Find the best object split along the largest axis of the centroids,
+    // using binned SAH
+    SplitCandidate object_split(const std::vector<Reference> & refs,
+                                const Aabb & box,
+                                const Aabb & centroids) const noexcept {
+        SplitCandidate best;
+        const int axis = centroids.largest_axis();
+        const double cmin = centroids.min[axis];
+        const double extent = centroids.max[axis] - cmin;
+        if (extent <= 0.0) {
+            return best;
+        }
+
+        const size_t count = refs.size();
+        const size_t bin_count = std::min(SPLIT_BIN_COUNT, count);
+        const double scale = double(bin_count) * (1.0 - 1e-6) / extent;
+        Aabb boxes[SPLIT_BIN_COUNT];
+        size_t counts[SPLIT_BIN_COUNT] = {};
+        for (const Reference & ref : refs) {
+            const size_t b = std::min(
+                bin_count - 1,
+                static_cast<size_t>((ref.centroid()[axis] - cmin) * scale));
+            boxes[b].extend(ref.box);
+            ++counts[b];
+        }
+
+        Aabb right_boxes[SPLIT_BIN_COUNT];
+        Aabb acc;
+        for (size_t b = bin_count - 1; b > 0; --b) {
+            acc.extend(boxes[b]);
+            right_boxes[b] = acc;
+        }
+
+        const double inv_area = 1.0 / std::max(box.surface_area(), 1e-300);
+        acc = Aabb();
+        size_t left_count = 0;
+        for (size_t b = 1; b < bin_count; ++b) {
+            acc.extend(boxes[b - 1]);
+            left_count += counts[b - 1];
+            const size_t right_count = count - left_count;
+            if (left_count == 0 || right_count == 0) {
+                continue;
+            }
+            const double cost =
+                BvhTree::TRAVERSAL_COST
+                + (acc.surface_area()
+                       * BvhTree::leaf_cost(left_count, leaf_batch_size)
+                   + right_boxes[b].surface_area()
+                         * BvhTree::leaf_cost(right_count, leaf_batch_size))
+                      * inv_area;
+            if (cost < best.cost) {
+                best = SplitCandidate { cost,
+                                        axis,
+                                        b,
+                                        0.0,
+                                        acc,
+                                        right_boxes[b],
+                                        left_count,
+                                        right_count };
+            }
+        }
+        return best;
+    }
+
+    // Find the best spatial split along an axis. The references are chopped
+    // into the bins they overlap.
+    SplitCandidate spatial_split(const std::vector<Reference> & refs,
+                                 const Aabb & box,
+                                 const int axis) const noexcept {
+        SplitCandidate best;
+        const double origin = box.min[axis];
+        const double extent = box.max[axis] - origin;
+        if (extent <= 0.0) {
+            return best;
+        }
+
+        const double bin_width = extent / double(SPLIT_BIN_COUNT);
+        const double scale = 1.0 / bin_width;
+        const auto bin_index = [=](const double p) {
+            return std::min(
+                SPLIT_BIN_COUNT - 1,
+                static_cast<size_t>(std::max(0.0, (p - origin) * scale)));
+        };
+        SpatialBin bins[SPLIT_BIN_COUNT];
+        for (const Reference & ref : refs) {
+            const size_t first = bin_index(ref.box.min[axis]);
+            const size_t last = bin_index(ref.box.max[axis]);
+            Reference rest = ref;
+            for (size_t b = first; b < last; ++b) {
+                Reference left, right;
+                split_reference(rest, axis, origin + double(b + 1) * bin_width,
+                                left, right);
+                bins[b].box.extend(left.box);
+                rest = right;
+            }
+            bins[last].box.extend(rest.box);
+            ++bins[first].entries;
+            ++bins[last].exits;
+        }
+
+        Aabb right_boxes[SPLIT_BIN_COUNT];
+        size_t right_counts[SPLIT_BIN_COUNT];
+        Aabb acc;
+        size_t acc_count = 0;
+        for (size_t b = SPLIT_BIN_COUNT - 1; b > 0; --b) {
+            acc.extend(bins[b].box);
+            acc_count += bins[b].exits;
+            right_boxes[b] = acc;
+            right_counts[b] = acc_count;
+        }
+
+        const double inv_area = 1.0 / std::max(box.surface_area(), 1e-300);
+        acc = Aabb();
+        acc_count = 0;
+        for (size_t b = 1; b < SPLIT_BIN_COUNT; ++b) {
+            acc.extend(bins[b - 1].box);
+            acc_count += bins[b - 1].entries;
+            if (acc_count == 0 || right_counts[b] == 0) {
+                continue;
+            }
+            const double cost =
+                BvhTree::TRAVERSAL_COST
+                + (acc.surface_area()
+                       * BvhTree::leaf_cost(acc_count, leaf_batch_size)
+                   + right_boxes[b].surface_area()
+                         * BvhTree::leaf_cost(right_counts[b],
+                                              leaf_batch_size))
+                      * inv_area;
+            if (cost < best.cost) {
+                best = SplitCandidate { cost,
+                                        axis,
+                                        0,
+                                        origin + double(b) * bin_width,
+                                        acc,
+                                        right_boxes[b],
+                                        acc_count,
+                                        right_counts[b] };
+            }
+        }
+        return best;
+    }
+
+    // Distribute the references of a spatial split. A reference straddling
+    // the plane is kept whole on one side when it is cheaper than splitting
+    // it (reference unsplitting), or when the budget is exhausted.
+    void partition_spatial(const std::vector<Reference> & refs,
+                           const SplitCandidate & split,
+                           std::vector<Reference> & left,
+                           std::vector<Reference> & right) {
+        const int axis = split.axis;
+        Aabb left_box = split.left_box;
+        Aabb right_box = split.right_box;
+        size_t left_count = split.left_count;
+        size_t right_count = split.right_count;
+
+        for (const Reference & ref : refs) {
+            if (ref.box.max[axis] <= split.position) {
+                left.push_back(ref);
+                continue;
+            }
+            if (ref.box.min[axis] >= split.position) {
+                right.push_back(ref);
+                continue;
+            }
+
+            Reference left_part, right_part;
+            split_reference(ref, axis, split.position, left_part, right_part);
+            if (left_part.box.is_empty()) {
+                right.push_back(ref);
+                continue;
+            }
+            if (right_part.box.is_empty()) {
+                left.push_back(ref);
+                continue;
+            }
+
+            const double split_cost =
+                left_box.surface_area() * double(left_count)
+                + right_box.surface_area() * double(right_count);
+            const double left_cost =
+                left_box.merge(ref.box).surface_area() * double(left_count)
+                + right_box.surface_area() * double(right_count - 1);
+            const double right_cost =
+                left_box.surface_area() * double(left_count - 1)
+                + right_box.merge(ref.box).surface_area() * double(right_count);
+
+            if (budget == 0 || std::min(left_cost, right_cost) < split_cost) {
+                if (left_cost < right_cost) {
+                    left.push_back(ref);
+                    left_box.extend(ref.box);
+                    --right_count;
+                } else {
+                    right.push_back(ref);
+                    right_box.extend(ref.box);
+                    --left_count;
+                }
+            } else {
+                left.push_back(left_part);
+                right.push_back(right_part);
+                --budget;
+            }
+        }
+    }
+
+    // Split a set of references at their median centroid along an axis
+    static void partition_median(std::vector<Reference> & refs,
+                                 const int axis,
+                                 std::vector<Reference> & left,
+                                 std::vector<Reference> & right) {
+        const auto mid = refs.begin() + refs.size() / 2;
+        std::nth_element(refs.begin(), mid, refs.end(),
+                         [axis](const Reference & a, const Reference & b) {
+                             return a.centroid()[axis] < b.centroid()[axis];
+                         });
+        left.assign(refs.begin(), mid);
+        right.assign(mid, refs.end());
+    }
+
+    // Split a set of references. Returns false if it should become a leaf.
+    bool split(std::vector<Reference> & refs,
+               const Aabb & box,
+               const Aabb & centroids,
+               const size_t level,
+               std::vector<Reference> & left,
+               std::vector<Reference> & right,
+               int & axis) {
+        const size_t count = refs.size();
+        if (count <= 1) {
+            return false;
+        }
+
+        if (level >= SBVH_MEDIAN_SPLIT_DEPTH) {
+            // Deep tree: split at the median
+            axis = centroids.largest_axis();
+            partition_median(refs, axis, left, right);
+            return true;
+        }
+
+        const SplitCandidate object = object_split(refs, box, centroids);
+        SplitCandidate spatial;
+        const bool overlapping =
+            object.cost == utils::INF
+            || object.left_box.intersect(object.right_box).surface_area()
+                   > min_overlap;
+        if (budget != 0 && overlapping) {
+            for (int a = 0; a < 3; ++a) {
+                const SplitCandidate candidate = spatial_split(refs, box, a);
+                if (candidate.cost < spatial.cost) {
+                    spatial = candidate;
+                }
+            }
+        }
+
+        const double best_cost = std::min(object.cost, spatial.cost);
+        if (count <= max_leaf_size
+            && BvhTree::leaf_cost(count, leaf_batch_size) <= best_cost) {
+            return false;
+        }
+
+        if (spatial.cost < object.cost) {
+            axis = spatial.axis;
+            partition_spatial(refs, spatial, left, right);
+            if (!left.empty() && !right.empty()) {
+                return true;
+            }
+            left.clear();
+            right.clear();
+        }
+
+        if (object.cost == utils::INF) {
+            // Degenerate centroids: split at the median
+            axis = centroids.largest_axis();
+            partition_median(refs, axis, left, right);
+            return true;
+        }
+
+        axis = object.axis;
+        const double cmin = centroids.min[axis];
+        const size_t bin_count = std::min(SPLIT_BIN_COUNT, count);
+        const double scale = double(bin_count) * (1.0 - 1e-6)
+                             / (centroids.max[axis] - cmin);
+        for (const Reference & ref : refs) {
+            const size_t b = std::min(
+                bin_count - 1,
+                static_cast<size_t>((ref.centroid()[axis] - cmin) * scale));
+            (b < object.bin ? left : right).push_back(ref);
+        }
+        return true;
+    }
+};
+
+BvhTree::BvhTree(const std::vector<std::array<Point3, 3>> & triangles,
+                 const SpatialSplitInfo & info,
+                 const size_t leaf_batch_size) {
+    std::vector<Reference> refs;
+    refs.reserve(triangles.size());
+    Aabb root_box;
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        Aabb box = Aabb::from_point(triangles[i][0]);
+        box.extend(triangles[i][1]);
+        box.extend(triangles[i][2]);
+        refs.push_back(Reference { box, static_cast<uint32_t>(i) });
+        root_box.extend(box);
+    }
+
+    if (!info.enabled) {
+        std::vector<Aabb> boxes(refs.size());
+        for (size_t i = 0; i < refs.size(); ++i) {
+            boxes[i] = refs[i].box;
+        }
+        *this = BvhTree(boxes, leaf_batch_size);
+        return;
+    }
+    if (refs.empty()) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    const size_t budget =
+        static_cast<size_t>(std::max(0.0, info.memory_budget)
+                            * double(triangles.size()));
+    index_storage.reserve(triangles.size() + budget);
+    SpatialSplitBuilder builder(triangles, node_storage, index_storage,
+                                info.overlap_threshold
+                                    * root_box.surface_area(),
+                                budget, leaf_batch_size);
+    tree_depth = builder.build(refs, root_box, 0);
+    lay_out_built_nodes(DEFAULT_LAYOUT);
+    use_storage();
+
+    build_millis = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    build_cost = sah_cost();
+}
@@ -0,0 +1,180 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <accelerators/compressed_bvh.hpp>
+#include <accelerators/wide_bvh.hpp>
+#include <utils/aabb.hpp>
+
+// Round a double down to the nearest float
+static inline float round_down(const double value) noexcept {
+    const float f = static_cast<float>(value);
+    return double(f) > value ? std::nextafter(f, -INFINITY) : f;
+}
+
+// Round a double up to the nearest float
+static inline float round_up(const double value) noexcept {
+    const float f = static_cast<float>(value);
+    return double(f) < value ? std::nextafter(f, INFINITY) : f;
+}
+
+template <size_t N>
+void WideBvhNode<N>::set_boxes(const Aabb * boxes,
+                               size_t box_count) noexcept {
+    for (size_t i = 0; i < N; ++i) {
+        // Unused children get a null box, they are masked by the traversal
+        const Aabb box =
+            i < box_count ? boxes[i] : Aabb::from_point(vec3::ZEROS);
+        bounds[0][i] = round_down(box.min.x);
+        bounds[1][i] = round_down(box.min.y);
+        bounds[2][i] = round_down(box.min.z);
+        bounds[3][i] = round_up(box.max.x);
+        bounds[4][i] = round_up(box.max.y);
+        bounds[5][i] = round_up(box.max.z);
+    }
+}
+
+template <class Node>
+WideBvhTree<Node>::WideBvhTree(const std::vector<Aabb> & boxes)
+    : WideBvhTree(BvhTree(boxes)) {}
+
+template <class Node>
+WideBvhTree<Node>::WideBvhTree(const BvhTree & binary)
+    : indices(binary.primitive_indices().begin(),
+              binary.primitive_indices().end()),
+      root_box(binary.bounds()) {
+    if (binary.node_count() == 0) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    nodes.reserve(binary.node_count() / (N - 1) + 1);
+    tree_depth = collapse(binary.get_nodes(), 0);
+
+    build_millis = binary.build_time()
+                   + std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    build_cost = sah_cost();
+}
+
+template <class Node>
+double WideBvhTree<Node>::sah_cost() const noexcept {
+    if (nodes.empty()) {
+        return 0.0;
+    }
+    double cost = root_box.surface_area() * BvhTree::TRAVERSAL_COST;
+    for (const Node & node : nodes) {
+        for (size_t i = 0; i < node.child_count; ++i) {
+            cost += node.get_box(i).surface_area()
+                    * (node.count[i] != 0 ? double(node.count[i])
+                                          : BvhTree::TRAVERSAL_COST);
+        }
+    }
+    return cost / std::max(root_box.surface_area(), 1e-300);
+}
+
+template <class Node>
+void WideBvhTree<Node>::refit(const std::vector<Aabb> & boxes) noexcept {
+    // Children are stored after their parent
+    for (size_t n = nodes.size(); n-- > 0;) {
+        Node & node = nodes[n];
+        Aabb child_boxes[N];
+        for (size_t i = 0; i < node.child_count; ++i) {
+            if (node.count[i] != 0) {
+                for (uint32_t k = 0; k < node.count[i]; ++k) {
+                    child_boxes[i].extend(boxes[indices[node.child[i] + k]]);
+                }
+            } else {
+                const Node & child = nodes[node.child[i]];
+                for (size_t k = 0; k < child.child_count; ++k) {
+                    child_boxes[i].extend(child.get_box(k));
+                }
+            }
+        }
+        node.set_boxes(child_boxes, node.child_count);
+        if (n == 0) {
+            root_box = Aabb();
+            for (size_t i = 0; i < node.child_count; ++i) {
+                root_box.extend(child_boxes[i]);
+            }
+        }
+    }
+}
+
+template <class Node>
+bool WideBvhTree<Node>::update(const std::vector<Aabb> & boxes,
+                               const double max_cost_growth) {
+    refit(boxes);
+    if (cost_growth() <= max_cost_growth) {
+        return false;
+    }
+    *this = WideBvhTree(boxes);
+    return true;
+}
+
+template <class Node>
+size_t WideBvhTree<Node>::collapse(const std::span<const BvhNode> binary,
+                                   const uint32_t binary_index) {
+    // Open the children with the largest area until the node is full
+    uint32_t children[N];
+    size_t child_count = 0;
+    if (binary[binary_index].is_leaf()) {
+        children[child_count++] = binary_index;
+    } else {
+        children[child_count++] = binary[binary_index].offset;
+        children[child_count++] = binary[binary_index].offset + 1;
+    }
+    while (child_count < N) {
+        size_t best = N;
+        double best_area = -1.0;
+        for (size_t i = 0; i < child_count; ++i) {
+            const BvhNode & child = binary[children[i]];
+            if (!child.is_leaf() && child.box.surface_area() > best_area) {
+                best = i;
+                best_area = child.box.surface_area();
+            }
+        }
+        if (best == N) {
+            break;
+        }
+        const uint32_t opened = children[best];
+        children[best] = binary[opened].offset;
+        children[child_count++] = binary[opened].offset + 1;
+    }
+
+    const uint32_t node_index = nodes.size();
+    nodes.emplace_back();
+    nodes[node_index] = Node {};
+    nodes[node_index].child_count = child_count;
+
+    Aabb boxes[N];
+    size_t depth = 0;
+    for (size_t i = 0; i < child_count; ++i) {
+        const BvhNode & child = binary[children[i]];
+        uint32_t ref = child.offset;
+        if (!child.is_leaf()) {
+            // The node vector may be reallocated by the recursive call
+            ref = nodes.size();
+            depth = std::max(depth, collapse(binary, children[i]));
+        }
+        boxes[i] = child.box;
+        nodes[node_index].child[i] = ref;
+        nodes[node_index].count[i] = child.count;
+    }
+    nodes[node_index].set_boxes(boxes, child_count);
+    return depth + 1;
+}
+
+template struct WideBvhNode<4>;
+template struct WideBvhNode<8>;
+template class WideBvhTree<WideBvhNode<4>>;
+template class WideBvhTree<WideBvhNode<8>>;
+template class WideBvhTree<CompressedWideBvhNode<4, uint8_t>>;
+template class WideBvhTree<CompressedWideBvhNode<8, uint8_t>>;
+template class WideBvhTree<CompressedWideBvhNode<4, uint16_t>>;
+template class WideBvhTree<CompressedWideBvhNode<8, uint16_t>>;
@@ -1,5 +1,9 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <numeric>
+#include <utility>
+#include <vector>
 
 // From src/include
 #include <camera.hpp>
@@ -51,33 +55,243 @@ Colour Camera::cast_ray(const Hittable & world,
                         const Hittable & sampled_object,
                         const uint32_t max_bounces,
                         double u,
-                        double v) const noexcept {
-    Ray ray = get_ray(u, v);
-    Colour ray_colour = colour::WHITE;
+                        double v,
+                        uint64_t & ray_count) const noexcept {
+    PathState path;
+    path.ray = get_ray(u, v);
     HitRecord hit_record;
-    ScatterRecord scatter;
-    uint32_t iter = 0;
-    double pdf_coeff = 1.0;
-    double pdf_value = 1.0;
-    for (iter = 0; iter < max_bounces; ++iter) {
-        if (!world.hit(ray, utils::EPSILON, utils::INF, hit_record)) {
-            break;
+    bool hit = false;
+    if (max_bounces != 0) {
+        ++ray_count;
+        hit = world.hit(path.ray, utils::EPSILON, utils::INF, hit_record);
+    }
+    return trace_path(world, global_lights, sampled_object, max_bounces, path,
+                      hit, hit_record, ray_count);
+}
+
+void Camera::cast_packet(const Hittable & world,
+                         const vector<GlobalIllumination> & global_lights,
+                         const Hittable & sampled_object,
+                         const uint32_t max_bounces,
+                         const double * u,
+                         const double * v,
+                         Colour * colours,
+                         uint64_t & ray_count) const noexcept {
+    PathState paths[PACKET_SIZE];
+    Ray rays[PACKET_SIZE];
+    for (size_t i = 0; i < PACKET_SIZE; ++i) {
+        rays[i] = paths[i].ray = get_ray(u[i], v[i]);
+    }
+    HitRecord hit_records[PACKET_SIZE];
+    unsigned hit = 0;
+    if (max_bounces != 0) {
+        ray_count += PACKET_SIZE;
+        double tmax[PACKET_SIZE];
+        std::fill_n(tmax, PACKET_SIZE, utils::INF);
+        hit = world.hit_packet(RayPacket(rays), PACKET_MASK, utils::EPSILON,
+                               tmax, hit_records);
+    }
+
+    // The secondary rays are incoherent, and traced one by one
+    for (size_t i = 0; i < PACKET_SIZE; ++i) {
+        colours[i] = trace_path(world, global_lights, sampled_object,
+                                max_bounces, paths[i], hit >> i & 1,
+                                hit_records[i], ray_count);
+    }
+}
+
+// Number of bits of the origin cell coordinates when sorting a ray stream
+constexpr unsigned STREAM_CELL_BITS = 6;
+// Number of bits of the digits of the radix sort of a ray stream
+constexpr unsigned STREAM_RADIX_BITS = 11;
+
+static_assert(3 + 3 * STREAM_CELL_BITS <= 2 * STREAM_RADIX_BITS,
+              "Stream sort keys must be sorted in two passes");
+
+// Spread the 10 low bits of an integer, inserting two zeros between bits
+static inline uint32_t spread_bits(uint32_t x) noexcept {
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x << 8)) & 0x0300F00F;
+    x = (x | (x << 4)) & 0x030C30C3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// Sort the rays of the paths in `ids` by the octant of their direction, then
+// by the Morton code of their origin cell, so that rays going the same way
+// from the same region are traced together. `keys` is a scratch buffer.
+static void sort_stream(vector<uint32_t> & ids,
+                        const vector<PathState> & paths,
+                        vector<uint64_t> & keys) noexcept {
+    constexpr uint32_t cells = 1u << STREAM_CELL_BITS;
+    Aabb bounds;
+    for (const uint32_t id : ids) {
+        bounds.extend(paths[id].ray.origin);
+    }
+    const Vec3 extent = bounds.diagonal();
+    const auto cell = [&](double x, double min, double size) {
+        const double scale = cells / std::max(size, utils::EPSILON);
+        return spread_bits(std::min(uint32_t((x - min) * scale), cells - 1));
+    };
+
+    // The keys are stored above the path ids
+    const size_t n = ids.size();
+    keys.resize(2 * n);
+    uint64_t * in = keys.data();
+    uint64_t * out = keys.data() + n;
+    for (size_t i = 0; i < n; ++i) {
+        const Ray & ray = paths[ids[i]].ray;
+        const uint64_t octant = (ray.direction.x < 0)
+                                | (ray.direction.y < 0) << 1
+                                | (ray.direction.z < 0) << 2;
+        const uint64_t morton = cell(ray.origin.x, bounds.min.x, extent.x)
+                                | cell(ray.origin.y, bounds.min.y, extent.y)
+                                      << 1
+                                | cell(ray.origin.z, bounds.min.z, extent.z)
+                                      << 2;
+        in[i] = (octant << 3 * STREAM_CELL_BITS | morton) << 32 | ids[i];
+    }
+
+    // Least significant digit radix sort of the keys
+    for (unsigned shift = 32; shift < 32 + 2 * STREAM_RADIX_BITS;
+         shift += STREAM_RADIX_BITS) {
+        constexpr size_t digits = size_t(1) << STREAM_RADIX_BITS;
+        size_t offsets[digits] = {};
+        for (size_t i = 0; i < n; ++i) {
+            ++offsets[in[i] >> shift & (digits - 1)];
+        }
+        size_t sum = 0;
+        for (size_t & offset : offsets) {
+            sum += std::exchange(offset, sum);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            out[offsets[in[i] >> shift & (digits - 1)]++] = in[i];
+        }
+        std::swap(in, out);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        ids[i] = uint32_t(in[i]);
+    }
+}
+
+void Camera::cast_stream(const Hittable & world,
+                         const vector<GlobalIllumination> & global_lights,
+                         const Hittable & sampled_object,
+                         const uint32_t max_bounces,
+                         const double * u,
+                         const double * v,
+                         const size_t count,
+                         const bool packets,
+                         Colour * colours,
+                         uint64_t & ray_count) const noexcept {
+    vector<PathState> paths(count);
+    vector<HitRecord> hit_records(count);
+    vector<uint8_t> hits(count, false);
+    vector<uint32_t> ids;
+    vector<uint64_t> keys;
+    ids.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        paths[i].ray = get_ray(u[i], v[i]);
+        if (max_bounces != 0) {
+            ids.push_back(i);
+        } else {
+            advance_path(world, global_lights, sampled_object, max_bounces,
+                         paths[i], false, hit_records[i], colours[i],
+                         ray_count);
+        }
+    }
+
+    // The primary rays are coherent in the order of the samples
+    size_t first = 0;
+    if (packets) {
+        for (; first + PACKET_SIZE <= ids.size(); first += PACKET_SIZE) {
+            Ray rays[PACKET_SIZE];
+            double tmax[PACKET_SIZE];
+            for (size_t l = 0; l < PACKET_SIZE; ++l) {
+                rays[l] = paths[first + l].ray;
+                tmax[l] = utils::INF;
+            }
+            const unsigned hit = world.hit_packet(
+                RayPacket(rays), PACKET_MASK, utils::EPSILON, tmax,
+                &hit_records[first]);
+            for (size_t l = 0; l < PACKET_SIZE; ++l) {
+                hits[first + l] = hit >> l & 1;
+            }
+        }
+    }
+
+    while (!ids.empty()) {
+        for (size_t i = first; i < ids.size(); ++i) {
+            const uint32_t id = ids[i];
+            hits[id] = world.hit(paths[id].ray, utils::EPSILON, utils::INF,
+                                 hit_records[id]);
         }
+        ray_count += ids.size();
+
+        // Scatter the results back to the paths, and keep the paths which
+        // continue
+        size_t next = 0;
+        for (const uint32_t id : ids) {
+            if (advance_path(world, global_lights, sampled_object,
+                             max_bounces, paths[id], hits[id],
+                             hit_records[id], colours[id], ray_count)) {
+                ids[next++] = id;
+            }
+        }
+        ids.resize(next);
+        sort_stream(ids, paths, keys);
+        first = 0;
+    }
+}
+
+Colour Camera::trace_path(const Hittable & world,
+                          const vector<GlobalIllumination> & global_lights,
+                          const Hittable & sampled_object,
+                          const uint32_t max_bounces,
+                          PathState & path,
+                          bool hit,
+                          HitRecord & hit_record,
+                          uint64_t & ray_count) const noexcept {
+    Colour colour;
+    while (advance_path(world, global_lights, sampled_object, max_bounces,
+                        path, hit, hit_record, colour, ray_count)) {
+        ++ray_count;
+        hit = world.hit(path.ray, utils::EPSILON, utils::INF, hit_record);
+    }
+    return colour;
+}
+
+bool Camera::advance_path(const Hittable & world,
+                          const vector<GlobalIllumination> & global_lights,
+                          const Hittable & sampled_object,
+                          const uint32_t max_bounces,
+                          PathState & path,
+                          const bool hit,
+                          HitRecord & hit_record,
+                          Colour & colour,
+                          uint64_t & ray_count) const noexcept {
+    Ray & ray = path.ray;
+    if (path.iter < max_bounces && hit) {
 
 // Display normals
 #if 0
-        return Colour(0.5 + 0.5 * record.surface_normal);
+        colour = Colour(0.5 + 0.5 * hit_record.surface_normal);
+        return false;
 #endif
 
+        ScatterRecord scatter;
         if (hit_record.scatter(ray, scatter) != Material::ScatterType::Bounce) {
-            return (fabs(pdf_value) < utils::EPSILON
-                        ? colour::BLACK
-                        : pdf_coeff * ray_colour * scatter.attenuation
-                              / pdf_value);
+            colour = (fabs(path.pdf_value) < utils::EPSILON
+                          ? colour::BLACK
+                          : path.pdf_coeff * path.ray_colour
+                                * scatter.attenuation / path.pdf_value);
+            return false;
         }
 
-        ray_colour *= scatter.attenuation;
+        path.ray_colour *= scatter.attenuation;
         ray.origin = hit_record.hit_point;
+        bool below_surface = false;
         if (scatter.is_specular) {
             ray.direction = scatter.specular_direction;
         } else {
@@ -87,17 +301,20 @@ Colour Camera::cast_ray(const Hittable & world,
             const Pdf & pdf = sampled_object.is_samplable()
                                   ? mixture_pdf
                                   : (const Pdf &)*scatter.pdf.get();
-            ray_colour *= scatter.attenuation;
+            path.ray_colour *= scatter.attenuation;
             ray.direction = pdf.generate();
             if (ray.direction.dot(hit_record.surface_normal) < utils::EPSILON) {
-                pdf_value = 0.0;
-                break;
+                path.pdf_value = 0.0;
+                below_surface = true;
             } else {
-                pdf_value *= pdf.value(ray.direction);
+                path.pdf_value *= pdf.value(ray.direction);
+                path.pdf_coeff *=
+                    hit_record.material.get().scattering_pdf(hit_record, ray);
             }
+        }
 
-            pdf_coeff *=
-                hit_record.material.get().scattering_pdf(hit_record, ray);
+        if (!below_surface && ++path.iter < max_bounces) {
+            return true;
         }
     }
 
@@ -111,15 +328,31 @@ Colour Camera::cast_ray(const Hittable & world,
         }
         if (light.type != LightType::Ambient) {
             light_coeff =
-                (iter
+                (path.iter
                      ? fmax(hit_record.surface_normal.dot(light_direction), 0.0)
                      : light.type != LightType::Point)
                 * fmax(ray.direction.unit_vector().dot(light_direction), 0.0);
+
+            // Shadow ray from the last hit point, which only needs to know
+            // whether something lies between the point and the light
+            if (path.iter && light_coeff > 0.0) {
+                const bool is_point = light.type == LightType::Point;
+                ++ray_count;
+                if (world.occluded(Ray(ray.origin,
+                                       is_point ? light.position - ray.origin
+                                                : light.position),
+                                   utils::EPSILON,
+                                   is_point ? 1.0 : utils::INF)) {
+                    continue;
+                }
+            }
         }
         lights_contribution += light_coeff * light.colour;
     }
 
-    return (fabs(pdf_value) < utils::EPSILON)
-               ? colour::BLACK
-               : pdf_coeff * ray_colour * lights_contribution / pdf_value;
+    colour = (fabs(path.pdf_value) < utils::EPSILON)
+                 ? colour::BLACK
+                 : path.pdf_coeff * path.ray_colour * lights_contribution
+                       / path.pdf_value;
+    return false;
 }
@@ -24,6 +24,29 @@ bool HittableList::hit(const Ray & ray_in,
     return hit;
 }
 
+unsigned HittableList::hit_packet(const RayPacket & packet,
+                                  const unsigned mask,
+                                  const double tmin,
+                                  double * tmax,
+                                  HitRecord * records) const noexcept {
+    unsigned hit = 0;
+    for (const Hittable & obj : *this) {
+        hit |= obj.hit_packet(packet, mask, tmin, tmax, records);
+    }
+    return hit;
+}
+
+bool HittableList::occluded(const Ray & ray_in,
+                            const double tmin,
+                            const double tmax) const noexcept {
+    for (const Hittable & obj : *this) {
+        if (obj.occluded(ray_in, tmin, tmax)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 double HittableList::pdf_value(const Point3 & origin,
                                const Vec3 & direction) const noexcept {
     double sum = 0.0;
@@ -36,3 +59,19 @@ double HittableList::pdf_value(const Point3 & origin,
 Vec3 HittableList::random(const Point3 & origin) const noexcept {
     return operator[](rng::gen_u64() % size()).get().random(origin);
 }
+
+bool HittableList::bounding_box(Aabb & output_box) const noexcept {
+    if (empty()) {
+        return false;
+    }
+    Aabb res;
+    for (const Hittable & obj : *this) {
+        Aabb box;
+        if (!obj.bounding_box(box)) {
+            return false;
+        }
+        res.extend(box);
+    }
+    output_box = res;
+    return true;
+}
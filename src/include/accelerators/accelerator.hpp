@@ -0,0 +1,44 @@
+#ifndef ACCELERATOR_HPP
+#define ACCELERATOR_HPP
+
+#include <memory>
+#include <vector>
+
+// From src/include
+#include <accelerators/grid.hpp>
+#include <hittable.hpp>
+
+// Type of the top-level acceleration structure
+enum class AccelerationStructure {
+    // Binary bounding volume hierarchy
+    Bvh = 0,
+    // Wide bounding volume hierarchy, with 4 or 8 children per node
+    WideBvh = 1,
+    // Uniform grid, for many small objects of similar sizes
+    Grid = 2,
+};
+
+// Acceleration structure settings
+struct AccelerationInfo {
+    // Type of the structure
+    AccelerationStructure structure = AccelerationStructure::Bvh;
+    // Number of children per node of wide BVHs (4 or 8)
+    int width = 8;
+    // Number of bits of the quantized child boxes of wide BVHs (8 or 16), 0
+    // to store them as floats
+    int quantization = 0;
+    // Number of cells per object of grids
+    double density = GridTree::DEFAULT_DENSITY;
+    // Whether the primary rays are traced by packets
+    bool packets = true;
+    // Whether the rays of each bounce are sorted and traced by streams
+    bool streams = false;
+};
+
+// Build the acceleration structure over the objects of the scene, and log its
+// statistics
+std::unique_ptr<Hittable>
+    make_accelerator(const std::vector<std::shared_ptr<Hittable>> & objects,
+                     const AccelerationInfo & info);
+
+#endif
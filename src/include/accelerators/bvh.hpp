@@ -0,0 +1,556 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <hittable.hpp>
+#include <ray.hpp>
+#include <ray_packet.hpp>
+#include <utils/aabb.hpp>
+#include <utils/mapped_file.hpp>
+#include <utils/vec3.hpp>
+
+// Node of a flattened bounding volume hierarchy. The two children of an
+// interior node are stored next to each other, after their parent; the order
+// of the pairs is given by the layout of the tree.
+struct BvhNode {
+    // Bounding box of the node
+    Aabb box;
+    // Interior nodes: index of the first child, the second child follows it.
+    // Leaves: index of the first primitive in the primitive index array.
+    uint32_t offset;
+    // Number of primitives in a leaf, 0 for interior nodes
+    uint16_t count;
+    // Split axis of an interior node, used to order the traversal
+    uint16_t axis;
+
+    // Wether the node is a leaf
+    constexpr bool is_leaf() const noexcept { return count != 0; }
+};
+
+// Order of the nodes of a BvhTree in memory. Traversal is bound by the
+// latency of node fetches, so the layout decides how many of them hit the
+// cache.
+enum class BvhLayout {
+    // Depth-first order of the child pairs
+    DepthFirst = 0,
+    // Subtrees of a few cache lines, grown from their root by visit
+    // probability (largest surface area first) and stored contiguously
+    Treelet = 1,
+    // Van Emde Boas order: the top half of the levels is laid out
+    // recursively, followed by each bottom subtree, independently of the
+    // cache size
+    VanEmdeBoas = 2,
+};
+
+// Settings of the spatial split builder
+struct SpatialSplitInfo {
+    // Wether spatial splits are used. Otherwise the tree is built by the
+    // binned SAH builder.
+    bool enabled = false;
+    // Maximum number of additional primitive references created by spatial
+    // splits, relative to the number of primitives
+    double memory_budget = 0.5;
+    // Spatial splits are only tried when the children of the best object
+    // split overlap by more than this fraction of the root surface area
+    double overlap_threshold = 1e-5;
+};
+
+// Bounding volume hierarchy over a set of bounding boxes, built in parallel
+// using the binned surface area heuristic (SAH). The tree only stores
+// primitive indices, so it can be reused for any kind of primitive.
+class BvhTree {
+public:
+    // Maximum number of primitives in a leaf
+    static constexpr size_t MAX_LEAF_SIZE = 4;
+    // Maximum number of primitive batches in a leaf, when the primitives are
+    // intersected a batch at a time
+    static constexpr size_t MAX_LEAF_BATCHES = 2;
+    // Maximum depth of the tree, bounds the traversal stack
+    static constexpr size_t MAX_DEPTH = 64;
+    // Cost of traversing an interior node, relative to a primitive test
+    static constexpr double TRAVERSAL_COST = 0.125;
+    // Refitted trees are rebuilt when their SAH cost grows by this factor
+    static constexpr double MAX_REFIT_COST_GROWTH = 1.5;
+    // Size of the treelets of the treelet layout, in bytes
+    static constexpr size_t TREELET_SIZE = 1024;
+    // Layout of the built trees. The other layouts are compared by changing
+    // it, which also invalidates the cached trees through their key.
+    static constexpr BvhLayout DEFAULT_LAYOUT = BvhLayout::VanEmdeBoas;
+
+private:
+    // Nodes of a tree built in memory
+    std::vector<BvhNode> node_storage;
+    // Primitive indices of a tree built in memory
+    std::vector<uint32_t> index_storage;
+    // Cache file holding the nodes and indices of a tree loaded from disk
+    std::unique_ptr<MappedFile> mapping;
+    // Flattened nodes, the root is the first node
+    std::span<BvhNode> nodes;
+    // Primitive indices, referenced by the leaves
+    std::span<uint32_t> indices;
+    // Depth of the tree
+    size_t tree_depth = 0;
+    // Time spent building the tree, in milliseconds
+    double build_millis = 0.0;
+    // SAH cost of the tree when it was built
+    double build_cost = 0.0;
+
+    // Point the nodes and indices to the in-memory storage
+    inline void use_storage() noexcept {
+        nodes = node_storage;
+        indices = index_storage;
+    }
+
+    // Reorder the nodes produced by the builders, where the first child of an
+    // interior node directly follows it and its offset is the index of the
+    // second child, into the given layout
+    void lay_out_built_nodes(const BvhLayout layout);
+
+public:
+    // Construct an empty tree
+    BvhTree() noexcept = default;
+
+    // Copy a tree. The copy always owns its nodes.
+    BvhTree(const BvhTree & other)
+        : node_storage(other.nodes.begin(), other.nodes.end()),
+          index_storage(other.indices.begin(), other.indices.end()),
+          tree_depth(other.tree_depth), build_millis(other.build_millis),
+          build_cost(other.build_cost) {
+        use_storage();
+    }
+
+    // Copy assignment
+    inline BvhTree & operator=(const BvhTree & other) {
+        return *this = BvhTree(other);
+    }
+
+    // Moving the storage keeps the nodes and indices in place
+    BvhTree(BvhTree &&) noexcept = default;
+    BvhTree & operator=(BvhTree &&) noexcept = default;
+
+    // Build the tree over the bounding boxes of a set of primitives. The
+    // leaves are priced for primitives intersected `leaf_batch_size` at a
+    // time, so that batched primitives get larger leaves.
+    explicit BvhTree(const std::vector<Aabb> & boxes,
+                     const size_t leaf_batch_size = 1);
+
+    // Build the tree over a set of triangles, given by their vertices. With
+    // spatial splits (SBVH), triangles straddling a split plane may be
+    // referenced by both children, so a primitive can appear in several
+    // leaves.
+    BvhTree(const std::vector<std::array<Point3, 3>> & triangles,
+            const SpatialSplitInfo & info,
+            const size_t leaf_batch_size = 1);
+
+    // Maximum number of primitives in a leaf, for primitives intersected
+    // `leaf_batch_size` at a time
+    static constexpr size_t max_leaf_size(
+        const size_t leaf_batch_size) noexcept {
+        return std::max(MAX_LEAF_SIZE, MAX_LEAF_BATCHES * leaf_batch_size);
+    }
+
+    // SAH cost of intersecting `count` primitives `leaf_batch_size` at a
+    // time, relative to a primitive test
+    static constexpr double leaf_cost(const size_t count,
+                                      const size_t leaf_batch_size) noexcept {
+        return double((count + leaf_batch_size - 1) / leaf_batch_size);
+    }
+
+    // Flattened nodes of the tree
+    inline std::span<const BvhNode> get_nodes() const noexcept { return nodes; }
+
+    // Primitive indices, in the order of the leaves. With spatial splits, an
+    // index may appear several times.
+    inline std::span<const uint32_t> primitive_indices() const noexcept {
+        return indices;
+    }
+
+    // Number of nodes in the tree
+    inline size_t node_count() const noexcept { return nodes.size(); }
+
+    // Memory used by the nodes and primitive indices, in bytes
+    inline size_t memory_usage() const noexcept {
+        return nodes.size() * sizeof(BvhNode)
+               + indices.size() * sizeof(uint32_t);
+    }
+
+    // Depth of the tree
+    inline size_t depth() const noexcept { return tree_depth; }
+
+    // Time spent building the tree, in milliseconds
+    inline double build_time() const noexcept { return build_millis; }
+
+    // Build throughput, in primitives per second
+    inline double build_throughput() const noexcept {
+        return build_millis > 0.0 ? 1000.0 * indices.size() / build_millis
+                                  : 0.0;
+    }
+
+    // Bounding box of the whole tree
+    inline Aabb bounds() const noexcept {
+        return nodes.empty() ? Aabb() : nodes[0].box;
+    }
+
+    // SAH cost of the tree, relative to the surface area of the root
+    double sah_cost() const noexcept;
+
+    // Growth of the SAH cost since the tree was built
+    inline double cost_growth() const noexcept {
+        return build_cost > 0.0 ? sah_cost() / build_cost : 1.0;
+    }
+
+    // Update the node bounds bottom-up after the primitives moved, keeping
+    // the topology of the tree. `boxes` are the new bounding boxes of the
+    // primitives, in the order used to build the tree.
+    void refit(const std::vector<Aabb> & boxes) noexcept;
+
+    // Refit the tree, and rebuild it if the refitted tree is too slow to
+    // traverse. Returns whether the tree was rebuilt.
+    bool update(const std::vector<Aabb> & boxes,
+                const double max_cost_growth = MAX_REFIT_COST_GROWTH);
+
+    // Content hash of a triangle mesh and of the settings used to build its
+    // tree, identifying a cached tree
+    static uint64_t cache_key(
+        const std::vector<std::array<Point3, 3>> & triangles,
+        const SpatialSplitInfo & info,
+        const size_t leaf_batch_size = 1) noexcept;
+
+    // Key of a tree built over a geometry identified by its own content hash
+    static uint64_t cache_key(const uint64_t geometry_key,
+                              const SpatialSplitInfo & info,
+                              const size_t leaf_batch_size = 1) noexcept;
+
+    // Load a tree from a cache file, by mapping it in memory. Returns false,
+    // leaving the tree unchanged, if the file is missing, invalid, or was
+    // written for another key.
+    bool load_cache(const std::string & file_name, const uint64_t key);
+
+    // Write the tree to a cache file. Returns false if it could not be
+    // written.
+    bool save_cache(const std::string & file_name, const uint64_t key) const;
+
+    // Traverse the tree front to back along a ray. For every primitive in a
+    // leaf reached by the ray, call `hit_primitive(index, tmax)`, which must
+    // return true and shrink tmax on a hit.
+    template <class F>
+    inline bool traverse(const Ray & ray,
+                         const double tmin,
+                         const double tmax,
+                         F && hit_primitive) const noexcept {
+        return traverse_leaves(
+            ray, tmin, tmax,
+            [&](uint32_t first, uint32_t count, double & t_max) {
+                bool hit = false;
+                for (uint32_t i = first; i < first + count; ++i) {
+                    if (hit_primitive(indices[i], t_max)) {
+                        hit = true;
+                    }
+                }
+                return hit;
+            });
+    }
+
+    // Traverse the tree front to back along a ray. For every leaf reached by
+    // the ray, call `hit_leaf(first, count, tmax)` with the range of its
+    // primitives in the primitive index array, which must return true and
+    // shrink tmax on a hit.
+    template <class F>
+    inline bool traverse_leaves(const Ray & ray,
+                                const double tmin,
+                                const double tmax,
+                                F && hit_leaf) const noexcept {
+        return traverse_leaves(nodes, ray, tmin, tmax, hit_leaf);
+    }
+
+    // Traverse flattened nodes laid out as in a tree, such as a subtree
+    // stored apart from its tree, like `traverse_leaves` above
+    template <class F>
+    static inline bool traverse_leaves(const std::span<const BvhNode> nodes,
+                                       const Ray & ray,
+                                       const double tmin,
+                                       double tmax,
+                                       F && hit_leaf) noexcept {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const Vec3 inv_direction = 1.0 / ray.direction;
+        const bool dir_is_neg[3] = { inv_direction.x < 0, inv_direction.y < 0,
+                                     inv_direction.z < 0 };
+        uint32_t stack[MAX_DEPTH];
+        size_t stack_size = 0;
+        uint32_t current = 0;
+        bool hit = false;
+
+        while (true) {
+            const BvhNode & node = nodes[current];
+            if (node.box.hit(ray.origin, inv_direction, tmin, tmax)) {
+                if (node.is_leaf()) {
+                    if (hit_leaf(node.offset, node.count, tmax)) {
+                        hit = true;
+                    }
+                } else if (dir_is_neg[node.axis]) {
+                    // Visit the second child first
+                    stack[stack_size++] = node.offset;
+                    current = node.offset + 1;
+                    continue;
+                } else {
+                    stack[stack_size++] = node.offset + 1;
+                    current = node.offset;
+                    continue;
+                }
+            }
+            if (stack_size == 0) {
+                break;
+            }
+            current = stack[--stack_size];
+        }
+
+        return hit;
+    }
+
+    // Traverse the tree with a packet of rays, visiting a node when any
+    // active lane hits its box. For every primitive in a leaf reached by the
+    // packet, call `hit_primitives(index, lanes)` with the lanes hitting the
+    // leaf, which must return the lanes hit and shrink their tmax. Returns
+    // the mask of the lanes hit.
+    template <class F>
+    inline unsigned traverse_packet(const RayPacket & packet,
+                                    const unsigned mask,
+                                    const double tmin,
+                                    double * tmax,
+                                    F && hit_primitives) const noexcept {
+        if (nodes.empty() || mask == 0) {
+            return 0;
+        }
+
+        // The children are ordered along the direction of the first active
+        // ray, which is close to the other directions of a coherent packet
+        const Vec3 & direction = packet.rays[std::countr_zero(mask)].direction;
+        const bool dir_is_neg[3] = { direction.x < 0, direction.y < 0,
+                                     direction.z < 0 };
+        uint32_t stack[MAX_DEPTH];
+        size_t stack_size = 0;
+        uint32_t current = 0;
+        unsigned hit = 0;
+
+        while (true) {
+            const BvhNode & node = nodes[current];
+            const unsigned lanes = packet.hit_box(node.box, tmin, tmax) & mask;
+            if (lanes) {
+                if (node.is_leaf()) {
+                    for (uint32_t i = 0; i < node.count; ++i) {
+                        hit |= hit_primitives(indices[node.offset + i], lanes);
+                    }
+                } else if (dir_is_neg[node.axis]) {
+                    // Visit the second child first
+                    stack[stack_size++] = node.offset;
+                    current = node.offset + 1;
+                    continue;
+                } else {
+                    stack[stack_size++] = node.offset + 1;
+                    current = node.offset;
+                    continue;
+                }
+            }
+            if (stack_size == 0) {
+                break;
+            }
+            current = stack[--stack_size];
+        }
+
+        return hit;
+    }
+
+    // Traverse the tree along a ray until `occluded_primitive(index)` returns
+    // true for a primitive of a leaf reached by the ray. Returns whether such
+    // a primitive was found.
+    template <class F>
+    inline bool traverse_any(const Ray & ray,
+                             const double tmin,
+                             const double tmax,
+                             F && occluded_primitive) const noexcept {
+        return traverse_any_leaves(
+            ray, tmin, tmax, [&](uint32_t first, uint32_t count) {
+                for (uint32_t i = first; i < first + count; ++i) {
+                    if (occluded_primitive(indices[i])) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+    }
+
+    // Traverse the tree along a ray until `occluded_leaf(first, count)`
+    // returns true for a leaf reached by the ray, given the range of its
+    // primitives in the primitive index array. Returns whether such a leaf
+    // was found.
+    template <class F>
+    inline bool traverse_any_leaves(const Ray & ray,
+                                    const double tmin,
+                                    const double tmax,
+                                    F && occluded_leaf) const noexcept {
+        return traverse_any_leaves(nodes, ray, tmin, tmax, occluded_leaf);
+    }
+
+    // Traverse flattened nodes laid out as in a tree, such as a subtree
+    // stored apart from its tree, like `traverse_any_leaves` above
+    template <class F>
+    static inline bool
+        traverse_any_leaves(const std::span<const BvhNode> nodes,
+                            const Ray & ray,
+                            const double tmin,
+                            const double tmax,
+                            F && occluded_leaf) noexcept {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const Vec3 inv_direction = 1.0 / ray.direction;
+        uint32_t stack[MAX_DEPTH];
+        size_t stack_size = 0;
+        uint32_t current = 0;
+
+        while (true) {
+            const BvhNode & node = nodes[current];
+            if (node.box.hit(ray.origin, inv_direction, tmin, tmax)) {
+                if (node.is_leaf()) {
+                    if (occluded_leaf(node.offset, node.count)) {
+                        return true;
+                    }
+                } else {
+                    stack[stack_size++] = node.offset + 1;
+                    current = node.offset;
+                    continue;
+                }
+            }
+            if (stack_size == 0) {
+                return false;
+            }
+            current = stack[--stack_size];
+        }
+    }
+};
+
+// A bounding volume hierarchy of hittable objects, generic over the tree
+// layout. Unbounded objects are tested linearly after the tree.
+template <class Tree>
+class BasicBvh : public Hittable {
+private:
+    // The acceleration structure
+    Tree tree;
+    // The bounded objects, indexed by the tree
+    std::vector<std::reference_wrapper<const Hittable>> objects;
+    // Objects without a bounding box
+    HittableList unbounded;
+
+public:
+    // Build a BVH over a list of objects. The extra arguments are forwarded
+    // to the constructor of the tree.
+    template <class... Args>
+    explicit BasicBvh(const std::vector<std::shared_ptr<Hittable>> & objects,
+                      const Args &... tree_args) {
+        std::vector<Aabb> boxes;
+        for (const std::shared_ptr<Hittable> & obj : objects) {
+            Aabb box;
+            if (obj->bounding_box(box)) {
+                boxes.push_back(box);
+                this->objects.push_back(std::cref(*obj));
+            } else {
+                unbounded.add(*obj);
+            }
+        }
+        tree = Tree(boxes, tree_args...);
+    }
+
+    // The inner tree
+    inline const Tree & get_tree() const noexcept { return tree; }
+
+    // Number of objects put in the tree
+    inline size_t bounded_count() const noexcept { return objects.size(); }
+
+    // Update the tree after the objects moved or deformed. The tree is
+    // refitted, or rebuilt if its SAH cost grew by more than
+    // `max_cost_growth`. Returns whether the tree was rebuilt.
+    bool
+        update(const double max_cost_growth = BvhTree::MAX_REFIT_COST_GROWTH) {
+        std::vector<Aabb> boxes(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i) {
+            objects[i].get().bounding_box(boxes[i]);
+        }
+        return tree.update(boxes, max_cost_growth);
+    }
+
+    // Hit method override
+    virtual bool hit(const Ray & ray,
+                     const double tmin,
+                     double tmax,
+                     HitRecord & hit_record) const noexcept override {
+        bool hit = tree.traverse(ray, tmin, tmax,
+                                 [&](uint32_t index, double & t_max) {
+                                     if (objects[index].get().hit(
+                                             ray, tmin, t_max, hit_record)) {
+                                         t_max = hit_record.time;
+                                         return true;
+                                     }
+                                     return false;
+                                 });
+        if (hit) {
+            tmax = hit_record.time;
+        }
+        if (unbounded.hit(ray, tmin, tmax, hit_record)) {
+            hit = true;
+        }
+        return hit;
+    }
+
+    // Virtual function override
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept override {
+        const unsigned hit = tree.traverse_packet(
+            packet, mask, tmin, tmax, [&](uint32_t index, unsigned lanes) {
+                return objects[index].get().hit_packet(packet, lanes, tmin,
+                                                       tmax, records);
+            });
+        return hit | unbounded.hit_packet(packet, mask, tmin, tmax, records);
+    }
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray,
+                          const double tmin,
+                          const double tmax) const noexcept override {
+        return tree.traverse_any(ray, tmin, tmax,
+                                 [&](uint32_t index) {
+                                     return objects[index].get().occluded(
+                                         ray, tmin, tmax);
+                                 })
+               || unbounded.occluded(ray, tmin, tmax);
+    }
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override {
+        if (!unbounded.empty() || objects.empty()) {
+            return false;
+        }
+        output_box = tree.bounds();
+        return true;
+    }
+};
+
+// Binary bounding volume hierarchy of hittable objects
+using Bvh = BasicBvh<BvhTree>;
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef COMPRESSED_BVH_HPP
+#define COMPRESSED_BVH_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+// From src/include
+#include <accelerators/wide_bvh.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+// Node of a wide bounding volume hierarchy with quantized child boxes. The
+// child bounds are stored as 8 or 16 bit integer offsets on a grid anchored at
+// the minimum corner of the node, with a power of two cell size per axis.
+// Quantized bounds are rounded outwards, and their decoding is exact, so the
+// decoded boxes always contain the original ones.
+template <size_t N, class Q>
+struct CompressedWideBvhNode {
+    static_assert(N == 4 || N == 8, "Wide BVH nodes have 4 or 8 children");
+    static_assert(std::is_same_v<Q, uint8_t> || std::is_same_v<Q, uint16_t>,
+                  "Child bounds are quantized on 8 or 16 bits");
+
+    // Number of children
+    static constexpr size_t WIDTH = N;
+    // Largest quantized coordinate
+    static constexpr unsigned Q_MAX = std::numeric_limits<Q>::max();
+
+    // Origin of the quantization grid
+    float origin[3];
+    // Cell size of the grid along each axis, as a power of two exponent
+    int8_t exponent[3];
+    // Number of valid children, stored first
+    uint8_t child_count;
+    // Inner children: index of the node.
+    // Leaf children: index of the first primitive in the primitive indices.
+    uint32_t child[N];
+    // Number of primitives of leaf children, 0 for inner children
+    uint8_t count[N];
+    // Quantized child bounds: min x, min y, min z, max x, max y, max z
+    Q bounds[6][N];
+
+    // Set the bounding boxes of the children
+    void set_boxes(const Aabb * boxes, size_t box_count) noexcept;
+
+    // Cell size of the grid along an axis
+    inline double scale(int axis) const noexcept {
+        return std::ldexp(1.0, exponent[axis]);
+    }
+
+    // Decode a quantized coordinate. The product is exact, so the result is
+    // rounded only once, with or without fused multiply-add.
+    inline double decode(int axis, unsigned q) const noexcept {
+        return double(origin[axis]) + double(q) * scale(axis);
+    }
+
+    // Get the decoded bounding box of a child
+    inline Aabb get_box(size_t i) const noexcept {
+        return Aabb(Point3(decode(0, bounds[0][i]), decode(1, bounds[1][i]),
+                           decode(2, bounds[2][i])),
+                    Point3(decode(0, bounds[3][i]), decode(1, bounds[4][i]),
+                           decode(2, bounds[5][i])));
+    }
+
+    // Intersect a ray with all the children. Returns the mask of the children
+    // hit, and writes their entry distances to t_near.
+    inline unsigned intersect(const WideRay & ray,
+                              const double tmin,
+                              const double tmax,
+                              double * t_near) const noexcept {
+        unsigned mask = 0;
+#ifdef __AVX2__
+        const __m256d o[3] = { _mm256_set1_pd(origin[0]),
+                               _mm256_set1_pd(origin[1]),
+                               _mm256_set1_pd(origin[2]) };
+        const __m256d s[3] = { _mm256_set1_pd(scale(0)),
+                               _mm256_set1_pd(scale(1)),
+                               _mm256_set1_pd(scale(2)) };
+        for (size_t g = 0; g < N; g += 4) {
+            const auto load = [&](int plane) {
+                __m128i q;
+                if constexpr (std::is_same_v<Q, uint8_t>) {
+                    int32_t packed;
+                    std::memcpy(&packed, &bounds[plane][g], sizeof(packed));
+                    q = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+                } else {
+                    q = _mm_cvtepu16_epi32(_mm_loadl_epi64(
+                        reinterpret_cast<const __m128i *>(&bounds[plane][g])));
+                }
+                return _mm256_add_pd(o[plane % 3],
+                                     _mm256_mul_pd(_mm256_cvtepi32_pd(q),
+                                                   s[plane % 3]));
+            };
+            mask |= slab_test4(ray, load(0), load(1), load(2), load(3),
+                               load(4), load(5), tmin, tmax, t_near + g)
+                    << g;
+        }
+#else
+        for (size_t i = 0; i < child_count; ++i) {
+            mask |= unsigned(slab_test(ray, get_box(i), tmin, tmax, t_near[i]))
+                    << i;
+        }
+#endif
+        return mask & ((1u << child_count) - 1);
+    }
+};
+
+// Compressed wide bounding volume hierarchy of hittable objects
+template <size_t N, class Q>
+using CompressedBvh = BasicBvh<WideBvhTree<CompressedWideBvhNode<N, Q>>>;
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef GRID_HPP
+#define GRID_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <ray.hpp>
+#include <ray_packet.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+// Uniform grid over a set of bounding boxes. Each cell lists the primitives
+// overlapping it, and rays walk through the cells front to back with a 3D-DDA.
+// The grid is built in linear time, which pays off over trees for many small
+// primitives of similar sizes (particles, point clouds). Like BvhTree, it only
+// stores primitive indices.
+class GridTree {
+public:
+    // Default number of cells per primitive
+    static constexpr double DEFAULT_DENSITY = 2.0;
+    // Maximum number of cells along an axis
+    static constexpr int MAX_RESOLUTION = 1024;
+    // Number of entries of the mailbox of a ray. Must be a power of 2.
+    static constexpr size_t MAILBOX_SIZE = 32;
+
+private:
+    // Empty mailbox entry
+    static constexpr uint32_t NO_PRIMITIVE = UINT32_MAX;
+
+    // Index of the first primitive of each cell in cell_objects, followed by
+    // the total number of references
+    std::vector<uint32_t> cell_offsets;
+    // Primitive indices, grouped by cell
+    std::vector<uint32_t> cell_objects;
+    // Bounding box of the grid
+    Aabb root_box;
+    // Number of cells along each axis
+    int resolution[3] = { 0, 0, 0 };
+    // Size of a cell
+    Vec3 cell_size;
+    // Componentwise inverse of the size of a cell
+    Vec3 inv_cell_size;
+    // Number of cells per primitive requested at build time
+    double density = DEFAULT_DENSITY;
+    // Number of primitives
+    size_t primitive_count = 0;
+    // Time spent building the grid, in milliseconds
+    double build_millis = 0.0;
+
+    // Index of the cell containing a coordinate along an axis, clamped to
+    // the grid
+    inline int cell_coordinate(const double x, const int axis) const noexcept {
+        // Clamped before the conversion, which overflows far from the grid.
+        // NaN coordinates go to the first cell.
+        const double cell = (x - root_box.min[axis]) * inv_cell_size[axis];
+        if (!(cell > 0.0)) {
+            return 0;
+        }
+        return int(std::min(cell, double(resolution[axis] - 1)));
+    }
+
+    // Walk the cells pierced by a ray in [tmin, tmax] front to back, calling
+    // `visit(cell)` on each, until `visit` returns true or the next cell
+    // starts after tmax. tmax may shrink during the walk.
+    template <class F>
+    inline void walk(const Ray & ray,
+                     const double tmin,
+                     const double & tmax,
+                     F && visit) const noexcept {
+        // Clip the ray to the grid
+        double t_enter = tmin;
+        double t_exit = tmax;
+        for (int a = 0; a < 3; ++a) {
+            const double inv_direction = 1.0 / ray.direction[a];
+            double t0 = (root_box.min[a] - ray.origin[a]) * inv_direction;
+            double t1 = (root_box.max[a] - ray.origin[a]) * inv_direction;
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+            t_enter = std::max(t_enter, t0);
+            t_exit = std::min(t_exit, t1);
+        }
+        if (t_enter > t_exit) {
+            return;
+        }
+
+        // Set up the 3D-DDA from the entry point
+        const Point3 entry = ray.at(t_enter);
+        int cell[3];
+        int step[3];
+        int out[3];
+        double t_next[3];
+        double t_delta[3];
+        for (int a = 0; a < 3; ++a) {
+            cell[a] = cell_coordinate(entry[a], a);
+            const double direction = ray.direction[a];
+            if (direction > 0) {
+                step[a] = 1;
+                out[a] = resolution[a];
+                t_next[a] = (root_box.min[a] + (cell[a] + 1) * cell_size[a]
+                             - ray.origin[a])
+                            / direction;
+                t_delta[a] = cell_size[a] / direction;
+            } else if (direction < 0) {
+                step[a] = -1;
+                out[a] = -1;
+                t_next[a] =
+                    (root_box.min[a] + cell[a] * cell_size[a] - ray.origin[a])
+                    / direction;
+                t_delta[a] = -cell_size[a] / direction;
+            } else {
+                step[a] = 0;
+                out[a] = -1;
+                t_next[a] = utils::INF;
+                t_delta[a] = utils::INF;
+            }
+        }
+
+        while (true) {
+            const size_t index =
+                (size_t(cell[2]) * resolution[1] + cell[1]) * resolution[0]
+                + cell[0];
+            if (visit(index)) {
+                return;
+            }
+
+            // Step to the neighbouring cell through the nearest face
+            const int a = t_next[0] < t_next[1]
+                              ? (t_next[0] < t_next[2] ? 0 : 2)
+                              : (t_next[1] < t_next[2] ? 1 : 2);
+            if (t_next[a] > tmax || t_next[a] > t_exit) {
+                return;
+            }
+            cell[a] += step[a];
+            if (cell[a] == out[a]) {
+                return;
+            }
+            t_next[a] += t_delta[a];
+        }
+    }
+
+public:
+    // Construct an empty grid
+    GridTree() noexcept = default;
+
+    // Build the grid over the bounding boxes of a set of primitives, with
+    // about `density` cells per primitive
+    explicit GridTree(const std::vector<Aabb> & boxes,
+                      const double density = DEFAULT_DENSITY);
+
+    // Number of cells along each axis
+    inline const int * get_resolution() const noexcept { return resolution; }
+
+    // Number of cells in the grid
+    inline size_t cell_count() const noexcept {
+        return cell_offsets.empty() ? 0 : cell_offsets.size() - 1;
+    }
+
+    // Number of primitive references stored in the cells
+    inline size_t reference_count() const noexcept {
+        return cell_objects.size();
+    }
+
+    // Memory used by the cells and primitive indices, in bytes
+    inline size_t memory_usage() const noexcept {
+        return (cell_offsets.size() + cell_objects.size()) * sizeof(uint32_t);
+    }
+
+    // Time spent building the grid, in milliseconds
+    inline double build_time() const noexcept { return build_millis; }
+
+    // Build throughput, in primitives per second
+    inline double build_throughput() const noexcept {
+        return build_millis > 0.0 ? 1000.0 * primitive_count / build_millis
+                                  : 0.0;
+    }
+
+    // Bounding box of the whole grid
+    inline Aabb bounds() const noexcept { return root_box; }
+
+    // Rebuild the grid after the primitives moved. A grid cannot be refitted,
+    // so it is always rebuilt. Returns true.
+    bool update(const std::vector<Aabb> & boxes,
+                const double max_cost_growth = BvhTree::MAX_REFIT_COST_GROWTH);
+
+    // Traverse the grid front to back along a ray. For every primitive in a
+    // cell reached by the ray, call `hit_primitive(index, tmax)`, which must
+    // return true and shrink tmax on a hit. Primitives overlapping several
+    // cells are only tested once, thanks to a small mailbox of the last
+    // primitives tested.
+    template <class F>
+    inline bool traverse(const Ray & ray,
+                         const double tmin,
+                         double tmax,
+                         F && hit_primitive) const noexcept {
+        if (cell_offsets.empty()) {
+            return false;
+        }
+
+        uint32_t mailbox[MAILBOX_SIZE];
+        std::fill_n(mailbox, MAILBOX_SIZE, NO_PRIMITIVE);
+        bool hit = false;
+        walk(ray, tmin, tmax, [&](size_t cell) {
+            for (uint32_t i = cell_offsets[cell]; i < cell_offsets[cell + 1];
+                 ++i) {
+                const uint32_t index = cell_objects[i];
+                uint32_t & slot = mailbox[index & (MAILBOX_SIZE - 1)];
+                if (slot == index) {
+                    continue;
+                }
+                slot = index;
+                if (hit_primitive(index, tmax)) {
+                    hit = true;
+                }
+            }
+            return false;
+        });
+        return hit;
+    }
+
+    // Traverse the grid with a packet of rays. Rays do not visit the same
+    // cells, so each active lane walks the grid on its own. For every
+    // primitive in a cell reached by a lane, call
+    // `hit_primitives(index, lane)`, which must return the lanes hit and
+    // shrink their tmax. Returns the mask of the lanes hit.
+    template <class F>
+    inline unsigned traverse_packet(const RayPacket & packet,
+                                    const unsigned mask,
+                                    const double tmin,
+                                    double * tmax,
+                                    F && hit_primitives) const noexcept {
+        unsigned hit = 0;
+        for (unsigned m = mask; m; m &= m - 1) {
+            const unsigned l = std::countr_zero(m);
+            if (traverse(packet.rays[l], tmin, tmax[l],
+                         [&](uint32_t index, double & t_max) {
+                             if (hit_primitives(index, 1u << l)) {
+                                 t_max = tmax[l];
+                                 return true;
+                             }
+                             return false;
+                         })) {
+                hit |= 1u << l;
+            }
+        }
+        return hit;
+    }
+
+    // Traverse the grid along a ray until `occluded_primitive(index)` returns
+    // true for a primitive of a cell reached by the ray. Returns whether such
+    // a primitive was found.
+    template <class F>
+    inline bool traverse_any(const Ray & ray,
+                             const double tmin,
+                             const double tmax,
+                             F && occluded_primitive) const noexcept {
+        if (cell_offsets.empty()) {
+            return false;
+        }
+
+        uint32_t mailbox[MAILBOX_SIZE];
+        std::fill_n(mailbox, MAILBOX_SIZE, NO_PRIMITIVE);
+        bool occluded = false;
+        walk(ray, tmin, tmax, [&](size_t cell) {
+            for (uint32_t i = cell_offsets[cell]; i < cell_offsets[cell + 1];
+                 ++i) {
+                const uint32_t index = cell_objects[i];
+                uint32_t & slot = mailbox[index & (MAILBOX_SIZE - 1)];
+                if (slot == index) {
+                    continue;
+                }
+                slot = index;
+                if (occluded_primitive(index)) {
+                    occluded = true;
+                    return true;
+                }
+            }
+            return false;
+        });
+        return occluded;
+    }
+};
+
+// Uniform grid of hittable objects
+using Grid = BasicBvh<GridTree>;
+
+#endif
@@ -0,0 +1,439 @@
+#ifndef WIDE_BVH_HPP
+#define WIDE_BVH_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <ray.hpp>
+#include <ray_packet.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+// Ray data broadcast for the SIMD box tests of wide BVH nodes
+struct WideRay {
+    // Origin of the ray
+    Point3 origin;
+    // Componentwise inverse of the ray direction
+    Vec3 inv_direction;
+#ifdef __AVX2__
+    // Broadcast origin and inverse direction
+    __m256d ox, oy, oz, ix, iy, iz;
+#endif
+
+    // Construct an uninitialized ray
+    WideRay() noexcept = default;
+
+    // Prepare a ray for the box tests
+    inline WideRay(const Ray & ray) noexcept
+        : origin(ray.origin), inv_direction(1.0 / ray.direction) {
+#ifdef __AVX2__
+        ox = _mm256_set1_pd(origin.x);
+        oy = _mm256_set1_pd(origin.y);
+        oz = _mm256_set1_pd(origin.z);
+        ix = _mm256_set1_pd(inv_direction.x);
+        iy = _mm256_set1_pd(inv_direction.y);
+        iz = _mm256_set1_pd(inv_direction.z);
+#endif
+    }
+};
+
+#ifdef __AVX2__
+// Slab test of four boxes against a ray. Returns the mask of the boxes hit in
+// [tmin, tmax] and writes their entry distances to t_near.
+inline unsigned slab_test4(const WideRay & ray,
+                           const __m256d min_x,
+                           const __m256d min_y,
+                           const __m256d min_z,
+                           const __m256d max_x,
+                           const __m256d max_y,
+                           const __m256d max_z,
+                           const double tmin,
+                           const double tmax,
+                           double * t_near) noexcept {
+    const __m256d t0x = _mm256_mul_pd(_mm256_sub_pd(min_x, ray.ox), ray.ix);
+    const __m256d t0y = _mm256_mul_pd(_mm256_sub_pd(min_y, ray.oy), ray.iy);
+    const __m256d t0z = _mm256_mul_pd(_mm256_sub_pd(min_z, ray.oz), ray.iz);
+    const __m256d t1x = _mm256_mul_pd(_mm256_sub_pd(max_x, ray.ox), ray.ix);
+    const __m256d t1y = _mm256_mul_pd(_mm256_sub_pd(max_y, ray.oy), ray.iy);
+    const __m256d t1z = _mm256_mul_pd(_mm256_sub_pd(max_z, ray.oz), ray.iz);
+    const __m256d near = _mm256_max_pd(
+        _mm256_max_pd(_mm256_min_pd(t0x, t1x), _mm256_min_pd(t0y, t1y)),
+        _mm256_max_pd(_mm256_min_pd(t0z, t1z), _mm256_set1_pd(tmin)));
+    const __m256d far = _mm256_min_pd(
+        _mm256_min_pd(_mm256_max_pd(t0x, t1x), _mm256_max_pd(t0y, t1y)),
+        _mm256_min_pd(_mm256_max_pd(t0z, t1z), _mm256_set1_pd(tmax)));
+    _mm256_storeu_pd(t_near, near);
+    return _mm256_movemask_pd(_mm256_cmp_pd(near, far, _CMP_LE_OQ));
+}
+#endif
+
+// Scalar slab test of a box against a ray. Returns whether the box is hit in
+// [tmin, tmax] and writes the entry distance to t_near.
+inline bool slab_test(const WideRay & ray,
+                      const Aabb & box,
+                      const double tmin,
+                      const double tmax,
+                      double & t_near) noexcept {
+    const Vec3 t0 = (box.min - ray.origin) * ray.inv_direction;
+    const Vec3 t1 = (box.max - ray.origin) * ray.inv_direction;
+    t_near = std::max(std::max(std::min(t0.x, t1.x), std::min(t0.y, t1.y)),
+                      std::max(std::min(t0.z, t1.z), tmin));
+    const double t_far =
+        std::min(std::min(std::max(t0.x, t1.x), std::max(t0.y, t1.y)),
+                 std::min(std::max(t0.z, t1.z), tmax));
+    return t_near <= t_far;
+}
+
+// Node of a wide bounding volume hierarchy, with N children. The child boxes
+// are stored as a structure of arrays of floats, rounded outwards so that the
+// boxes stay conservative.
+template <size_t N>
+struct alignas(32) WideBvhNode {
+    static_assert(N == 4 || N == 8, "Wide BVH nodes have 4 or 8 children");
+
+    // Number of children
+    static constexpr size_t WIDTH = N;
+
+    // Child bounds: min x, min y, min z, max x, max y, max z
+    float bounds[6][N];
+    // Inner children: index of the node.
+    // Leaf children: index of the first primitive in the primitive indices.
+    uint32_t child[N];
+    // Number of primitives of leaf children, 0 for inner children
+    uint8_t count[N];
+    // Number of valid children, stored first
+    uint8_t child_count;
+
+    // Set the bounding boxes of the children
+    void set_boxes(const Aabb * boxes, size_t box_count) noexcept;
+
+    // Get the bounding box of a child
+    inline Aabb get_box(size_t i) const noexcept {
+        return Aabb(Point3(bounds[0][i], bounds[1][i], bounds[2][i]),
+                    Point3(bounds[3][i], bounds[4][i], bounds[5][i]));
+    }
+
+    // Intersect a ray with all the children. Returns the mask of the children
+    // hit, and writes their entry distances to t_near.
+    inline unsigned intersect(const WideRay & ray,
+                              const double tmin,
+                              const double tmax,
+                              double * t_near) const noexcept {
+        unsigned mask = 0;
+#ifdef __AVX2__
+        for (size_t g = 0; g < N; g += 4) {
+            const auto load = [&](int plane) {
+                return _mm256_cvtps_pd(_mm_load_ps(&bounds[plane][g]));
+            };
+            mask |= slab_test4(ray, load(0), load(1), load(2), load(3),
+                               load(4), load(5), tmin, tmax, t_near + g)
+                    << g;
+        }
+#else
+        for (size_t i = 0; i < child_count; ++i) {
+            mask |= unsigned(slab_test(ray, get_box(i), tmin, tmax, t_near[i]))
+                    << i;
+        }
+#endif
+        return mask & ((1u << child_count) - 1);
+    }
+};
+
+// Wide bounding volume hierarchy, built by collapsing a binary BvhTree.
+// Each node tests all its children against a ray at once, and visits them
+// front to back. The node layout is given by the Node type.
+template <class Node>
+class WideBvhTree {
+public:
+    // Number of children per node
+    static constexpr size_t N = Node::WIDTH;
+    // Maximum size of the traversal stack
+    static constexpr size_t STACK_SIZE = BvhTree::MAX_DEPTH * (N - 1) + 1;
+
+private:
+    // Flattened nodes, the root is the first node
+    std::vector<Node> nodes;
+    // Primitive indices, referenced by the leaves
+    std::vector<uint32_t> indices;
+    // Bounding box of the whole tree
+    Aabb root_box;
+    // Depth of the tree
+    size_t tree_depth = 0;
+    // Time spent building the tree, in milliseconds
+    double build_millis = 0.0;
+    // SAH cost of the tree when it was built
+    double build_cost = 0.0;
+
+    // Entry of the traversal stack
+    struct StackEntry {
+        // Entry distance of the ray in the child box
+        double t_near;
+        // Node index or first primitive
+        uint32_t child;
+        // Number of primitives, 0 for inner nodes
+        uint32_t count;
+    };
+
+    // Entry of the packet traversal stack
+    struct PacketStackEntry {
+        // Smallest entry distance of the lanes in the child box
+        double t_near;
+        // Node index or first primitive
+        uint32_t child;
+        // Number of primitives, 0 for inner nodes
+        uint16_t count;
+        // Lanes of the packet hitting the child box
+        uint16_t lanes;
+    };
+
+    // Collapse the binary subtree under `binary_index` in a new wide node.
+    // Returns the depth of the wide subtree.
+    size_t collapse(std::span<const BvhNode> binary, uint32_t binary_index);
+
+public:
+    // Construct an empty tree
+    WideBvhTree() noexcept = default;
+
+    // Build the tree over the bounding boxes of a set of primitives
+    explicit WideBvhTree(const std::vector<Aabb> & boxes);
+
+    // Collapse a binary tree
+    explicit WideBvhTree(const BvhTree & binary);
+
+    // Number of nodes in the tree
+    inline size_t node_count() const noexcept { return nodes.size(); }
+
+    // Memory used by the nodes and primitive indices, in bytes
+    inline size_t memory_usage() const noexcept {
+        return nodes.size() * sizeof(Node) + indices.size() * sizeof(uint32_t);
+    }
+
+    // Depth of the tree
+    inline size_t depth() const noexcept { return tree_depth; }
+
+    // Time spent building the tree, in milliseconds
+    inline double build_time() const noexcept { return build_millis; }
+
+    // Build throughput, in primitives per second
+    inline double build_throughput() const noexcept {
+        return build_millis > 0.0 ? 1000.0 * indices.size() / build_millis
+                                  : 0.0;
+    }
+
+    // Bounding box of the whole tree
+    inline Aabb bounds() const noexcept { return root_box; }
+
+    // SAH cost of the tree, relative to the surface area of the root
+    double sah_cost() const noexcept;
+
+    // Growth of the SAH cost since the tree was built
+    inline double cost_growth() const noexcept {
+        return build_cost > 0.0 ? sah_cost() / build_cost : 1.0;
+    }
+
+    // Update the child bounds bottom-up after the primitives moved, keeping
+    // the topology of the tree. `boxes` are the new bounding boxes of the
+    // primitives, in the order used to build the tree.
+    void refit(const std::vector<Aabb> & boxes) noexcept;
+
+    // Refit the tree, and rebuild it if the refitted tree is too slow to
+    // traverse. Returns whether the tree was rebuilt.
+    bool update(const std::vector<Aabb> & boxes,
+                const double max_cost_growth = BvhTree::MAX_REFIT_COST_GROWTH);
+
+    // Traverse the tree front to back along a ray. For every primitive in a
+    // leaf reached by the ray, call `hit_primitive(index, tmax)`, which must
+    // return true and shrink tmax on a hit.
+    template <class F>
+    inline bool traverse(const Ray & ray,
+                         const double tmin,
+                         double tmax,
+                         F && hit_primitive) const noexcept {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const WideRay wide_ray(ray);
+        StackEntry stack[STACK_SIZE];
+        size_t stack_size = 0;
+        stack[stack_size++] = StackEntry { tmin, 0, 0 };
+        bool hit = false;
+
+        while (stack_size != 0) {
+            const StackEntry entry = stack[--stack_size];
+            if (entry.t_near > tmax) {
+                // A closer hit was found since the entry was pushed
+                continue;
+            }
+            if (entry.count != 0) {
+                for (uint32_t i = 0; i < entry.count; ++i) {
+                    if (hit_primitive(indices[entry.child + i], tmax)) {
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+
+            const Node & node = nodes[entry.child];
+            alignas(32) double t_near[N];
+            unsigned mask = node.intersect(wide_ray, tmin, tmax, t_near);
+
+            // Push the children from the farthest to the nearest, so that the
+            // nearest is popped first
+            const size_t first = stack_size;
+            while (mask) {
+                const unsigned i = std::countr_zero(mask);
+                mask &= mask - 1;
+                const StackEntry child { t_near[i], node.child[i],
+                                         node.count[i] };
+                size_t j = stack_size++;
+                while (j > first && stack[j - 1].t_near < child.t_near) {
+                    stack[j] = stack[j - 1];
+                    --j;
+                }
+                stack[j] = child;
+            }
+        }
+
+        return hit;
+    }
+
+    // Traverse the tree with a packet of rays. Each active lane tests all the
+    // children of a node at once, and a child is visited by the lanes hitting
+    // it, nearest first. For every primitive in a leaf reached by the packet,
+    // call `hit_primitives(index, lanes)`, which must return the lanes hit and
+    // shrink their tmax. Returns the mask of the lanes hit.
+    template <class F>
+    inline unsigned traverse_packet(const RayPacket & packet,
+                                    const unsigned mask,
+                                    const double tmin,
+                                    double * tmax,
+                                    F && hit_primitives) const noexcept {
+        if (nodes.empty() || mask == 0) {
+            return 0;
+        }
+
+        WideRay wide_rays[PACKET_SIZE];
+        for (size_t i = 0; i < PACKET_SIZE; ++i) {
+            wide_rays[i] = WideRay(packet.rays[i]);
+        }
+        PacketStackEntry stack[STACK_SIZE];
+        size_t stack_size = 0;
+        stack[stack_size++] = PacketStackEntry { tmin, 0, 0, uint16_t(mask) };
+        unsigned hit = 0;
+
+        while (stack_size != 0) {
+            const PacketStackEntry entry = stack[--stack_size];
+            // Drop the lanes which found a closer hit since the entry was
+            // pushed
+            unsigned lanes = 0;
+            for (unsigned m = entry.lanes; m; m &= m - 1) {
+                const unsigned l = std::countr_zero(m);
+                lanes |= unsigned(entry.t_near <= tmax[l]) << l;
+            }
+            if (lanes == 0) {
+                continue;
+            }
+            if (entry.count != 0) {
+                for (uint32_t i = 0; i < entry.count; ++i) {
+                    hit |= hit_primitives(indices[entry.child + i], lanes);
+                }
+                continue;
+            }
+
+            const Node & node = nodes[entry.child];
+            unsigned child_lanes[N] = {};
+            double child_near[N];
+            std::fill_n(child_near, N, utils::INF);
+            for (unsigned m = lanes; m; m &= m - 1) {
+                const unsigned l = std::countr_zero(m);
+                alignas(32) double t_near[N];
+                unsigned children =
+                    node.intersect(wide_rays[l], tmin, tmax[l], t_near);
+                while (children) {
+                    const unsigned i = std::countr_zero(children);
+                    children &= children - 1;
+                    child_lanes[i] |= 1u << l;
+                    child_near[i] = std::min(child_near[i], t_near[i]);
+                }
+            }
+
+            // Push the children from the farthest to the nearest, so that the
+            // nearest is popped first
+            const size_t first = stack_size;
+            for (size_t i = 0; i < N; ++i) {
+                if (child_lanes[i] == 0) {
+                    continue;
+                }
+                const PacketStackEntry child { child_near[i], node.child[i],
+                                               node.count[i],
+                                               uint16_t(child_lanes[i]) };
+                size_t j = stack_size++;
+                while (j > first && stack[j - 1].t_near < child.t_near) {
+                    stack[j] = stack[j - 1];
+                    --j;
+                }
+                stack[j] = child;
+            }
+        }
+
+        return hit;
+    }
+
+    // Traverse the tree along a ray until `occluded_primitive(index)` returns
+    // true for a primitive of a leaf reached by the ray. Returns whether such
+    // a primitive was found. The children are not sorted.
+    template <class F>
+    inline bool traverse_any(const Ray & ray,
+                             const double tmin,
+                             const double tmax,
+                             F && occluded_primitive) const noexcept {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const WideRay wide_ray(ray);
+        StackEntry stack[STACK_SIZE];
+        size_t stack_size = 0;
+        stack[stack_size++] = StackEntry { tmin, 0, 0 };
+
+        while (stack_size != 0) {
+            const StackEntry entry = stack[--stack_size];
+            if (entry.count != 0) {
+                for (uint32_t i = 0; i < entry.count; ++i) {
+                    if (occluded_primitive(indices[entry.child + i])) {
+                        return true;
+                    }
+                }
+                continue;
+            }
+
+            const Node & node = nodes[entry.child];
+            alignas(32) double t_near[N];
+            unsigned mask = node.intersect(wide_ray, tmin, tmax, t_near);
+            while (mask) {
+                const unsigned i = std::countr_zero(mask);
+                mask &= mask - 1;
+                stack[stack_size++] =
+                    StackEntry { t_near[i], node.child[i], node.count[i] };
+            }
+        }
+
+        return false;
+    }
+};
+
+// Wide bounding volume hierarchy of hittable objects
+template <size_t N>
+using WideBvh = BasicBvh<WideBvhTree<WideBvhNode<N>>>;
+
+#endif
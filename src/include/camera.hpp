@@ -7,6 +7,7 @@
 // From src/include
 #include <hittable.hpp>
 #include <ray.hpp>
+#include <ray_packet.hpp>
 #include <utils/orthonormal_bases.hpp>
 #include <utils/vec3.hpp>
 
@@ -69,6 +70,20 @@ struct GlobalIllumination {
           colour(colour) {}
 };
 
+// State of a path between two bounces
+struct PathState {
+    // The next ray of the path
+    Ray ray;
+    // Product of the attenuations along the path
+    Colour ray_colour = colour::WHITE;
+    // Product of the scattering pdfs along the path
+    double pdf_coeff = 1.0;
+    // Product of the sampling pdfs along the path
+    double pdf_value = 1.0;
+    // Number of bounces
+    uint32_t iter = 0;
+};
+
 // Main camera class
 class Camera {
 private:
@@ -100,13 +115,70 @@ public:
     }
 
     // Cast a ray into the world with the given parameters
-    // and at the given screen space coordinates
+    // and at the given screen space coordinates.
+    // Adds the number of rays traced against the world to ray_count.
     Colour cast_ray(const Hittable & world,
                     const std::vector<GlobalIllumination> & global_lights,
                     const Hittable & sampled_object,
                     const uint32_t max_bounces,
                     double u,
-                    double v) const noexcept;
+                    double v,
+                    uint64_t & ray_count) const noexcept;
+
+    // Cast a packet of rays at the given screen space coordinates, and write
+    // their colours. The primary rays are traced together, the following
+    // bounces one by one.
+    // Adds the number of rays traced against the world to ray_count.
+    void cast_packet(const Hittable & world,
+                     const std::vector<GlobalIllumination> & global_lights,
+                     const Hittable & sampled_object,
+                     const uint32_t max_bounces,
+                     const double * u,
+                     const double * v,
+                     Colour * colours,
+                     uint64_t & ray_count) const noexcept;
+
+    // Cast a stream of `count` rays at the given screen space coordinates,
+    // and write their colours. The paths advance together one bounce at a
+    // time: the rays of each bounce are sorted by origin and direction
+    // before being traced, so that consecutive rays visit the same parts of
+    // the scene. With `packets`, the primary rays are traced by packets.
+    // Adds the number of rays traced against the world to ray_count.
+    void cast_stream(const Hittable & world,
+                     const std::vector<GlobalIllumination> & global_lights,
+                     const Hittable & sampled_object,
+                     const uint32_t max_bounces,
+                     const double * u,
+                     const double * v,
+                     const size_t count,
+                     const bool packets,
+                     Colour * colours,
+                     uint64_t & ray_count) const noexcept;
+
+private:
+    // Follow a path until it ends, given the result of the hit test of its
+    // current ray
+    Colour trace_path(const Hittable & world,
+                      const std::vector<GlobalIllumination> & global_lights,
+                      const Hittable & sampled_object,
+                      const uint32_t max_bounces,
+                      PathState & path,
+                      bool hit,
+                      HitRecord & hit_record,
+                      uint64_t & ray_count) const noexcept;
+
+    // Advance a path by one bounce, given the result of the hit test of its
+    // current ray. Returns true if the next ray of the path must be traced;
+    // otherwise the path ended and its colour is written.
+    bool advance_path(const Hittable & world,
+                      const std::vector<GlobalIllumination> & global_lights,
+                      const Hittable & sampled_object,
+                      const uint32_t max_bounces,
+                      PathState & path,
+                      const bool hit,
+                      HitRecord & hit_record,
+                      Colour & colour,
+                      uint64_t & ray_count) const noexcept;
 };
 
 #endif
@@ -7,6 +7,8 @@
 
 // From src/include
 #include <ray.hpp>
+#include <ray_packet.hpp>
+#include <utils/aabb.hpp>
 #include <utils/pdf.hpp>
 #include <utils/vec3.hpp>
 
@@ -119,6 +121,41 @@ public:
                      const double tmax,
                      HitRecord & hit_record) const noexcept = 0;
 
+    // Check if a ray hits the object between tmin and tmax, without computing
+    // the hit attributes. Implementations should return at the first hit
+    // found, which need not be the closest one.
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept {
+        HitRecord hit_record;
+        return hit(ray_in, tmin, tmax, hit_record);
+    }
+
+    // Check if the active rays of a packet hit the object. Lane i of `mask`
+    // is tested in [tmin, tmax[i]]; on a hit, tmax[i] is shrunk to the hit
+    // time and records[i] is written. Returns the mask of the lanes hit.
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept {
+        unsigned hit = 0;
+        for (size_t i = 0; i < PACKET_SIZE; ++i) {
+            if ((mask >> i & 1)
+                && this->hit(packet.rays[i], tmin, tmax[i], records[i])) {
+                tmax[i] = records[i].time;
+                hit |= 1u << i;
+            }
+        }
+        return hit;
+    }
+
+    // Compute the bounding box of the object. Returns false if the object is
+    // unbounded, in which case it cannot be put in an acceleration structure.
+    virtual bool bounding_box(Aabb & output_box) const noexcept {
+        return false;
+    }
+
     // Sample the hittable pdf along a direction
     virtual double pdf_value(const Point3 & origin,
                              const Vec3 & direction) const noexcept {
@@ -159,12 +196,30 @@ public:
         push_back(std::cref(object));
     }
 
+    // Check if the list contains no object
+    inline bool empty() const noexcept { return container::empty(); }
+
     // Hit method override
     virtual bool hit(const Ray & ray_in,
                      const double tmin,
                      const double tmax,
                      HitRecord & hit_record) const noexcept override;
 
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+
     // Virtual function override
     virtual double pdf_value(const Point3 & origin,
                              const Vec3 & direction) const noexcept override;
@@ -39,6 +39,9 @@ public:
                      const double tmin,
                      const double tmax,
                      HitRecord & hit_record) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
 };
 
 #endif
@@ -0,0 +1,71 @@
+#ifndef INSTANCE_HPP
+#define INSTANCE_HPP
+
+#include <memory>
+
+// From src/include
+#include <hittable.hpp>
+#include <utils/aabb.hpp>
+#include <utils/transform.hpp>
+#include <utils/vec3.hpp>
+
+// Instance of a shared object, placed in the scene by an affine transform.
+// The object and its acceleration structure are stored once and shared by
+// all its instances; rays are transformed into object space to hit it.
+class Instance : public Hittable {
+private:
+    // The instanced object
+    const std::shared_ptr<const Hittable> object;
+    // Object to world transform
+    Transform transform;
+    // World to object transform
+    Transform inverse;
+    // Material replacing the materials of the object, or null
+    const Material * const material;
+
+public:
+    // Construct an instance of an object, keeping its materials
+    Instance(const std::shared_ptr<const Hittable> & object,
+             const Transform & transform)
+        : object(object), transform(transform), inverse(transform.inverse()),
+          material(nullptr) {}
+
+    // Construct an instance of an object, with another material
+    template <class T>
+    requires Material::is_material<T>
+    inline Instance(const std::shared_ptr<const Hittable> & object,
+                    const Transform & transform,
+                    const T & material)
+        : object(object), transform(transform), inverse(transform.inverse()),
+          material(&material) {}
+
+    // Move the instance. The acceleration structure containing it must then
+    // be updated.
+    inline void set_transform(const Transform & new_transform) {
+        inverse = new_transform.inverse();
+        transform = new_transform;
+    }
+
+    // Virtual function override
+    virtual bool hit(const Ray & ray_in,
+                     const double tmin,
+                     const double tmax,
+                     HitRecord & hit_record) const noexcept override;
+
+    // Virtual function override
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <hittable.hpp>
+#include <objects/triangle_batch.hpp>
+#include <utils/mapped_file.hpp>
+#include <utils/vec3.hpp>
+#include <utils/weld.hpp>
+
+// Indexed triangle mesh (based on .obj or binary .ply files). The triangles
+// only hold the indices of their vertices in a shared vertex array, and are
+// stored in their own bounding volume hierarchy. Meshes read from a file can
+// be cached in a binary file, mapped in memory and used in place by the next
+// runs.
+class Mesh : public Hittable {
+public:
+    // Indices of the vertices of a triangle. The order of the vertices
+    // defines the orientation of the triangle.
+    using Face = std::array<uint32_t, 3>;
+
+private:
+    // Material of the mesh
+    const Material & material;
+    // Vertices, triangles and vertex normals of a mesh built in memory
+    std::vector<Point3> vertex_storage;
+    std::vector<Face> face_storage;
+    std::vector<Vec3> normal_storage;
+    // Cache file holding the geometry of a mesh loaded from disk
+    std::unique_ptr<MappedFile> mapping;
+    // Vertices shared by the triangles
+    std::span<const Point3> vertices;
+    // Triangles of the mesh
+    std::span<const Face> faces;
+    // Unit normals of the vertices, interpolated over the triangles. Empty
+    // for flat shaded meshes.
+    std::span<const Vec3> normals;
+    // Content hash of the geometry, identifying the cached BVH. Only computed
+    // when the mesh is cached.
+    uint64_t geometry_key = 0;
+    // Wether the geometry was loaded from its cache file
+    bool cached = false;
+    // Time spent reading the geometry and building the BVH, in milliseconds
+    double load_millis = 0.0;
+    // Sizes of the mesh before and after welding its vertices
+    WeldStats weld_stats;
+    // BVH over the triangles
+    BvhTree tree;
+
+    // Read the vertices and faces of a .obj file. Polygons are split in
+    // triangle fans.
+    static void read_obj_file(const std::string & obj_file_name,
+                              std::vector<Point3> & vertices,
+                              std::vector<Face> & faces);
+
+    // Load the geometry from a cache file, by mapping it in memory. Returns
+    // false, leaving the mesh unchanged, if the file is missing, invalid,
+    // older than the source file, or welded with other settings.
+    bool load_cache(const std::string & file_name,
+                    const std::string & source_file_name,
+                    const WeldInfo & weld);
+
+    // Write the geometry to a cache file, marked with the size and date of
+    // the source file and the welding settings. Returns false if it could not
+    // be written.
+    bool save_cache(const std::string & file_name,
+                    const std::string & source_file_name,
+                    const WeldInfo & weld);
+
+    // Point the vertices, faces and normals at their storage
+    void use_storage() noexcept;
+
+    // Read the geometry of a .obj or .ply file, depending on its extension
+    void read_file(const std::string & file_name);
+
+    // Read the geometry of a file, or its cache, then build or load the BVH.
+    // The vertices read from the file are welded if enabled.
+    void load(const std::string & file_name,
+              const bool use_cache,
+              const WeldInfo & weld);
+
+    // Build the BVH over the triangles. If a cache file name is given, the
+    // BVH is read from it when it matches the geometry, or written to it.
+    void build(const std::string & cache_file_name = std::string());
+
+    // Find the closest hit of a ray with the triangles of a leaf of the BVH,
+    // in [tmin, tmax]. The triangles are gathered in batches for the SIMD
+    // test. Writes the time of the hit and returns the index of the triangle
+    // hit, or TriangleBatch::NO_TRIANGLE.
+    uint32_t intersect_leaf(const WatertightRay & ray,
+                            const uint32_t first,
+                            const uint32_t count,
+                            const double tmin,
+                            const double tmax,
+                            double & time) const noexcept;
+
+public:
+    // Whether a file is read as a .ply file, from its extension. The other
+    // files are read as .obj files.
+    static bool is_ply_file(const std::string & file_name);
+
+    // Construct a mesh from a given .obj or binary .ply file. With
+    // `use_cache`, the geometry and the BVH are cached next to the file and
+    // reused by the next runs. Duplicated vertices may be welded, which also
+    // drops the degenerate triangles.
+    template <class T>
+    requires Material::is_material<T>
+    inline Mesh(const std::string & file_name,
+                const T & material,
+                const bool use_cache = false,
+                const WeldInfo & weld = WeldInfo())
+        : material(material) {
+        load(file_name, use_cache, weld);
+    }
+
+    // Construct a mesh from its vertices and triangles, and optionally the
+    // normals of its vertices
+    template <class T>
+    requires Material::is_material<T>
+    inline Mesh(std::vector<Point3> vertices,
+                std::vector<Face> faces,
+                const T & material,
+                std::vector<Vec3> normals = std::vector<Vec3>())
+        : material(material), vertex_storage(std::move(vertices)),
+          face_storage(std::move(faces)), normal_storage(std::move(normals)) {
+        if (!normal_storage.empty()
+            && normal_storage.size() != vertex_storage.size()) {
+            throw "Could not build mesh: one normal is needed per vertex";
+        }
+        use_storage();
+        build();
+    }
+
+    // Number of triangles of the mesh
+    inline size_t size() const noexcept { return faces.size(); }
+
+    // Number of vertices of the mesh
+    inline size_t vertex_count() const noexcept { return vertices.size(); }
+
+    // Wether the geometry was loaded from its cache file
+    inline bool loaded_from_cache() const noexcept { return cached; }
+
+    // Time spent reading the geometry and building the BVH, in milliseconds
+    inline double load_time() const noexcept { return load_millis; }
+
+    // Sizes of the mesh before and after welding. Not welded when loaded
+    // from the cache, which holds the welded mesh.
+    inline const WeldStats & weld_statistics() const noexcept {
+        return weld_stats;
+    }
+
+    // Memory used by the vertices, the triangles, the normals and the BVH,
+    // in bytes
+    inline size_t memory_usage() const noexcept {
+        return vertices.size_bytes() + faces.size_bytes()
+               + normals.size_bytes() + tree.memory_usage();
+    }
+
+    // The BVH over the triangles
+    inline const BvhTree & get_tree() const noexcept { return tree; }
+
+    // Vertices shared by the triangles
+    inline std::span<const Point3> get_vertices() const noexcept {
+        return vertices;
+    }
+
+    // Triangles of the mesh
+    inline std::span<const Face> get_faces() const noexcept { return faces; }
+
+    // Content hash of the geometry, or 0 if the mesh is not cached
+    inline uint64_t get_geometry_key() const noexcept { return geometry_key; }
+
+    // Virtual function override
+    virtual bool hit(const Ray & ray_in,
+                     const double tmin,
+                     const double tmax,
+                     HitRecord & hit_record) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+};
+
+#endif
@@ -1,37 +1,117 @@
 #ifndef OBJECT_HPP
 #define OBJECT_HPP
 
-#include <fstream>
+#include <array>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 // From src/include
+#include <accelerators/bvh.hpp>
 #include <hittable.hpp>
 #include <objects/triangle.hpp>
+#include <objects/triangle_batch.hpp>
 #include <utils/vec3.hpp>
+#include <utils/weld.hpp>
 
-// Object class (based on .obj files)
+// Object class (based on .obj files). The triangles of the object are stored
+// in their own bounding volume hierarchy.
 class Object : public Hittable {
 private:
     // material corresponding to object
     const Material & material;
     // the set of triangles created from the polygones of the .obj
     std::vector<Triangle> triangles_set;
+    // BVH over the triangles
+    BvhTree tree;
+    // Vertices of the triangles of each leaf, in batches for the SIMD
+    // intersection
+    std::vector<TriangleBatch> batches;
+    // First batch of each leaf, indexed by the position of the first
+    // primitive of the leaf in the primitive index array
+    std::vector<uint32_t> leaf_batches;
+    // Settings used to build the BVH
+    SpatialSplitInfo split_info;
+    // Wether the BVH was loaded from its cache file
+    bool cached = false;
+    // Sizes of the object before and after welding its vertices
+    WeldStats weld_stats;
 
-    std::vector<Triangle>
-        build_triangles_from_file(const std::string & obj_file_name) noexcept;
+    // Read the vertices of the triangles of a .obj file. Polygons are split
+    // in triangle fans. The vertices are welded first if enabled.
+    static std::vector<std::array<Point3, 3>>
+        read_triangles_from_file(const std::string & obj_file_name,
+                                 const WeldInfo & weld,
+                                 WeldStats & weld_stats);
+
+    // Pack the triangles of the leaves of the BVH in batches
+    void pack_batches(const std::vector<std::array<Point3, 3>> & triangles);
+
+    // Build the triangles and their BVH. If a cache file name is given, the
+    // BVH is loaded from it when it matches the triangles, otherwise it is
+    // built and saved to it.
+    void build(const std::vector<std::array<Point3, 3>> & triangles,
+               const std::string & cache_file_name);
 
 public:
-    // Construct an object from a given .obj file
+    // Construct an object from a given .obj file. Spatial splits may be
+    // enabled for meshes with long, thin triangles. With `use_cache`, the BVH
+    // is cached next to the .obj file and reused by the next runs. Duplicated
+    // vertices may be welded, which also drops the degenerate triangles.
     template <class T>
     requires Material::is_material<T>
     inline Object(const std::string & obj_file_name,
-                  const T & material) noexcept {}
+                  const T & material,
+                  const SpatialSplitInfo & split_info = SpatialSplitInfo(),
+                  const bool use_cache = false,
+                  const WeldInfo & weld = WeldInfo())
+        : material(material), split_info(split_info) {
+        build(read_triangles_from_file(obj_file_name, weld, weld_stats),
+              use_cache ? obj_file_name + ".bvh" : std::string());
+    }
+
+    // Number of triangles of the object
+    inline size_t size() const noexcept { return triangles_set.size(); }
+
+    // The BVH over the triangles
+    inline const BvhTree & get_tree() const noexcept { return tree; }
+
+    // Wether the BVH was loaded from its cache file
+    inline bool loaded_from_cache() const noexcept { return cached; }
+
+    // Sizes of the object before and after welding
+    inline const WeldStats & weld_statistics() const noexcept {
+        return weld_stats;
+    }
+
+    // Move the vertices of a deforming object. The triangles keep their order
+    // and the BVH is refitted, unless its SAH cost grew by more than
+    // `max_cost_growth`, in which case it is rebuilt. Returns wether the BVH
+    // was rebuilt.
+    bool set_vertices(
+        const std::vector<std::array<Point3, 3>> & triangles,
+        const double max_cost_growth = BvhTree::MAX_REFIT_COST_GROWTH);
 
     // Virtual function override
     virtual bool hit(const Ray & ray_in,
                      double tmin,
                      double tmax,
                      HitRecord & hit_record) const noexcept override;
+
+    // Virtual function override
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
 };
 
 #endif
@@ -0,0 +1,126 @@
+#ifndef PAGED_MESH_HPP
+#define PAGED_MESH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <hittable.hpp>
+#include <utils/aabb.hpp>
+#include <utils/page_cache.hpp>
+#include <utils/vec3.hpp>
+
+// Subtree of the BVH of a paged mesh, stored in a page with its triangles:
+// its nodes, laid out as in a BvhTree, are followed by the vertices of the
+// triangles of its leaves
+struct PagedCluster {
+    // Bounding box of the subtree
+    Aabb box;
+    // Page holding the subtree
+    uint32_t page;
+    // Offset of the subtree in its page, in bytes
+    uint32_t offset;
+    // Number of nodes of the subtree
+    uint32_t node_count;
+    // Number of triangles of the subtree
+    uint32_t triangle_count;
+};
+
+// Triangle mesh too large for memory. On the first run, the mesh is streamed
+// from its file and sorted in spatial buckets on disk. The BVH of each bucket
+// is built in turn and cut into subtrees of at most a page, stored with their
+// triangles in a page file next to the mesh. Only a BVH over the subtrees
+// stays in memory: the pages are read when a ray reaches their subtree, and
+// the ones not used recently are evicted to stay within the memory budget.
+// Vertex normals are not kept.
+class PagedMesh : public Hittable {
+public:
+    // Vertices of a triangle, as stored in the pages
+    using Triangle = std::array<Point3, 3>;
+
+    // Size of a page, in bytes
+    static constexpr size_t PAGE_SIZE = size_t(1) << 16;
+    // Default memory budget of the pages, in bytes
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = size_t(256) << 20;
+
+private:
+    // Material of the mesh
+    const Material & material;
+    // Subtrees of the BVH of the mesh
+    std::vector<PagedCluster> clusters;
+    // Number of triangles of the mesh
+    size_t triangle_count = 0;
+    // BVH over the subtrees, always in memory
+    BvhTree tree;
+    // Pages holding the subtrees
+    std::unique_ptr<PageCache> pages;
+
+    // Write the page file of a source file, without holding the mesh in
+    // memory: the BVH of a bucket of triangles is built at a time, using
+    // about `memory_budget` bytes. Returns false if the file could not be
+    // written.
+    static bool write_pages(const std::string & source_file_name,
+                            const std::string & file_name,
+                            const uint64_t source_size,
+                            const int64_t source_time,
+                            const size_t memory_budget);
+
+    // Read the subtrees of a page file written for the given version of the
+    // source file, then open its pages. Returns false if the file is missing,
+    // invalid, or was written for another version of the source file.
+    bool open_pages(const std::string & file_name,
+                    const uint64_t source_size,
+                    const int64_t source_time,
+                    const size_t memory_budget);
+
+    // Load the mesh from its page file, writing it first if needed
+    void load(const std::string & file_name, const size_t memory_budget);
+
+public:
+    // Construct a paged mesh from a given .obj or binary .ply file. The page
+    // file is written next to it on the first run. `memory_budget` bounds the
+    // memory used by the pages, in bytes.
+    template <class T>
+    requires Material::is_material<T>
+    inline PagedMesh(const std::string & file_name,
+                     const T & material,
+                     const size_t memory_budget = DEFAULT_MEMORY_BUDGET)
+        : material(material) {
+        load(file_name, memory_budget);
+    }
+
+    // Number of triangles of the mesh
+    inline size_t size() const noexcept { return triangle_count; }
+
+    // Number of subtrees
+    inline size_t cluster_count() const noexcept { return clusters.size(); }
+
+    // Memory always used by the subtrees and the BVH over them, in bytes
+    inline size_t resident_memory_usage() const noexcept {
+        return clusters.size() * sizeof(PagedCluster) + tree.memory_usage();
+    }
+
+    // The pages, and their access counters
+    inline const PageCache & get_pages() const noexcept { return *pages; }
+
+    // Virtual function override
+    virtual bool hit(const Ray & ray_in,
+                     const double tmin,
+                     const double tmax,
+                     HitRecord & hit_record) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+};
+
+#endif
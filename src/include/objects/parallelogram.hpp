@@ -1,6 +1,7 @@
 #ifndef PARALLELOGRAM_HPP
 #define PARALLELOGRAM_HPP
 
+#include <cmath>
 #include <type_traits>
 
 // From src/include
@@ -23,9 +24,23 @@ private:
     // Unit normal of the parallelogram
     const Vec3 unit_normal;
 
+    // Wether the edges are orthogonal, rectangles are sampled by solid angle
+    const bool rectangular;
+
     // Material of the parallelogram
     const Material & material;
 
+    // Intersect a ray with the parallelogram, writing the time of the hit
+    bool intersect(const Ray & ray,
+                   const double tmin,
+                   const double tmax,
+                   double & time) const noexcept;
+
+    // Fill the hit record of a ray hitting the parallelogram at the given time
+    void set_hit_record(const Ray & ray,
+                        const double time,
+                        HitRecord & hit_record) const noexcept;
+
 public:
     // Construct a parallelogram from its three defining vertices.
     // The fourth vertex is deduced.
@@ -39,6 +54,9 @@ public:
         : vertex(point1), edge1(point2 - point1), edge2(point3 - point1),
           normal((point2 - point1).cross(point3 - point1)),
           unit_normal((point2 - point1).cross(point3 - point1).unit_vector()),
+          rectangular(fabs((point2 - point1).dot(point3 - point1))
+                      <= 1e-6 * (point2 - point1).norm()
+                             * (point3 - point1).norm()),
           material(material) {}
 
     // Virtual function override
@@ -47,6 +65,21 @@ public:
                      const double tmax,
                      HitRecord & hit_record) const noexcept override;
 
+    // Virtual function override
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+
     // Virtual function override
     virtual double pdf_value(const Point3 & origin,
                              const Vec3 & direction) const noexcept override;
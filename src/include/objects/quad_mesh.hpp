@@ -0,0 +1,126 @@
+#ifndef QUAD_MESH_HPP
+#define QUAD_MESH_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <hittable.hpp>
+#include <utils/vec3.hpp>
+
+// Mesh of quads sharing a vertex buffer (based on .obj files). Quads are kept
+// as single primitives instead of being split in two triangles: planar convex
+// quads are intersected with their plane, and the other ones as bilinear
+// patches. Triangles are stored as quads whose last two vertices are equal.
+class QuadMesh : public Hittable {
+public:
+    // Indices of the vertices of a quad, in order around the quad
+    using Quad = std::array<uint32_t, 4>;
+
+private:
+    // Material of the mesh
+    const Material & material;
+    // Vertices shared by the quads
+    std::vector<Point3> vertices;
+    // Quads of the mesh
+    std::vector<Quad> quads;
+    // Wether each quad is planar and convex
+    std::vector<uint8_t> planar;
+    // BVH over the quads
+    BvhTree tree;
+
+    // Read the vertices and faces of a .obj file. Polygons with more than 4
+    // vertices are split in fans of quads.
+    static void read_quads_from_file(const std::string & obj_file_name,
+                                     std::vector<Point3> & vertices,
+                                     std::vector<Quad> & quads);
+
+    // Classify the quads and build their BVH
+    void build();
+
+    // Intersect a ray with a planar quad, writing the time of the hit and the
+    // normal of the quad
+    bool intersect_planar(const Quad & quad,
+                          const Ray & ray,
+                          const double tmin,
+                          const double tmax,
+                          double & time,
+                          Vec3 & normal) const noexcept;
+
+    // Intersect a ray with the bilinear patch of a quad, writing the time of
+    // the closest hit and the normal of the patch there
+    bool intersect_bilinear(const Quad & quad,
+                            const Ray & ray,
+                            const double tmin,
+                            const double tmax,
+                            double & time,
+                            Vec3 & normal) const noexcept;
+
+    // Intersect a ray with a quad of the mesh
+    inline bool intersect(const uint32_t index,
+                          const Ray & ray,
+                          const double tmin,
+                          const double tmax,
+                          double & time,
+                          Vec3 & normal) const noexcept {
+        return planar[index]
+                   ? intersect_planar(quads[index], ray, tmin, tmax, time,
+                                      normal)
+                   : intersect_bilinear(quads[index], ray, tmin, tmax, time,
+                                        normal);
+    }
+
+public:
+    // Construct a mesh from a given .obj file
+    template <class T>
+    requires Material::is_material<T>
+    inline QuadMesh(const std::string & obj_file_name, const T & material)
+        : material(material) {
+        read_quads_from_file(obj_file_name, vertices, quads);
+        build();
+    }
+
+    // Construct a mesh from its vertices and quads
+    template <class T>
+    requires Material::is_material<T>
+    inline QuadMesh(std::vector<Point3> vertices,
+                    std::vector<Quad> quads,
+                    const T & material)
+        : material(material), vertices(std::move(vertices)),
+          quads(std::move(quads)) {
+        build();
+    }
+
+    // Number of quads of the mesh
+    inline size_t size() const noexcept { return quads.size(); }
+
+    // Number of vertices of the mesh
+    inline size_t vertex_count() const noexcept { return vertices.size(); }
+
+    // Number of quads intersected as bilinear patches
+    size_t bilinear_count() const noexcept;
+
+    // The BVH over the quads
+    inline const BvhTree & get_tree() const noexcept { return tree; }
+
+    // Virtual function override
+    virtual bool hit(const Ray & ray_in,
+                     const double tmin,
+                     const double tmax,
+                     HitRecord & hit_record) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+};
+
+#endif
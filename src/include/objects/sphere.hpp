@@ -17,6 +17,17 @@ private:
     // Material of the sphere
     const Material & material;
 
+    // Intersect a ray with the sphere, writing the time of the hit
+    bool intersect(const Ray & ray,
+                   const double tmin,
+                   const double tmax,
+                   double & time) const noexcept;
+
+    // Fill the hit record of a ray hitting the sphere at the given time
+    void set_hit_record(const Ray & ray,
+                        const double time,
+                        HitRecord & hit_record) const noexcept;
+
 public:
     // Construct sphere from its centre, radius and material
     template <class T>
@@ -32,6 +43,21 @@ public:
                      const double tmax,
                      HitRecord & hit_record) const noexcept override;
 
+    // Virtual function override
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+
     // Virtual function override
     virtual double pdf_value(const Point3 & origin,
                              const Vec3 & direction) const noexcept override;
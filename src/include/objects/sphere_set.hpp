@@ -0,0 +1,96 @@
+#ifndef SPHERE_SET_HPP
+#define SPHERE_SET_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// From src/include
+#include <hittable.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+// Small group of nearby spheres, stored as a structure of arrays so that a
+// ray is intersected with 4 of them at once with AVX2. Scenes made of many
+// spheres are packed into sets, which the acceleration structures then see
+// as single primitives.
+class SphereSet : public Hittable {
+public:
+    // Maximum number of spheres in a set, a multiple of the packet size
+    static constexpr size_t CAPACITY = 8;
+
+    // Sphere to be packed in a set
+    struct Entry {
+        // Centre of the sphere
+        Point3 centre;
+        // Radius of the sphere
+        double radius;
+        // Material of the sphere
+        const Material * material;
+    };
+
+private:
+    // Centres of the spheres
+    alignas(32) double centre_x[CAPACITY];
+    alignas(32) double centre_y[CAPACITY];
+    alignas(32) double centre_z[CAPACITY];
+    // Squared radii of the spheres
+    alignas(32) double squared_radius[CAPACITY];
+    // Radii of the spheres
+    double radius[CAPACITY];
+    // Materials of the spheres
+    const Material * materials[CAPACITY];
+    // Number of spheres in the set
+    size_t count = 0;
+    // Bounding box of the spheres
+    Aabb box;
+
+    // Intersect a ray with the spheres, writing the time of the closest hit.
+    // Returns the index of the sphere hit, or -1 if none is hit in the time
+    // window.
+    int intersect(const Ray & ray,
+                  const double tmin,
+                  const double tmax,
+                  double & time) const noexcept;
+
+    // Fill the hit record of a ray hitting a sphere at the given time
+    void set_hit_record(const Ray & ray,
+                        const int index,
+                        const double time,
+                        HitRecord & hit_record) const noexcept;
+
+public:
+    // Construct a set from at most CAPACITY spheres
+    SphereSet(const Entry * entries, const size_t entry_count);
+
+    // Group spheres spatially into sets, splitting them at the median of
+    // their longest axis until each group fits in a set
+    static std::vector<std::shared_ptr<Hittable>>
+        pack(std::vector<Entry> & entries);
+
+    // Number of spheres in the set
+    inline size_t size() const noexcept { return count; }
+
+    // Virtual function override
+    virtual bool hit(const Ray & ray_in,
+                     const double tmin,
+                     const double tmax,
+                     HitRecord & hit_record) const noexcept override;
+
+    // Virtual function override
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+};
+
+#endif
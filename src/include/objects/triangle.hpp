@@ -26,6 +26,12 @@ private:
     // Material of the triangle
     const Material & material;
 
+    // Intersect a ray with the triangle, writing the time of the hit
+    bool intersect(const Ray & ray,
+                   const double tmin,
+                   const double tmax,
+                   double & time) const noexcept;
+
 public:
     // Construct a triangle from its three vertices.
     // The order of the vertices defines the orientation of the triangle.
@@ -40,12 +46,32 @@ public:
           unit_normal((point2 - point1).cross(point3 - point1).unit_vector()),
           material(material) {}
 
+    // Fill the hit record of a ray hitting the triangle at the given time
+    void set_hit_record(const Ray & ray,
+                        const double time,
+                        HitRecord & hit_record) const noexcept;
+
     // Virtual function override
     virtual bool hit(const Ray & ray_in,
                      const double tmin,
                      const double tmax,
                      HitRecord & hit_record) const noexcept override;
 
+    // Virtual function override
+    virtual unsigned hit_packet(const RayPacket & packet,
+                                const unsigned mask,
+                                const double tmin,
+                                double * tmax,
+                                HitRecord * records) const noexcept override;
+
+    // Virtual function override
+    virtual bool occluded(const Ray & ray_in,
+                          const double tmin,
+                          const double tmax) const noexcept override;
+
+    // Virtual function override
+    virtual bool bounding_box(Aabb & output_box) const noexcept override;
+
     // Virtual function override
     virtual double pdf_value(const Point3 & origin,
                              const Vec3 & direction) const noexcept override;
@@ -0,0 +1,84 @@
+#ifndef TRIANGLE_BATCH_HPP
+#define TRIANGLE_BATCH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// From src/include
+#include <ray.hpp>
+#include <ray_packet.hpp>
+#include <utils/vec3.hpp>
+
+// Ray prepared for the watertight triangle test (Woop, Benthin and Wald,
+// 2013). The ray is sheared so that it points along the z axis of a
+// permuted frame, where the edge functions of the triangles are evaluated
+// in 2D. The test relies on exact IEEE arithmetic: it is compiled in its own
+// translation unit, without fast math or fused multiply-adds (see the
+// Makefile).
+struct WatertightRay {
+    // Permuted axes, kz being the largest component of the direction
+    int kx, ky, kz;
+    // Shear constants
+    double sx, sy, sz;
+    // Origin of the ray
+    Point3 origin;
+
+    // Prepare a ray for the test
+    explicit WatertightRay(const Ray & ray) noexcept;
+
+    // Intersect the ray with a triangle in [tmin, tmax], writing the time of
+    // the hit. Hits on the edges and vertices shared by triangles are never
+    // missed.
+    bool intersect(const Point3 & a,
+                   const Point3 & b,
+                   const Point3 & c,
+                   const double tmin,
+                   const double tmax,
+                   double & time) const noexcept;
+};
+
+// Batch of triangles stored as a structure of arrays, one triangle per lane
+// of an AVX register. Unused lanes have no triangle index.
+struct alignas(32) TriangleBatch {
+    // Number of triangles in a batch
+    static constexpr size_t SIZE = PACKET_SIZE;
+    // Index of an unused lane
+    static constexpr uint32_t NO_TRIANGLE = UINT32_MAX;
+
+    // Coordinates of the vertices: vertices[v][axis][lane]
+    double vertices[3][3][SIZE];
+    // Index of the triangle of each lane
+    uint32_t index[SIZE];
+
+    // Pack consecutive triangles in batches. `triangles[i]` is the index of
+    // the i-th triangle to pack, and `vertices` gives the vertices of a
+    // triangle index. Returns the number of batches appended.
+    static size_t pack(const std::span<const uint32_t> triangles,
+                       const std::vector<std::array<Point3, 3>> & vertices,
+                       std::vector<TriangleBatch> & batches);
+
+    // Gather indexed triangles in consecutive batches. `triangles[i]` is the
+    // index in `faces` of the i-th triangle to gather, and `faces` holds the
+    // indices of the vertices of each triangle in `vertices`. Unused lanes
+    // repeat the last triangle. Returns the number of batches written.
+    static size_t gather(const std::span<const uint32_t> triangles,
+                         const std::span<const Point3> vertices,
+                         const std::span<const std::array<uint32_t, 3>> faces,
+                         TriangleBatch * batches) noexcept;
+
+    // Find the closest hit of a ray with the triangles of consecutive
+    // batches, in [tmin, tmax]. Hits on the edges and vertices shared by
+    // triangles are never missed. Writes the time of the hit and returns the
+    // index of the triangle hit, or NO_TRIANGLE.
+    static uint32_t intersect(const WatertightRay & ray,
+                              const TriangleBatch * batches,
+                              const size_t batch_count,
+                              const double tmin,
+                              const double tmax,
+                              double & time) noexcept;
+};
+
+#endif
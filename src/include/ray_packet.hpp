@@ -0,0 +1,151 @@
+#ifndef RAY_PACKET_HPP
+#define RAY_PACKET_HPP
+
+#include <cstddef>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+// From src/include
+#include <ray.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+// Number of rays traced together in a packet, one per lane of an AVX register
+constexpr size_t PACKET_SIZE = 4;
+
+// Mask of all the lanes of a packet
+constexpr unsigned PACKET_MASK = (1u << PACKET_SIZE) - 1;
+
+// Packet of coherent rays, traced together through the acceleration
+// structures. The lanes of a packet are selected by bit masks: lane i is
+// active when bit i of the mask is set.
+struct RayPacket {
+    // The rays of the packet
+    Ray rays[PACKET_SIZE];
+    // Componentwise inverse of the ray directions
+    Vec3 inv_directions[PACKET_SIZE];
+#ifdef __AVX2__
+    // Origins, directions and inverse directions, one ray per lane
+    __m256d ox, oy, oz, dx, dy, dz, ix, iy, iz;
+#endif
+
+    // Construct a packet from its rays
+    inline explicit RayPacket(const Ray * packet_rays) noexcept {
+        for (size_t i = 0; i < PACKET_SIZE; ++i) {
+            rays[i] = packet_rays[i];
+            inv_directions[i] = 1.0 / rays[i].direction;
+        }
+#ifdef __AVX2__
+        const auto gather = [&](auto component) {
+            return _mm256_setr_pd(component(0), component(1), component(2),
+                                  component(3));
+        };
+        ox = gather([&](int i) { return rays[i].origin.x; });
+        oy = gather([&](int i) { return rays[i].origin.y; });
+        oz = gather([&](int i) { return rays[i].origin.z; });
+        dx = gather([&](int i) { return rays[i].direction.x; });
+        dy = gather([&](int i) { return rays[i].direction.y; });
+        dz = gather([&](int i) { return rays[i].direction.z; });
+        ix = gather([&](int i) { return inv_directions[i].x; });
+        iy = gather([&](int i) { return inv_directions[i].y; });
+        iz = gather([&](int i) { return inv_directions[i].z; });
+#endif
+    }
+
+    // Slab test of a box against all the rays. Lane i is tested in
+    // [tmin, tmax[i]]. Returns the mask of the lanes hitting the box.
+    inline unsigned hit_box(const Aabb & box,
+                            const double tmin,
+                            const double * tmax) const noexcept {
+#ifdef __AVX2__
+        const __m256d t0x =
+            _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(box.min.x), ox), ix);
+        const __m256d t0y =
+            _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(box.min.y), oy), iy);
+        const __m256d t0z =
+            _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(box.min.z), oz), iz);
+        const __m256d t1x =
+            _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(box.max.x), ox), ix);
+        const __m256d t1y =
+            _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(box.max.y), oy), iy);
+        const __m256d t1z =
+            _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(box.max.z), oz), iz);
+        const __m256d near = _mm256_max_pd(
+            _mm256_max_pd(_mm256_min_pd(t0x, t1x), _mm256_min_pd(t0y, t1y)),
+            _mm256_max_pd(_mm256_min_pd(t0z, t1z), _mm256_set1_pd(tmin)));
+        const __m256d far = _mm256_min_pd(
+            _mm256_min_pd(_mm256_max_pd(t0x, t1x), _mm256_max_pd(t0y, t1y)),
+            _mm256_min_pd(_mm256_max_pd(t0z, t1z), _mm256_loadu_pd(tmax)));
+        return _mm256_movemask_pd(_mm256_cmp_pd(near, far, _CMP_LE_OQ));
+#else
+        unsigned mask = 0;
+        for (size_t i = 0; i < PACKET_SIZE; ++i) {
+            mask |= unsigned(box.hit(rays[i].origin, inv_directions[i], tmin,
+                                     tmax[i]))
+                    << i;
+        }
+        return mask;
+#endif
+    }
+};
+
+#ifdef __AVX2__
+// Dot product of four vectors with a constant vector
+inline __m256d dot4(const __m256d x,
+                    const __m256d y,
+                    const __m256d z,
+                    const Vec3 & v) noexcept {
+    return _mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(v.x)),
+                      _mm256_mul_pd(y, _mm256_set1_pd(v.y))),
+        _mm256_mul_pd(z, _mm256_set1_pd(v.z)));
+}
+
+// Intersect the rays of a packet with the plane of a triangle or
+// parallelogram. Writes the hit times and the barycentric coordinates u, v of
+// the hit points along edge1 and edge2. Returns the mask of the lanes hitting
+// the plane in [tmin, tmax[i]].
+inline unsigned planar_intersect4(const RayPacket & packet,
+                                  const Point3 & vertex,
+                                  const Vec3 & edge1,
+                                  const Vec3 & edge2,
+                                  const Vec3 & normal,
+                                  const double tmin,
+                                  const double * tmax,
+                                  __m256d & time,
+                                  __m256d & u,
+                                  __m256d & v) noexcept {
+    // Rays colinear to the plane are rejected
+    const __m256d determinant = dot4(packet.dx, packet.dy, packet.dz, normal);
+    const __m256d abs_determinant =
+        _mm256_andnot_pd(_mm256_set1_pd(-0.0), determinant);
+    const __m256d scale = _mm256_div_pd(_mm256_set1_pd(1.0), determinant);
+    const __m256d ovx = _mm256_sub_pd(_mm256_set1_pd(vertex.x), packet.ox);
+    const __m256d ovy = _mm256_sub_pd(_mm256_set1_pd(vertex.y), packet.oy);
+    const __m256d ovz = _mm256_sub_pd(_mm256_set1_pd(vertex.z), packet.oz);
+    time = _mm256_mul_pd(scale, dot4(ovx, ovy, ovz, normal));
+
+    // Cross product of the directions with the origin to vertex vectors
+    const __m256d cx = _mm256_sub_pd(_mm256_mul_pd(packet.dy, ovz),
+                                     _mm256_mul_pd(packet.dz, ovy));
+    const __m256d cy = _mm256_sub_pd(_mm256_mul_pd(packet.dz, ovx),
+                                     _mm256_mul_pd(packet.dx, ovz));
+    const __m256d cz = _mm256_sub_pd(_mm256_mul_pd(packet.dx, ovy),
+                                     _mm256_mul_pd(packet.dy, ovx));
+    u = _mm256_mul_pd(scale, dot4(cx, cy, cz, edge1));
+    v = _mm256_mul_pd(_mm256_sub_pd(_mm256_setzero_pd(), scale),
+                      dot4(cx, cy, cz, edge2));
+
+    const __m256d valid = _mm256_and_pd(
+        _mm256_cmp_pd(abs_determinant, _mm256_set1_pd(utils::EPSILON),
+                      _CMP_GE_OQ),
+        _mm256_and_pd(
+            _mm256_cmp_pd(time, _mm256_set1_pd(tmin), _CMP_GE_OQ),
+            _mm256_cmp_pd(time, _mm256_loadu_pd(tmax), _CMP_LE_OQ)));
+    return _mm256_movemask_pd(valid);
+}
+#endif
+
+#endif
@@ -2,8 +2,10 @@
 #define UTILS_HPP
 
 #include <atomic>
+#include <bit>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
 #include <limits>
@@ -125,6 +127,10 @@ namespace utils {
     constexpr double PI = 3.14159265358979323846264338327950288;
     // Geometric TAU constant, TAU = 2.0 * PI
     constexpr double TAU = 6.28318530717958647692528676655900577;
+    // Lights subtending a smaller or larger solid angle are sampled by area,
+    // as solid angle sampling becomes inaccurate
+    constexpr double MIN_SAMPLED_SOLID_ANGLE = 3e-4;
+    constexpr double MAX_SAMPLED_SOLID_ANGLE = 6.22;
 
     // Convert a value in degrees to radians
     template <class T>
@@ -133,6 +139,13 @@ namespace utils {
         return value * static_cast<T>(PI) / 180.0;
     }
 
+    // Wether a light subtending the given solid angle is sampled by solid
+    // angle rather than by area
+    constexpr bool samples_solid_angle(const double solid_angle) noexcept {
+        return MIN_SAMPLED_SOLID_ANGLE <= solid_angle
+               && solid_angle <= MAX_SAMPLED_SOLID_ANGLE;
+    }
+
     // Compute the absolute value of a number
     template <class T>
     constexpr T abs(const T value) {
@@ -186,6 +199,22 @@ namespace utils {
         return r0 + (1.0 - r0) * pow(1.0 - cos_theta, 5);
     }
 
+    // Mix a 64 bit word in a hash
+    constexpr uint64_t hash_mix(const uint64_t hash,
+                                const uint64_t word) noexcept {
+        return std::rotl(hash ^ (word * 0x9E3779B97F4A7C15ull), 31)
+               * 0xBF58476D1CE4E5B9ull;
+    }
+
+    // Finalize a hash, so that all its bits depend on all the input bits
+    constexpr uint64_t hash_finalize(uint64_t hash) noexcept {
+        hash ^= hash >> 30;
+        hash *= 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 27;
+        hash *= 0x94D049BB133111EBull;
+        return hash ^ (hash >> 31);
+    }
+
 } // namespace utils
 
 #endif
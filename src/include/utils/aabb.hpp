@@ -0,0 +1,131 @@
+#ifndef AABB_HPP
+#define AABB_HPP
+
+#include <algorithm>
+#include <limits>
+
+// From src/include
+#include <ray.hpp>
+#include <utils.hpp>
+#include <utils/vec3.hpp>
+
+// Axis-aligned bounding box
+class Aabb {
+private:
+    // The slab distances are computed with up to 3 rounding errors. The far
+    // distance is enlarged by 2 gamma(3) (Ize, 2013), so that rays touching
+    // the box, such as rays through the vertices of a mesh, are never culled.
+    static constexpr double ROBUST_FAR_SCALE =
+        1.0
+        + 2.0 * (3.0 * std::numeric_limits<double>::epsilon() * 0.5)
+              / (1.0 - 3.0 * std::numeric_limits<double>::epsilon() * 0.5);
+
+public:
+    // Minimum corner of the box
+    Point3 min;
+    // Maximum corner of the box
+    Point3 max;
+
+    // Construct an empty box, which contains no point
+    constexpr Aabb() noexcept
+        : min(utils::INF, utils::INF, utils::INF),
+          max(-utils::INF, -utils::INF, -utils::INF) {}
+
+    // Construct a box from its two corners
+    constexpr Aabb(const Point3 & min, const Point3 & max) noexcept
+        : min(min), max(max) {}
+
+    // Construct the bounding box of a single point
+    constexpr static Aabb from_point(const Point3 & p) noexcept {
+        return Aabb(p, p);
+    }
+
+    // Check if the box contains no point
+    constexpr bool is_empty() const noexcept {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    // Extend the box to contain a point
+    constexpr void extend(const Point3 & p) noexcept {
+        min = Point3(std::min(min.x, p.x), std::min(min.y, p.y),
+                     std::min(min.z, p.z));
+        max = Point3(std::max(max.x, p.x), std::max(max.y, p.y),
+                     std::max(max.z, p.z));
+    }
+
+    // Extend the box to contain another box
+    constexpr void extend(const Aabb & other) noexcept {
+        min = Point3(std::min(min.x, other.min.x), std::min(min.y, other.min.y),
+                     std::min(min.z, other.min.z));
+        max = Point3(std::max(max.x, other.max.x), std::max(max.y, other.max.y),
+                     std::max(max.z, other.max.z));
+    }
+
+    // Union of two boxes
+    constexpr Aabb merge(const Aabb & other) const noexcept {
+        Aabb res = *this;
+        res.extend(other);
+        return res;
+    }
+
+    // Intersection of two boxes, empty if they do not overlap
+    constexpr Aabb intersect(const Aabb & other) const noexcept {
+        return Aabb(Point3(std::max(min.x, other.min.x),
+                           std::max(min.y, other.min.y),
+                           std::max(min.z, other.min.z)),
+                    Point3(std::min(max.x, other.max.x),
+                           std::min(max.y, other.max.y),
+                           std::min(max.z, other.max.z)));
+    }
+
+    // Size of the box along each axis
+    constexpr Vec3 diagonal() const noexcept { return max - min; }
+
+    // Centre of the box
+    constexpr Point3 centroid() const noexcept { return 0.5 * (min + max); }
+
+    // Index of the axis along which the box is the largest
+    constexpr int largest_axis() const noexcept {
+        const Vec3 d = diagonal();
+        return d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+    }
+
+    // Surface area of the box. The empty box has a null area.
+    constexpr double surface_area() const noexcept {
+        if (is_empty()) {
+            return 0.0;
+        }
+        const Vec3 d = diagonal();
+        return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // Check if a ray intersects the box in the [tmin, tmax] interval, given
+    // the ray origin and the componentwise inverse of its direction. The slab
+    // distances are reduced with min/max only, without branching on the sign
+    // of the direction.
+    constexpr bool hit(const Point3 & origin,
+                       const Vec3 & inv_direction,
+                       const double tmin,
+                       const double tmax) const noexcept {
+        const Vec3 t0 = (min - origin) * inv_direction;
+        const Vec3 t1 = (max - origin) * inv_direction;
+        const double t_near =
+            std::max(std::max(std::min(t0.x, t1.x), std::min(t0.y, t1.y)),
+                     std::max(std::min(t0.z, t1.z), tmin));
+        const double t_far =
+            std::min(std::min(std::max(t0.x, t1.x), std::max(t0.y, t1.y)),
+                     std::max(t0.z, t1.z))
+            * ROBUST_FAR_SCALE;
+        return t_near <= std::min(t_far, tmax);
+    }
+
+    // Check if a ray intersects the box in the [tmin, tmax] interval.
+    // Prefer the precomputed inverse direction version in traversal loops.
+    constexpr bool hit(const Ray & ray,
+                       const double tmin,
+                       const double tmax) const noexcept {
+        return hit(ray.origin, 1.0 / ray.direction, tmin, tmax);
+    }
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include <vector>
 
 // From src/include
+#include <accelerators/accelerator.hpp>
 #include <camera.hpp>
 #include <extern/json.hpp>
 #include <hittable.hpp>
@@ -16,7 +17,7 @@ class ParseJsonException : public std::exception {
     const char * msg;
 
 public:
-    ParseJsonException(const char * msg) {}
+    ParseJsonException(const char * msg) : msg(msg) {}
 
     virtual const char * what() const noexcept override { return msg; }
 };
@@ -39,6 +40,8 @@ struct Params {
     Camera cam;
     // Basic image and rendering settings
     ImageInfo info;
+    // Acceleration structure settings
+    AccelerationInfo acceleration;
     // Vector of global lights
     std::vector<GlobalIllumination> global_lights;
     // Map of named materials
@@ -0,0 +1,47 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// File mapped in memory. The mapping is private: writes to the memory are
+// never written back to the file. On platforms without mmap, the file is read
+// in a buffer.
+class MappedFile {
+private:
+    // Start of the mapped memory
+    std::byte * bytes = nullptr;
+    // Size of the file, in bytes
+    size_t file_size = 0;
+#ifdef _WIN32
+    // Buffer holding the file content
+    std::vector<std::byte> buffer;
+#endif
+
+public:
+    // Map a file. Throws if the file cannot be opened or mapped.
+    explicit MappedFile(const std::string & file_name);
+
+    // The mapping cannot be copied
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    // Unmap the file
+    ~MappedFile() noexcept;
+
+    // Start of the file content
+    inline std::byte * data() const noexcept { return bytes; }
+
+    // Size of the file, in bytes
+    inline size_t size() const noexcept { return file_size; }
+};
+
+// Size and last modification time of a file, which identify its version for
+// the files derived from it. Returns false if the file cannot be read.
+bool file_stamp(const std::string & file_name,
+                uint64_t & size,
+                int64_t & time) noexcept;
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef OBJ_FILE_HPP
+#define OBJ_FILE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <utils/vec3.hpp>
+
+// Geometry of a Wavefront .obj file. The file is mapped in memory and split in
+// line-aligned chunks, parsed in parallel without allocating per line. Only
+// the vertex positions and the faces are kept: texture coordinates and
+// normals are skipped, as well as the vt and vn indices of the face corners.
+class ObjFile {
+private:
+    // Vertex positions
+    std::vector<Point3> vertex_storage;
+    // Vertex indices of the corners of the faces, face after face. Indices
+    // start at 0 and are all valid.
+    std::vector<uint32_t> corners;
+    // Index of the first corner of each face, followed by the number of
+    // corners
+    std::vector<size_t> face_offsets;
+    // Size of the file, in bytes
+    size_t file_size = 0;
+    // Time spent parsing the file, in milliseconds
+    double parse_millis = 0.0;
+
+public:
+    // Parse a .obj file. Throws if the file cannot be read, or if a face
+    // references a missing vertex.
+    explicit ObjFile(const std::string & file_name);
+
+    // Function receiving the vertices or the triangles of a file a block at a
+    // time. The block is only valid during the call.
+    using VertexBlockFunction = std::function<void(std::span<const Point3>)>;
+    using TriangleBlockFunction =
+        std::function<void(std::span<const std::array<uint32_t, 3>>)>;
+
+    // Parse a .obj file a group of chunks at a time, passing the vertices and
+    // the faces split in triangle fans in order to the given functions, so
+    // that the mesh is never held in memory. Throws if the file cannot be
+    // read, or if a face references a missing vertex.
+    static void stream(const std::string & file_name,
+                       const VertexBlockFunction & vertex_block,
+                       const TriangleBlockFunction & triangle_block);
+
+    // Vertex positions
+    inline const std::vector<Point3> & vertices() const noexcept {
+        return vertex_storage;
+    }
+
+    // Number of faces
+    inline size_t face_count() const noexcept {
+        return face_offsets.size() - 1;
+    }
+
+    // Vertex indices of the corners of a face, in order
+    inline std::span<const uint32_t> face(const size_t i) const noexcept {
+        return std::span<const uint32_t>(corners.data() + face_offsets[i],
+                                         face_offsets[i + 1] - face_offsets[i]);
+    }
+
+    // Time spent parsing the file, in milliseconds
+    inline double parse_time() const noexcept { return parse_millis; }
+
+    // Parsing throughput, in MB per second
+    inline double throughput() const noexcept {
+        return parse_millis > 0.0 ? file_size / (1000.0 * parse_millis) : 0.0;
+    }
+
+    // Size of the file, in bytes
+    inline size_t size() const noexcept { return file_size; }
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef PAGE_CACHE_HPP
+#define PAGE_CACHE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+    #include <fstream>
+#endif
+
+// Fixed size pages of a file, read on demand into a pool of slots and evicted
+// with the CLOCK policy, an approximation of least recently used order. The
+// pool is allocated once, so the memory used never exceeds its size. Pages
+// are pinned while in use and never evicted then. Thread safe: resident pages
+// are pinned and released without locking, the lock is only taken to read a
+// page. A page which cannot be read makes the cache fail for good.
+class PageCache {
+public:
+    // Slot or page of an empty entry
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+private:
+    // Bit of the pin count of a slot being refilled. Users pinning the slot
+    // then unpin it and take the lock.
+    static constexpr uint32_t LOADING = uint32_t(1) << 31;
+
+    // Slot of the pool holding a page
+    struct Slot {
+        // Page held, or NONE. Only changed while LOADING is set.
+        std::atomic<uint32_t> page = NONE;
+        // Number of users of the page, and LOADING
+        std::atomic<uint32_t> pins = 0;
+        // Whether the page was used since the clock hand last passed it
+        std::atomic<bool> referenced = false;
+    };
+
+    // Accesses to resident pages by a thread, on its own cache line
+    struct alignas(64) HitCounter {
+        std::atomic<uint64_t> count = 0;
+    };
+
+    // Name of the file, for the error messages
+    std::string name;
+#ifdef _WIN32
+    // The file, only read under the lock
+    std::ifstream file;
+#else
+    // Descriptor of the file, read concurrently
+    int fd = -1;
+#endif
+    // Offset of the first page in the file, in bytes
+    size_t first_page_offset;
+    // Size of a page, in bytes
+    size_t page_size;
+    // Number of pages of the file
+    size_t pages_in_file;
+    // Number of slots of the pool
+    size_t slots_in_pool;
+    // Memory of the slots
+    std::vector<std::byte> memory;
+    // Slot of each page, or NONE when the page is not resident
+    std::unique_ptr<std::atomic<uint32_t>[]> page_slots;
+    // Slots of the pool
+    std::unique_ptr<Slot[]> slots;
+    // Next slot considered for eviction
+    size_t clock_hand = 0;
+    // Accesses to a resident page, per thread
+    std::unique_ptr<HitCounter[]> hit_counters;
+    size_t hit_counter_count;
+    // Accesses to a page which had to be read
+    uint64_t fault_count = 0;
+    // Pages evicted to make room for others
+    uint64_t eviction_count = 0;
+    // Whether a page could not be read
+    std::atomic<bool> read_failed = false;
+    // Guards the faults: the clock hand and the counters above
+    mutable std::mutex mutex;
+    // Signaled when a page is read
+    std::condition_variable changed;
+
+    // Read a page into a slot. Returns false on failure.
+    bool read_page(const uint32_t page, std::byte * destination);
+
+    // Pin a page if it is resident and not being read. Returns its slot, or
+    // NONE.
+    uint32_t pin_resident(const uint32_t page) noexcept;
+
+    // Claim a slot which is not in use for a new page, setting its LOADING
+    // bit. Called under the lock. Returns NONE if all the slots are in use.
+    uint32_t claim_slot() noexcept;
+
+    // Pin a page which is not resident, reading it
+    const std::byte * fault(const uint32_t page) noexcept;
+
+public:
+    // Cache the `page_count` pages of a file, starting at a given offset,
+    // in `slot_count` slots. Throws if the file cannot be opened.
+    PageCache(const std::string & file_name,
+              const size_t first_page_offset,
+              const size_t page_size,
+              const size_t page_count,
+              const size_t slot_count);
+
+    // The cache cannot be copied
+    PageCache(const PageCache &) = delete;
+    PageCache & operator=(const PageCache &) = delete;
+
+    // Close the file
+    ~PageCache() noexcept;
+
+    // Pin a page, reading it if needed, and return its content. It stays
+    // valid until the page is released. Returns nullptr once a page could not
+    // be read.
+    inline const std::byte * acquire(const uint32_t page) noexcept {
+        const uint32_t slot = pin_resident(page);
+        if (slot == NONE) {
+            return fault(page);
+        }
+        return memory.data() + slot * page_size;
+    }
+
+    // Unpin a page acquired before
+    inline void release(const uint32_t page) noexcept {
+        slots[page_slots[page].load(std::memory_order_relaxed)].pins.fetch_sub(
+            1, std::memory_order_release);
+    }
+
+    // Size of a page, in bytes
+    inline size_t get_page_size() const noexcept { return page_size; }
+
+    // Number of pages of the file
+    inline size_t page_count() const noexcept { return pages_in_file; }
+
+    // Number of pages which fit in memory
+    inline size_t slot_count() const noexcept { return slots_in_pool; }
+
+    // Memory used by the pages, in bytes
+    inline size_t memory_usage() const noexcept { return memory.size(); }
+
+    // Whether a page could not be read. The pages acquired since then are
+    // missing.
+    inline bool failed() const noexcept {
+        return read_failed.load(std::memory_order_relaxed);
+    }
+
+    // Number of accesses to a resident page
+    uint64_t hits() const noexcept;
+
+    // Number of pages read from the file
+    uint64_t faults() const noexcept;
+
+    // Number of pages evicted
+    uint64_t evictions() const noexcept;
+
+    // Fraction of the accesses to a resident page
+    double hit_rate() const noexcept;
+};
+
+#endif
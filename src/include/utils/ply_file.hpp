@@ -0,0 +1,111 @@
+#ifndef PLY_FILE_HPP
+#define PLY_FILE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <utils/vec3.hpp>
+
+// Types of the properties of a .ply file
+enum class PlyType : uint8_t {
+    INT8,
+    UINT8,
+    INT16,
+    UINT16,
+    INT32,
+    UINT32,
+    FLOAT32,
+    FLOAT64
+};
+
+// Property of an element of a .ply file: a single value, or a list of values
+// preceded by their count
+struct PlyProperty {
+    std::string name;
+    // Type of the values
+    PlyType type;
+    // Wether the property is a list
+    bool is_list;
+    // Type of the count of a list
+    PlyType count_type;
+};
+
+// Element of a .ply file, such as the vertices or the faces
+struct PlyElement {
+    std::string name;
+    // Number of records
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+// Binary little endian .ply file, as written by most scanners. The header is
+// read when the file is opened, then the elements are streamed through a
+// small buffer straight into the arrays of the mesh: only the vertex
+// positions and normals and the face indices are decoded, the other
+// properties and elements are skipped.
+class PlyFile {
+private:
+    // Name of the file, for the error messages
+    std::string name;
+    // The file, positioned at the start of the data after the header is read
+    std::ifstream file;
+    // Size of the file, in bytes
+    size_t file_size = 0;
+    // Elements, in the order of the file
+    std::vector<PlyElement> elements;
+    // Number of vertices and of faces
+    size_t vertices_in_file = 0;
+    size_t faces_in_file = 0;
+    // Wether the vertices have normals
+    bool normals_in_file = false;
+
+    // Parse the name of a type. Throws if it is unknown.
+    PlyType parse_type(const std::string & type_name) const;
+
+    // Read the header. Throws if it is invalid or describes another format.
+    void read_header();
+
+public:
+    // Open a .ply file and read its header. Throws if the file cannot be
+    // opened, is not a binary little endian .ply file, or has no vertex
+    // positions or face indices.
+    explicit PlyFile(const std::string & file_name);
+
+    // Number of vertices
+    inline size_t vertex_count() const noexcept { return vertices_in_file; }
+
+    // Number of faces. Polygons give several triangles.
+    inline size_t face_count() const noexcept { return faces_in_file; }
+
+    // Wether the vertices have normals
+    inline bool has_normals() const noexcept { return normals_in_file; }
+
+    // Read the vertices, the faces split in triangle fans, and the vertex
+    // normals if the file has some, replacing the content of the arrays.
+    // Throws if the file is truncated or a face references a missing vertex.
+    void read(std::vector<Point3> & vertices,
+              std::vector<std::array<uint32_t, 3>> & triangles,
+              std::vector<Vec3> & normals);
+
+    // Function receiving the vertices or the triangles of a file a block at a
+    // time. The block is only valid during the call.
+    using VertexBlockFunction = std::function<void(std::span<const Point3>)>;
+    using TriangleBlockFunction =
+        std::function<void(std::span<const std::array<uint32_t, 3>>)>;
+
+    // Read the vertices and the faces split in triangle fans, passing them
+    // in order to the given functions a block at a time, so that the mesh is
+    // never held in memory. Normals are skipped. Throws if the file is
+    // truncated or a face references a missing vertex.
+    void stream(const VertexBlockFunction & vertex_block,
+                const TriangleBlockFunction & triangle_block);
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include <cmath>
+
+// From src/include
+#include <ray.hpp>
+#include <utils.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+// Affine transform: a linear map followed by a translation
+class Transform {
+public:
+    // Rows of the matrix of the linear map
+    Vec3 rows[3];
+    // Translation applied after the linear map
+    Vec3 translation;
+
+    // Construct the identity transform
+    constexpr Transform() noexcept
+        : rows { vec3::X, vec3::Y, vec3::Z }, translation(vec3::ZEROS) {}
+
+    // Construct a transform from the rows of its matrix and its translation
+    constexpr Transform(const Vec3 & row0,
+                        const Vec3 & row1,
+                        const Vec3 & row2,
+                        const Vec3 & translation) noexcept
+        : rows { row0, row1, row2 }, translation(translation) {}
+
+    // Translation by a vector
+    constexpr static Transform translate(const Vec3 & offset) noexcept {
+        return Transform(vec3::X, vec3::Y, vec3::Z, offset);
+    }
+
+    // Scaling along each axis
+    constexpr static Transform scale(const Vec3 & factors) noexcept {
+        return Transform(Vec3(factors.x, 0, 0), Vec3(0, factors.y, 0),
+                         Vec3(0, 0, factors.z), vec3::ZEROS);
+    }
+
+    // Rotation around a unit axis, by an angle in radians
+    inline static Transform rotate(const Vec3 & axis,
+                                   const double angle) noexcept {
+        const double c = std::cos(angle);
+        const double s = std::sin(angle);
+        const double t = 1.0 - c;
+        const Vec3 a = axis;
+        return Transform(
+            Vec3(t * a.x * a.x + c, t * a.x * a.y - s * a.z,
+                 t * a.x * a.z + s * a.y),
+            Vec3(t * a.x * a.y + s * a.z, t * a.y * a.y + c,
+                 t * a.y * a.z - s * a.x),
+            Vec3(t * a.x * a.z - s * a.y, t * a.y * a.z + s * a.x,
+                 t * a.z * a.z + c),
+            vec3::ZEROS);
+    }
+
+    // Compose two transforms: `other` is applied first
+    constexpr Transform operator*(const Transform & other) const noexcept {
+        const Vec3 c0(other.rows[0].x, other.rows[1].x, other.rows[2].x);
+        const Vec3 c1(other.rows[0].y, other.rows[1].y, other.rows[2].y);
+        const Vec3 c2(other.rows[0].z, other.rows[1].z, other.rows[2].z);
+        return Transform(
+            Vec3(rows[0].dot(c0), rows[0].dot(c1), rows[0].dot(c2)),
+            Vec3(rows[1].dot(c0), rows[1].dot(c1), rows[1].dot(c2)),
+            Vec3(rows[2].dot(c0), rows[2].dot(c1), rows[2].dot(c2)),
+            apply_point(other.translation));
+    }
+
+    // Determinant of the linear map
+    constexpr double determinant() const noexcept {
+        return rows[0].dot(rows[1].cross(rows[2]));
+    }
+
+    // Inverse transform. Throws if the linear map is singular.
+    inline Transform inverse() const {
+        const double det = determinant();
+        if (std::abs(det) < 1e-300) {
+            throw "Could not invert transform: singular matrix";
+        }
+        // The columns of the inverse are the cross products of the rows
+        const double inv_det = 1.0 / det;
+        const Vec3 c0 = rows[1].cross(rows[2]) * inv_det;
+        const Vec3 c1 = rows[2].cross(rows[0]) * inv_det;
+        const Vec3 c2 = rows[0].cross(rows[1]) * inv_det;
+        const Vec3 r0(c0.x, c1.x, c2.x);
+        const Vec3 r1(c0.y, c1.y, c2.y);
+        const Vec3 r2(c0.z, c1.z, c2.z);
+        return Transform(r0, r1, r2,
+                         -Vec3(r0.dot(translation), r1.dot(translation),
+                               r2.dot(translation)));
+    }
+
+    // Apply the linear map to a vector
+    constexpr Vec3 apply_vector(const Vec3 & v) const noexcept {
+        return Vec3(rows[0].dot(v), rows[1].dot(v), rows[2].dot(v));
+    }
+
+    // Apply the transposed linear map to a vector. Normals are transformed
+    // by the transpose of the inverse transform.
+    constexpr Vec3 apply_transpose(const Vec3 & v) const noexcept {
+        return v.x * rows[0] + v.y * rows[1] + v.z * rows[2];
+    }
+
+    // Apply the transform to a point
+    constexpr Point3 apply_point(const Point3 & p) const noexcept {
+        return apply_vector(p) + translation;
+    }
+
+    // Apply the transform to a ray. The direction is not normalized, so the
+    // ray times are preserved.
+    constexpr Ray apply(const Ray & ray) const noexcept {
+        return Ray(apply_point(ray.origin), apply_vector(ray.direction));
+    }
+
+    // Bounding box of a transformed box (Arvo, "Transforming Axis-Aligned
+    // Bounding Boxes")
+    constexpr Aabb apply(const Aabb & box) const noexcept {
+        Aabb res(translation, translation);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                const double a = rows[i][j] * box.min[j];
+                const double b = rows[i][j] * box.max[j];
+                res.min[i] += std::min(a, b);
+                res.max[i] += std::max(a, b);
+            }
+        }
+        return res;
+    }
+};
+
+#endif
@@ -266,6 +266,14 @@ namespace vec3 {
         }
 
         /// Operator overloading
+        // Get a component of the vector from its axis index (0, 1 or 2)
+        constexpr double operator[](const int axis) const noexcept {
+            return axis == 0 ? x : (axis == 1 ? y : z);
+        }
+        // Get a mutable component of the vector from its axis index
+        constexpr double & operator[](const int axis) noexcept {
+            return axis == 0 ? x : (axis == 1 ? y : z);
+        }
         // Get the opposite of a vector
         constexpr Vec3 operator-() const noexcept { return Vec3(-x, -y, -z); }
         // Unary + operator
@@ -0,0 +1,45 @@
+#ifndef WELD_HPP
+#define WELD_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// From src/include
+#include <utils/vec3.hpp>
+
+// Settings of the vertex welding pass run when a mesh is loaded
+struct WeldInfo {
+    // Wether vertices are welded
+    bool enabled = false;
+    // Vertices closer than this distance are merged. With 0, only vertices
+    // at the exact same position are.
+    double tolerance = 1e-6;
+};
+
+// Sizes of a mesh before and after welding
+struct WeldStats {
+    // Wether the pass ran
+    bool welded = false;
+    size_t vertices_before = 0;
+    size_t vertices_after = 0;
+    size_t triangles_before = 0;
+    size_t triangles_after = 0;
+    // Time spent welding, in milliseconds
+    double millis = 0.0;
+};
+
+// Merge the vertices of a triangle mesh closer than `tolerance`, found with a
+// spatial hash, and remap the triangles to the merged vertices in parallel.
+// Chains of close vertices are merged into their first vertex, but only the
+// ones within `tolerance` of it, so that no vertex moves further. Vertices with
+// different normals are kept apart, so that sharp edges stay sharp. The
+// triangles left with a null area are dropped, then the vertices no triangle
+// uses. `normals` is either empty or holds one normal per vertex.
+WeldStats weld_vertices(std::vector<Point3> & vertices,
+                        std::vector<std::array<uint32_t, 3>> & triangles,
+                        std::vector<Vec3> & normals,
+                        const double tolerance);
+
+#endif
@@ -4,13 +4,17 @@
 #include <cstdio>
 #include <ctime>
 // C++ headers
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <string>
 // Parallelization lib
 #include <omp.h>
 
 // From src/include
+#include <accelerators/accelerator.hpp>
 #include <camera.hpp>
+#include <objects/paged_mesh.hpp>
 #include <utils/image.hpp>
 #include <utils/load_json.hpp>
 #include <utils/progress_bar.hpp>
@@ -25,6 +29,12 @@ constexpr double processing_kernel_offset =
 constexpr double processing_kernel_min = 0.0 - processing_kernel_offset;
 constexpr double processing_kernel_max = 1.0 + processing_kernel_offset;
 
+// Size of the square tiles of pixels traced together in stream mode
+constexpr size_t TILE_SIZE = 8;
+// Number of rays traced together in stream mode. A tile traces as many
+// samples per pixel as fit in a stream.
+constexpr size_t STREAM_SIZE = 4096;
+
 int main(int argc, char * argv[]) try {
     // Initialize the RNG for all threads
 #pragma omp parallel
@@ -71,12 +81,14 @@ int main(int argc, char * argv[]) try {
 
     const Camera cam = params.cam;
 
+    const bool packets = params.acceleration.packets;
+    const bool streams = params.acceleration.streams;
+
     const vector<GlobalIllumination> global_lights = params.global_lights;
 
-    HittableList world;
-    for (const std::shared_ptr<Hittable> & obj : params.objects) {
-        world.add((const Hittable &)*obj);
-    }
+    const std::unique_ptr<Hittable> world_ptr =
+        make_accelerator(params.objects, params.acceleration);
+    const Hittable & world = *world_ptr;
 
     HittableList sampled_hittables;
     for (const size_t & index : params.sampled_objects) {
@@ -100,36 +112,31 @@ int main(int argc, char * argv[]) try {
     ProgressBar pb(width * height);
     console::log("Rendering image...");
 
+    uint64_t ray_count = 0;
+    const auto render_start = std::chrono::steady_clock::now();
     pb.start(term_colours::CYAN);
 
-#pragma omp parallel for schedule(dynamic)
-    for (size_t index = 0; index < width * height; ++index) {
-        // Colour c;
-        const size_t i = index % width;
-        const size_t j = height - 1 - (index / width);
-
-        Colour pixel_colour[2];
-        double luminance;
-        for (int k = 0; k < spp; ++k) {
-            // Compute camera coordinates
-            double u =
-                (static_cast<double>(i)
-                 + rng::gen(processing_kernel_min, processing_kernel_max))
-                * width_scale;
-            double v =
-                (static_cast<double>(j)
-                 + rng::gen(processing_kernel_min, processing_kernel_max))
-                * height_scale;
-            // Cast ray into scene
-            Colour c = cam.cast_ray(world, global_lights, sampled_hittables,
-                                    max_bounces, u, v);
-            // Add it to the pixel colour (separated in half buffers)
-            pixel_colour[k % 2] += c;
-            // Compute luminance and squared luminance
-            luminance = c.luminance();
-            var[k % 2][index] += luminance * luminance;
-        }
-        // Compute final pixel
+    // Random screen space coordinates of a sample of the pixel (i, j)
+    const auto sample_u = [&](size_t i) {
+        return (static_cast<double>(i)
+                + rng::gen(processing_kernel_min, processing_kernel_max))
+               * width_scale;
+    };
+    const auto sample_v = [&](size_t j) {
+        return (static_cast<double>(j)
+                + rng::gen(processing_kernel_min, processing_kernel_max))
+               * height_scale;
+    };
+    // Add the k-th sample of a pixel to its colour (separated in half
+    // buffers) and to its squared luminance
+    const auto add_sample = [&](size_t index, int k, const Colour & c,
+                                Colour * pixel_colour) {
+        pixel_colour[k % 2] += c;
+        const double luminance = c.luminance();
+        var[k % 2][index] += luminance * luminance;
+    };
+    // Compute the final pixel and its variance from the half buffers
+    const auto finish_pixel = [&](size_t index, const Colour * pixel_colour) {
         img[index] = (pixel_colour[0] + pixel_colour[1]) * spp_scale;
 
         // fill half buffers with variance
@@ -139,9 +146,126 @@ int main(int argc, char * argv[]) try {
         var[1][index] = var[1][index] * half_spp_scale - l1 * l1;
 
         pb.advance();
+    };
+
+    if (streams) {
+        // The samples of a tile are traced by streams, bounce after bounce
+        const size_t tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+        const size_t tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+#pragma omp parallel for schedule(dynamic) reduction(+ : ray_count)
+        for (size_t tile = 0; tile < tiles_x * tiles_y; ++tile) {
+            const size_t x0 = (tile % tiles_x) * TILE_SIZE;
+            const size_t y0 = (tile / tiles_x) * TILE_SIZE;
+            const size_t x1 = std::min(width, x0 + TILE_SIZE);
+            const size_t y1 = std::min(height, y0 + TILE_SIZE);
+            const size_t pixel_count = (x1 - x0) * (y1 - y0);
+            const int batch = std::max<int>(1, STREAM_SIZE / pixel_count);
+
+            vector<Colour> pixel_colours(2 * pixel_count);
+            vector<double> u;
+            vector<double> v;
+            vector<Colour> colours;
+            for (int k0 = 0; k0 < spp; k0 += batch) {
+                const int samples = std::min(batch, spp - k0);
+                u.clear();
+                v.clear();
+                for (size_t y = y0; y < y1; ++y) {
+                    for (size_t x = x0; x < x1; ++x) {
+                        for (int k = 0; k < samples; ++k) {
+                            u.push_back(sample_u(x));
+                            v.push_back(sample_v(height - 1 - y));
+                        }
+                    }
+                }
+                colours.resize(u.size());
+                cam.cast_stream(world, global_lights, sampled_hittables,
+                                max_bounces, u.data(), v.data(), u.size(),
+                                packets, colours.data(), ray_count);
+
+                size_t n = 0;
+                for (size_t y = y0, p = 0; y < y1; ++y) {
+                    for (size_t x = x0; x < x1; ++x, ++p) {
+                        for (int k = 0; k < samples; ++k) {
+                            add_sample(y * width + x, k0 + k, colours[n++],
+                                       &pixel_colours[2 * p]);
+                        }
+                    }
+                }
+            }
+
+            for (size_t y = y0, p = 0; y < y1; ++y) {
+                for (size_t x = x0; x < x1; ++x, ++p) {
+                    finish_pixel(y * width + x, &pixel_colours[2 * p]);
+                }
+            }
+        }
+    } else {
+#pragma omp parallel for schedule(dynamic) reduction(+ : ray_count)
+        for (size_t index = 0; index < width * height; ++index) {
+            const size_t i = index % width;
+            const size_t j = height - 1 - (index / width);
+
+            Colour pixel_colour[2];
+            int k = 0;
+            if (packets) {
+                // The samples of a pixel are coherent: trace them by packets
+                for (; k + int(PACKET_SIZE) <= spp; k += PACKET_SIZE) {
+                    double u[PACKET_SIZE];
+                    double v[PACKET_SIZE];
+                    for (size_t l = 0; l < PACKET_SIZE; ++l) {
+                        u[l] = sample_u(i);
+                        v[l] = sample_v(j);
+                    }
+                    Colour c[PACKET_SIZE];
+                    cam.cast_packet(world, global_lights, sampled_hittables,
+                                    max_bounces, u, v, c, ray_count);
+                    for (size_t l = 0; l < PACKET_SIZE; ++l) {
+                        add_sample(index, k + l, c[l], pixel_colour);
+                    }
+                }
+            }
+            for (; k < spp; ++k) {
+                // Compute camera coordinates
+                const double u = sample_u(i);
+                const double v = sample_v(j);
+                // Cast ray into scene
+                add_sample(index, k,
+                           cam.cast_ray(world, global_lights,
+                                        sampled_hittables, max_bounces, u, v,
+                                        ray_count),
+                           pixel_colour);
+            }
+            finish_pixel(index, pixel_colour);
+        }
     }
 
     pb.stop("Image rendered");
+    const double render_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                      - render_start)
+            .count();
+    console::log("Traced " + std::to_string(ray_count) + " rays ("
+                 + std::to_string(ray_count * 1e-6 / render_seconds)
+                 + " Mrays/s)");
+    // Page counters, to size the memory budget of paged meshes
+    for (const std::shared_ptr<Hittable> & object : params.objects) {
+        const PagedMesh * mesh = dynamic_cast<const PagedMesh *>(object.get());
+        if (mesh != nullptr) {
+            const PageCache & pages = mesh->get_pages();
+            console::log("Paged mesh: " + std::to_string(pages.faults())
+                         + " page faults, " + std::to_string(pages.hits())
+                         + " hits (" + std::to_string(100.0 * pages.hit_rate())
+                         + "% hit rate), " + std::to_string(pages.evictions())
+                         + " evictions");
+            if (pages.failed()) {
+                // Rays went through the pages which could not be read
+                throw std::string("Could not render the paged mesh: pages "
+                                  "could not be read, the image would miss "
+                                  "geometry");
+            }
+        }
+    }
     img.save_png("unfiltered_image.png");
 
     console::log("Applying firefly filter...");
@@ -1,3 +1,5 @@
+#include <cmath>
+
 // From src/include
 #include <hittable.hpp>
 #include <objects/cylinder.hpp>
@@ -71,3 +73,17 @@ bool Cylinder::hit(const Ray & ray,
 
     return false;
 }
+
+bool Cylinder::bounding_box(Aabb & output_box) const noexcept {
+    // The cylinder is bounded by its two end caps. A disk of normal `axis`
+    // extends by radius * sqrt(1 - axis_i^2) along the i-th coordinate axis.
+    const Vec3 extent =
+        radius
+        * Vec3(sqrt(fmax(0.0, 1.0 - axis.x * axis.x)),
+               sqrt(fmax(0.0, 1.0 - axis.y * axis.y)),
+               sqrt(fmax(0.0, 1.0 - axis.z * axis.z)));
+    const Point3 top = base + height * axis;
+    output_box = Aabb(base - extent, base + extent);
+    output_box.extend(Aabb(top - extent, top + extent));
+    return true;
+}
@@ -0,0 +1,70 @@
+#include <bit>
+
+// From src/include
+#include <hittable.hpp>
+#include <objects/instance.hpp>
+#include <ray_packet.hpp>
+#include <utils/transform.hpp>
+#include <utils/vec3.hpp>
+
+bool Instance::hit(const Ray & ray,
+                   const double tmin,
+                   const double tmax,
+                   HitRecord & hit_record) const noexcept {
+    // The object space direction is not normalized, so the hit times are
+    // the same in both spaces
+    if (!object->hit(inverse.apply(ray), tmin, tmax, hit_record)) {
+        return false;
+    }
+
+    // The orientation of the normal relative to the ray is preserved by the
+    // transform, so the front face flag is kept
+    hit_record.hit_point = ray.at(hit_record.time);
+    hit_record.surface_normal =
+        inverse.apply_transpose(hit_record.surface_normal).unit_vector();
+    if (material != nullptr) {
+        hit_record.material = std::cref(*material);
+    }
+    return true;
+}
+
+unsigned Instance::hit_packet(const RayPacket & packet,
+                              const unsigned mask,
+                              const double tmin,
+                              double * tmax,
+                              HitRecord * records) const noexcept {
+    // A coherent packet stays coherent in object space
+    Ray rays[PACKET_SIZE];
+    for (size_t i = 0; i < PACKET_SIZE; ++i) {
+        rays[i] = inverse.apply(packet.rays[i]);
+    }
+    const unsigned hit =
+        object->hit_packet(RayPacket(rays), mask, tmin, tmax, records);
+
+    for (unsigned m = hit; m; m &= m - 1) {
+        const unsigned l = std::countr_zero(m);
+        HitRecord & hit_record = records[l];
+        hit_record.hit_point = packet.rays[l].at(hit_record.time);
+        hit_record.surface_normal =
+            inverse.apply_transpose(hit_record.surface_normal).unit_vector();
+        if (material != nullptr) {
+            hit_record.material = std::cref(*material);
+        }
+    }
+    return hit;
+}
+
+bool Instance::occluded(const Ray & ray,
+                        const double tmin,
+                        const double tmax) const noexcept {
+    return object->occluded(inverse.apply(ray), tmin, tmax);
+}
+
+bool Instance::bounding_box(Aabb & output_box) const noexcept {
+    Aabb box;
+    if (!object->bounding_box(box)) {
+        return false;
+    }
+    output_box = transform.apply(box);
+    return true;
+}
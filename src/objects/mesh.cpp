@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <hittable.hpp>
+#include <objects/mesh.hpp>
+#include <objects/triangle_batch.hpp>
+#include <utils.hpp>
+#include <utils/obj_file.hpp>
+#include <utils/ply_file.hpp>
+#include <utils/vec3.hpp>
+#include <utils/weld.hpp>
+
+// The BVH takes most of the memory of a mesh. The triangles of its leaves are
+// gathered in batches and tested this many at a time, which gives larger
+// leaves and halves the number of nodes.
+constexpr size_t LEAF_BATCH_SIZE = TriangleBatch::SIZE;
+
+void Mesh::read_obj_file(const std::string & obj_file_name,
+                         std::vector<Point3> & vertices,
+                         std::vector<Face> & faces) {
+    const ObjFile obj_file(obj_file_name);
+    vertices = obj_file.vertices();
+    for (size_t f = 0; f < obj_file.face_count(); ++f) {
+        const std::span<const uint32_t> polygon = obj_file.face(f);
+        for (size_t i = 2; i < polygon.size(); ++i) {
+            faces.push_back({ polygon[0], polygon[i - 1], polygon[i] });
+        }
+    }
+}
+
+void Mesh::use_storage() noexcept {
+    vertices = vertex_storage;
+    faces = face_storage;
+    normals = normal_storage;
+}
+
+bool Mesh::is_ply_file(const std::string & file_name) {
+    std::string extension =
+        std::filesystem::path(file_name).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](const unsigned char c) { return std::tolower(c); });
+    return extension == ".ply";
+}
+
+void Mesh::read_file(const std::string & file_name) {
+    if (is_ply_file(file_name)) {
+        PlyFile(file_name).read(vertex_storage, face_storage, normal_storage);
+    } else {
+        read_obj_file(file_name, vertex_storage, face_storage);
+    }
+    use_storage();
+}
+
+void Mesh::load(const std::string & file_name,
+                const bool use_cache,
+                const WeldInfo & weld) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::string cache_file_name = file_name + ".mesh";
+    cached = use_cache && load_cache(cache_file_name, file_name, weld);
+    if (!cached) {
+        // No cache, or a missing or stale one
+        read_file(file_name);
+        if (weld.enabled) {
+            weld_stats = weld_vertices(vertex_storage, face_storage,
+                                       normal_storage, weld.tolerance);
+            use_storage();
+        }
+        if (use_cache && !save_cache(cache_file_name, file_name, weld)) {
+            console::warn("Could not write mesh cache " + cache_file_name);
+        }
+    }
+    build(use_cache ? cache_file_name + ".bvh" : std::string());
+    load_millis = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+}
+
+void Mesh::build(const std::string & cache_file_name) {
+    const uint64_t key =
+        BvhTree::cache_key(geometry_key, SpatialSplitInfo(), LEAF_BATCH_SIZE);
+    if (!cache_file_name.empty() && tree.load_cache(cache_file_name, key)) {
+        return;
+    }
+
+    std::vector<Aabb> boxes(faces.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < faces.size(); ++i) {
+        boxes[i] = Aabb::from_point(vertices[faces[i][0]]);
+        boxes[i].extend(vertices[faces[i][1]]);
+        boxes[i].extend(vertices[faces[i][2]]);
+    }
+    tree = BvhTree(boxes, LEAF_BATCH_SIZE);
+    if (!cache_file_name.empty() && !tree.save_cache(cache_file_name, key)) {
+        console::warn("Could not write BVH cache " + cache_file_name);
+    }
+}
+
+uint32_t Mesh::intersect_leaf(const WatertightRay & ray,
+                              const uint32_t first,
+                              const uint32_t count,
+                              const double tmin,
+                              const double tmax,
+                              double & time) const noexcept {
+    const std::span<const uint32_t> indices =
+        tree.primitive_indices().subspan(first, count);
+    TriangleBatch batches[BvhTree::MAX_LEAF_BATCHES];
+    constexpr size_t BATCHES_SIZE =
+        BvhTree::MAX_LEAF_BATCHES * TriangleBatch::SIZE;
+    uint32_t closest = TriangleBatch::NO_TRIANGLE;
+    time = tmax;
+    // Leaves whose triangles could not be split may not fit in the batches
+    for (size_t start = 0; start < count; start += BATCHES_SIZE) {
+        const size_t batch_count = TriangleBatch::gather(
+            indices.subspan(start, std::min(BATCHES_SIZE, count - start)),
+            vertices, faces, batches);
+        double batch_time;
+        const uint32_t index = TriangleBatch::intersect(
+            ray, batches, batch_count, tmin, time, batch_time);
+        if (index != TriangleBatch::NO_TRIANGLE) {
+            closest = index;
+            time = batch_time;
+        }
+    }
+    return closest;
+}
+
+bool Mesh::hit(const Ray & ray,
+               const double tmin,
+               const double tmax,
+               HitRecord & hit_record) const noexcept {
+    const WatertightRay watertight_ray(ray);
+    uint32_t closest = TriangleBatch::NO_TRIANGLE;
+    double closest_time = tmax;
+    tree.traverse_leaves(
+        ray, tmin, tmax, [&](uint32_t first, uint32_t count, double & t_max) {
+            double time;
+            const uint32_t index =
+                intersect_leaf(watertight_ray, first, count, tmin, t_max, time);
+            if (index == TriangleBatch::NO_TRIANGLE) {
+                return false;
+            }
+            closest = index;
+            closest_time = time;
+            t_max = time;
+            return true;
+        });
+    if (closest == TriangleBatch::NO_TRIANGLE) {
+        return false;
+    }
+
+    // The hit record is only filled for the closest triangle
+    const Face & face = faces[closest];
+    const Point3 & a = vertices[face[0]];
+    const Point3 & b = vertices[face[1]];
+    const Point3 & c = vertices[face[2]];
+    const Vec3 normal = (b - a).cross(c - a);
+    hit_record.time = closest_time;
+    hit_record.hit_point = ray.at(closest_time);
+    hit_record.set_face_normal(ray, normal.unit_vector());
+    if (!normals.empty()) {
+        // Barycentric coordinates of the hit point, from the areas of the
+        // sub-triangles facing each vertex
+        const double squared_norm = normal.squared_norm();
+        const Point3 & p = hit_record.hit_point;
+        const double wa = (c - b).cross(p - b).dot(normal) / squared_norm;
+        const double wb = (a - c).cross(p - c).dot(normal) / squared_norm;
+        const Vec3 shading_normal = wa * normals[face[0]]
+                                    + wb * normals[face[1]]
+                                    + (1.0 - wa - wb) * normals[face[2]];
+        // Vertices without normals keep the geometric normal. Otherwise, the
+        // shading normal stays on the side of the geometric normal.
+        if (shading_normal.squared_norm() > 0.0) {
+            hit_record.surface_normal =
+                shading_normal.dot(hit_record.surface_normal) < 0.0
+                    ? -shading_normal.unit_vector()
+                    : shading_normal.unit_vector();
+        }
+    }
+    hit_record.material = material;
+    return true;
+}
+
+bool Mesh::occluded(const Ray & ray,
+                    const double tmin,
+                    const double tmax) const noexcept {
+    const WatertightRay watertight_ray(ray);
+    return tree.traverse_any_leaves(
+        ray, tmin, tmax, [&](uint32_t first, uint32_t count) {
+            double time;
+            return intersect_leaf(watertight_ray, first, count, tmin, tmax,
+                                  time)
+                   != TriangleBatch::NO_TRIANGLE;
+        });
+}
+
+bool Mesh::bounding_box(Aabb & output_box) const noexcept {
+    if (faces.empty()) {
+        return false;
+    }
+    output_box = tree.bounds();
+    return true;
+}
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// From src/include
+#include <objects/mesh.hpp>
+#include <utils.hpp>
+#include <utils/mapped_file.hpp>
+#include <utils/vec3.hpp>
+#include <utils/weld.hpp>
+
+// Version of the cache format. Must be increased when it changes, to
+// invalidate the existing cache files.
+constexpr uint32_t MESH_CACHE_VERSION = 2;
+// Magic number at the start of cache files
+constexpr char MESH_CACHE_MAGIC[8] = { 'X', 'T', 'R', 'M',
+                                       'M', 'S', 'H', '\0' };
+// Alignment of the sections of a cache file, in bytes
+constexpr size_t MESH_CACHE_ALIGNMENT = 64;
+// Flag of the cache files holding vertex normals
+constexpr uint32_t MESH_CACHE_NORMALS = 1;
+// Flag of the cache files holding a welded mesh
+constexpr uint32_t MESH_CACHE_WELDED = 2;
+// Number of vertices or faces hashed by each task
+constexpr size_t HASH_CHUNK_SIZE = 1 << 16;
+
+// The arrays of the mesh are used in place from the file
+static_assert(std::is_trivially_copyable_v<Point3>);
+static_assert(std::is_trivially_copyable_v<Mesh::Face>);
+static_assert(sizeof(Point3) == 3 * sizeof(double));
+
+// Header of a cache file. It is followed by the vertices, the faces, then the
+// vertex normals if the mesh has some, each starting on an aligned offset.
+struct MeshCacheHeader {
+    // Magic number
+    char magic[8];
+    // Version of the format
+    uint32_t version;
+    // MESH_CACHE_NORMALS if the file holds vertex normals, MESH_CACHE_WELDED
+    // if its vertices were welded
+    uint32_t flags;
+    // Content hash of the geometry
+    uint64_t key;
+    // Size of the source file, in bytes
+    uint64_t source_size;
+    // Last modification time of the source file
+    int64_t source_time;
+    // Number of vertices
+    uint64_t vertex_count;
+    // Number of faces
+    uint64_t face_count;
+    // Size of a vertex and of a face, to reject files written with another
+    // layout
+    uint16_t vertex_size;
+    uint16_t face_size;
+    // Welding tolerance, only compared to the requested one
+    float weld_tolerance;
+};
+
+static_assert(sizeof(MeshCacheHeader) == MESH_CACHE_ALIGNMENT);
+
+// Round an offset up to the alignment of the sections
+static constexpr size_t align_offset(const size_t offset) noexcept {
+    return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT
+           * MESH_CACHE_ALIGNMENT;
+}
+
+// Offsets of the sections of a cache file
+struct MeshCacheLayout {
+    size_t vertices;
+    size_t faces;
+    size_t normals;
+    size_t end;
+
+    constexpr MeshCacheLayout(const MeshCacheHeader & header) noexcept
+        : vertices(sizeof(MeshCacheHeader)),
+          faces(align_offset(vertices
+                             + header.vertex_count * sizeof(Point3))),
+          normals(align_offset(faces + header.face_count * sizeof(Mesh::Face))),
+          end(header.flags & MESH_CACHE_NORMALS
+                  ? normals + header.vertex_count * sizeof(Vec3)
+                  : normals) {}
+};
+
+// Hash an array in fixed size chunks, in parallel, then combine them in
+// order, so the hash does not depend on the number of threads.
+// `hash_element(hash, element)` mixes an element in a hash.
+template <class T, class F>
+static uint64_t hash_array(const std::span<const T> elements,
+                           const F & hash_element) noexcept {
+    const size_t chunk_count =
+        (elements.size() + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE;
+    std::vector<uint64_t> chunk_hashes(chunk_count);
+#pragma omp parallel for
+    for (size_t c = 0; c < chunk_count; ++c) {
+        const size_t end = std::min(elements.size(), (c + 1) * HASH_CHUNK_SIZE);
+        uint64_t hash = c;
+        for (size_t i = c * HASH_CHUNK_SIZE; i < end; ++i) {
+            hash = hash_element(hash, elements[i]);
+        }
+        chunk_hashes[c] = utils::hash_finalize(hash);
+    }
+
+    uint64_t hash = elements.size();
+    for (const uint64_t chunk_hash : chunk_hashes) {
+        hash = utils::hash_mix(hash, chunk_hash);
+    }
+    return utils::hash_finalize(hash);
+}
+
+// Mix the coordinates of a vector in a hash
+static inline uint64_t hash_vector(const uint64_t hash,
+                                   const Vec3 & v) noexcept {
+    uint64_t h = utils::hash_mix(hash, std::bit_cast<uint64_t>(v.x));
+    h = utils::hash_mix(h, std::bit_cast<uint64_t>(v.y));
+    return utils::hash_mix(h, std::bit_cast<uint64_t>(v.z));
+}
+
+// Flags and tolerance identifying the welding settings of a cache file
+static inline uint32_t weld_flags(const WeldInfo & weld) noexcept {
+    return weld.enabled ? MESH_CACHE_WELDED : 0;
+}
+
+static inline float weld_tolerance(const WeldInfo & weld) noexcept {
+    return weld.enabled ? float(weld.tolerance) : 0.0f;
+}
+
+bool Mesh::load_cache(const std::string & file_name,
+                      const std::string & source_file_name,
+                      const WeldInfo & weld) {
+    uint64_t source_size;
+    int64_t source_time;
+    if (!std::filesystem::exists(file_name)
+        || !file_stamp(source_file_name, source_size, source_time)) {
+        return false;
+    }
+
+    std::unique_ptr<MappedFile> file;
+    try {
+        file = std::make_unique<MappedFile>(file_name);
+    } catch (...) {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    if (file->size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != MESH_CACHE_VERSION
+        || header.vertex_size != sizeof(Point3)
+        || header.face_size != sizeof(Face)
+        || header.source_size != source_size
+        || header.source_time != source_time
+        || (header.flags & MESH_CACHE_WELDED) != weld_flags(weld)
+        || header.weld_tolerance != weld_tolerance(weld)
+        || header.vertex_count > UINT32_MAX
+        || header.face_count > file->size()
+        || file->size() != MeshCacheLayout(header).end) {
+        return false;
+    }
+
+    // The faces are checked once, so that a corrupt file cannot send the
+    // traversal out of the vertices
+    const MeshCacheLayout layout(header);
+    std::byte * const data = file->data();
+    const std::span<const Face> file_faces(
+        reinterpret_cast<const Face *>(data + layout.faces), header.face_count);
+    const uint64_t vertex_count = header.vertex_count;
+    bool invalid_index = false;
+#pragma omp parallel for reduction(|| : invalid_index)
+    for (size_t i = 0; i < file_faces.size(); ++i) {
+        const Face & face = file_faces[i];
+        invalid_index = invalid_index || face[0] >= vertex_count
+                        || face[1] >= vertex_count || face[2] >= vertex_count;
+    }
+    if (invalid_index) {
+        return false;
+    }
+
+    // The other arrays are used in place, and only read from disk when first
+    // accessed
+    vertices = std::span<const Point3>(
+        reinterpret_cast<const Point3 *>(data + layout.vertices),
+        header.vertex_count);
+    faces = file_faces;
+    if (header.flags & MESH_CACHE_NORMALS) {
+        normals = std::span<const Vec3>(
+            reinterpret_cast<const Vec3 *>(data + layout.normals),
+            header.vertex_count);
+    } else {
+        normals = std::span<const Vec3>();
+    }
+    std::vector<Point3>().swap(vertex_storage);
+    std::vector<Face>().swap(face_storage);
+    std::vector<Vec3>().swap(normal_storage);
+    mapping = std::move(file);
+    geometry_key = header.key;
+    return true;
+}
+
+bool Mesh::save_cache(const std::string & file_name,
+                      const std::string & source_file_name,
+                      const WeldInfo & weld) {
+    // The key only depends on the geometry, so that touching the source file
+    // keeps the cached BVH valid. It is computed even if the cache cannot be
+    // written, since the BVH cache is looked up with it.
+    uint64_t key = hash_array(vertices, hash_vector);
+    key = utils::hash_mix(
+        key, hash_array(faces, [](const uint64_t hash, const Face & face) {
+            return utils::hash_mix(
+                utils::hash_mix(hash, (uint64_t(face[0]) << 32) | face[1]),
+                face[2]);
+        }));
+    key = utils::hash_mix(key, hash_array(normals, hash_vector));
+    geometry_key = utils::hash_finalize(key);
+
+    MeshCacheHeader header {};
+    if (!file_stamp(source_file_name, header.source_size,
+                    header.source_time)) {
+        return false;
+    }
+
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.flags =
+        (normals.empty() ? 0 : MESH_CACHE_NORMALS) | weld_flags(weld);
+    header.weld_tolerance = weld_tolerance(weld);
+    header.key = geometry_key;
+    header.vertex_count = vertices.size();
+    header.face_count = faces.size();
+    header.vertex_size = sizeof(Point3);
+    header.face_size = sizeof(Face);
+    const MeshCacheLayout layout(header);
+
+    // Write to a temporary file, then rename it, so that concurrent jobs
+    // never read a partial file
+    const std::string tmp_name =
+        file_name + "."
+        + std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count())
+        + ".tmp";
+    {
+        std::ofstream file(tmp_name, std::ios_base::out
+                                         | std::ios_base::binary
+                                         | std::ios_base::trunc);
+        if (!file) {
+            return false;
+        }
+        const char zeros[MESH_CACHE_ALIGNMENT] = {};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(vertices.data()),
+                   vertices.size_bytes());
+        file.write(zeros,
+                   layout.faces - layout.vertices - vertices.size_bytes());
+        file.write(reinterpret_cast<const char *>(faces.data()),
+                   faces.size_bytes());
+        if (!normals.empty()) {
+            file.write(zeros,
+                       layout.normals - layout.faces - faces.size_bytes());
+            file.write(reinterpret_cast<const char *>(normals.data()),
+                       normals.size_bytes());
+        }
+        if (!file) {
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(tmp_name, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmp_name, file_name, error);
+    if (error) {
+        std::filesystem::remove(tmp_name, error);
+        return false;
+    }
+    return true;
+}
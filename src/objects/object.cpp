@@ -1,70 +1,170 @@
+#include <array>
 #include <cmath>
+#include <span>
+#include <string>
+#include <vector>
 
 // From src/include
+#include <accelerators/bvh.hpp>
 #include <hittable.hpp>
 #include <objects/object.hpp>
+#include <objects/triangle_batch.hpp>
+#include <utils/obj_file.hpp>
 #include <utils/vec3.hpp>
+#include <utils/weld.hpp>
 
-std::vector<Triangle> Object::build_triangles_from_file(
-    const std::string & obj_file_name) noexcept {
-    std::ifstream obj_file(obj_file_name);
-
-    if (!obj_file.is_open()) {
-        std::cout << "/!\\ Unable to open " << obj_file_name << " /!\\"
-                  << std::endl;
+std::vector<std::array<Point3, 3>>
+    Object::read_triangles_from_file(const std::string & obj_file_name,
+                                     const WeldInfo & weld,
+                                     WeldStats & weld_stats) {
+    const ObjFile obj_file(obj_file_name);
+    std::vector<Point3> points = obj_file.vertices();
+    std::vector<std::array<uint32_t, 3>> faces;
+    for (size_t f = 0; f < obj_file.face_count(); ++f) {
+        const std::span<const uint32_t> polygon = obj_file.face(f);
+        // creates the triangle fan of the polygon
+        for (size_t i = 2; i < polygon.size(); ++i) {
+            faces.push_back({ polygon[0], polygon[i - 1], polygon[i] });
+        }
+    }
+    if (weld.enabled) {
+        std::vector<Vec3> normals;
+        weld_stats = weld_vertices(points, faces, normals, weld.tolerance);
     }
 
-    std::vector<Triangle> triangles_set;
-    // vector corresponding to the points in the .obj file makema
-    std::vector<Point3> obj_points;
-    // current word in the file
-    std::string word;
-    // positions of the vertices of the triangles
-    int vertices_index[3];
-    // used to split the words to get the vertex index in the obj (see end)
-    int slash_position;
+    std::vector<std::array<Point3, 3>> triangles(faces.size());
+#pragma omp parallel for
+    for (size_t t = 0; t < faces.size(); ++t) {
+        triangles[t] = { points[faces[t][0]], points[faces[t][1]],
+                         points[faces[t][2]] };
+    }
+    return triangles;
+}
 
-    while (obj_file >> word) {
-        // Creates 3d points and corresponding triangles from .obj file
-        if (word == "v") {
-            Point3 point;
-            obj_file >> word;
-            point.x = stod(word);
-            obj_file >> word;
-            point.y = stod(word);
-            obj_file >> word;
-            point.z = stod(word);
-            obj_points.push_back(point);
+void Object::pack_batches(
+    const std::vector<std::array<Point3, 3>> & triangles) {
+    const std::span<const uint32_t> indices = tree.primitive_indices();
+    batches.clear();
+    leaf_batches.assign(indices.size(), 0);
+    for (const BvhNode & node : tree.get_nodes()) {
+        if (node.is_leaf()) {
+            leaf_batches[node.offset] = batches.size();
+            TriangleBatch::pack(indices.subspan(node.offset, node.count),
+                                triangles, batches);
         }
+    }
+}
+
+void Object::build(const std::vector<std::array<Point3, 3>> & triangles,
+                   const std::string & cache_file_name) {
+    triangles_set.clear();
+    triangles_set.reserve(triangles.size());
+    for (const std::array<Point3, 3> & t : triangles) {
+        triangles_set.push_back(Triangle(t[0], t[1], t[2], material));
+    }
 
-        // assuming the polygon is a triangle, creates and adds the triangle to
-        // the list
-        if (word == "f") {
-            for (size_t i = 0; i < 3; ++i) {
-                obj_file >> word;
-                slash_position = word.find('/');
-                vertices_index[i] = stoi(word.substr(0, slash_position));
+    if (cache_file_name.empty()) {
+        tree = BvhTree(triangles, split_info, TriangleBatch::SIZE);
+    } else {
+        const uint64_t key = BvhTree::cache_key(triangles, split_info,
+                                                  TriangleBatch::SIZE);
+        cached = tree.load_cache(cache_file_name, key);
+        if (!cached) {
+            // Missing or stale cache
+            tree = BvhTree(triangles, split_info, TriangleBatch::SIZE);
+            if (!tree.save_cache(cache_file_name, key)) {
+                console::warn("Could not write BVH cache " + cache_file_name);
             }
-            // creates the triangle from the given points and pushes it
-            Triangle triangle(obj_points.data()[vertices_index[0]],
-                              obj_points.data()[vertices_index[1]],
-                              obj_points.data()[vertices_index[2]], material);
-            triangles_set.push_back(triangle);
         }
     }
+    pack_batches(triangles);
+}
+
+bool Object::set_vertices(const std::vector<std::array<Point3, 3>> & triangles,
+                          const double max_cost_growth) {
+    if (triangles.size() != triangles_set.size()) {
+        throw "Could not update object: the number of triangles changed";
+    }
+
+    std::vector<Aabb> boxes(triangles.size());
+    triangles_set.clear();
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        const std::array<Point3, 3> & t = triangles[i];
+        triangles_set.push_back(Triangle(t[0], t[1], t[2], material));
+        triangles_set.back().bounding_box(boxes[i]);
+    }
 
-    obj_file.close();
-    return triangles_set;
+    tree.refit(boxes);
+    const bool rebuilt = tree.cost_growth() > max_cost_growth;
+    if (rebuilt) {
+        tree = BvhTree(triangles, split_info, TriangleBatch::SIZE);
+    }
+    pack_batches(triangles);
+    return rebuilt;
 }
 
 bool Object::hit(const Ray & ray,
                  double tmin,
                  double tmax,
                  HitRecord & hit_record) const noexcept {
-    // Checks every triangle
-    for (const Triangle & triangle : triangles_set) {
-        triangle.hit(ray, tmin, tmax, hit_record);
+    // The leaves are tested a batch of triangles at a time, and the hit
+    // record is only filled for the closest triangle
+    const WatertightRay watertight_ray(ray);
+    uint32_t closest = TriangleBatch::NO_TRIANGLE;
+    double closest_time = tmax;
+    tree.traverse_leaves(
+        ray, tmin, tmax, [&](uint32_t first, uint32_t count, double & t_max) {
+            double time;
+            const uint32_t index = TriangleBatch::intersect(
+                watertight_ray, &batches[leaf_batches[first]],
+                (count + TriangleBatch::SIZE - 1) / TriangleBatch::SIZE, tmin,
+                t_max, time);
+            if (index == TriangleBatch::NO_TRIANGLE) {
+                return false;
+            }
+            closest = index;
+            closest_time = time;
+            t_max = time;
+            return true;
+        });
+    if (closest == TriangleBatch::NO_TRIANGLE) {
+        return false;
     }
+    triangles_set[closest].set_hit_record(ray, closest_time, hit_record);
+    return true;
+}
 
-    return false;
+unsigned Object::hit_packet(const RayPacket & packet,
+                            const unsigned mask,
+                            const double tmin,
+                            double * tmax,
+                            HitRecord * records) const noexcept {
+    return tree.traverse_packet(
+        packet, mask, tmin, tmax, [&](uint32_t index, unsigned lanes) {
+            return triangles_set[index].hit_packet(packet, lanes, tmin, tmax,
+                                                   records);
+        });
+}
+
+bool Object::occluded(const Ray & ray,
+                      const double tmin,
+                      const double tmax) const noexcept {
+    const WatertightRay watertight_ray(ray);
+    return tree.traverse_any_leaves(
+        ray, tmin, tmax, [&](uint32_t first, uint32_t count) {
+            double time;
+            return TriangleBatch::intersect(
+                       watertight_ray, &batches[leaf_batches[first]],
+                       (count + TriangleBatch::SIZE - 1) / TriangleBatch::SIZE,
+                       tmin, tmax, time)
+                   != TriangleBatch::NO_TRIANGLE;
+        });
+}
+
+bool Object::bounding_box(Aabb & output_box) const noexcept {
+    if (triangles_set.empty()) {
+        return false;
+    }
+    output_box = tree.bounds();
+    return true;
 }
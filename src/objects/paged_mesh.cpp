@@ -0,0 +1,682 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <hittable.hpp>
+#include <objects/mesh.hpp>
+#include <objects/paged_mesh.hpp>
+#include <objects/triangle_batch.hpp>
+#include <utils.hpp>
+#include <utils/mapped_file.hpp>
+#include <utils/obj_file.hpp>
+#include <utils/page_cache.hpp>
+#include <utils/ply_file.hpp>
+#include <utils/vec3.hpp>
+
+// Version of the page file format. Must be increased when it changes, to
+// invalidate the existing page files.
+constexpr uint32_t PAGE_FILE_VERSION = 2;
+// Magic number at the start of page files
+constexpr char PAGE_FILE_MAGIC[8] = { 'X', 'T', 'R', 'M',
+                                      'P', 'A', 'G', '\0' };
+// Minimum number of pages in memory per thread, so that a thread always
+// finds a page to evict
+constexpr size_t MIN_PAGES_PER_THREAD = 2;
+// Number of bits of each coordinate of the cells of the grid sorting the
+// triangles in buckets
+constexpr uint32_t BUCKET_GRID_BITS = 6;
+constexpr uint32_t BUCKET_GRID_CELLS = uint32_t(1) << (3 * BUCKET_GRID_BITS);
+// Memory used to build the BVH of a bucket, per triangle: the triangles,
+// their boxes and the arrays of the builder
+constexpr size_t BUILD_MEMORY_PER_TRIANGLE = 256;
+// Minimum number of triangles of a bucket
+constexpr size_t MIN_BUCKET_SIZE = size_t(1) << 16;
+// Number of triangles sorted in buckets at a time
+constexpr size_t SORT_BLOCK_SIZE = size_t(1) << 16;
+// Number of triangles buffered per bucket before they are written
+constexpr size_t BUCKET_BUFFER_SIZE = 256;
+
+// Header of a page file, in its first page. It is followed by the pages, then
+// by the subtrees.
+struct PageFileHeader {
+    // Magic number
+    char magic[8];
+    // Version of the format
+    uint32_t version;
+    // Size of a page
+    uint32_t page_size;
+    // Size of the source file, in bytes
+    uint64_t source_size;
+    // Last modification time of the source file
+    int64_t source_time;
+    // Number of subtrees
+    uint64_t cluster_count;
+    // Number of pages
+    uint64_t page_count;
+    // Number of triangles
+    uint64_t triangle_count;
+    // Size of a node and of a triangle, to reject files written with
+    // another layout
+    uint32_t node_size;
+    uint32_t triangle_size;
+};
+
+static_assert(sizeof(PageFileHeader) == 64);
+static_assert(sizeof(PagedCluster) == 64);
+
+// File removed when it goes out of scope
+struct TemporaryFile {
+    std::string name;
+
+    ~TemporaryFile() noexcept {
+        std::error_code error;
+        std::filesystem::remove(name, error);
+    }
+};
+
+// Number of nodes and triangles of each subtree of a BVH
+static void count_subtree(const std::span<const BvhNode> nodes,
+                          const uint32_t node,
+                          std::vector<uint32_t> & node_counts,
+                          std::vector<uint32_t> & triangle_counts) {
+    if (nodes[node].is_leaf()) {
+        node_counts[node] = 1;
+        triangle_counts[node] = nodes[node].count;
+        return;
+    }
+    const uint32_t first = nodes[node].offset;
+    count_subtree(nodes, first, node_counts, triangle_counts);
+    count_subtree(nodes, first + 1, node_counts, triangle_counts);
+    node_counts[node] = 1 + node_counts[first] + node_counts[first + 1];
+    triangle_counts[node] = triangle_counts[first] + triangle_counts[first + 1];
+}
+
+// Roots of the largest subtrees fitting in a page, in depth-first order, so
+// that neighbouring subtrees share pages
+static void cut_subtrees(const std::span<const BvhNode> nodes,
+                         const uint32_t node,
+                         const std::vector<uint32_t> & node_counts,
+                         const std::vector<uint32_t> & triangle_counts,
+                         std::vector<uint32_t> & roots) {
+    const size_t size = node_counts[node] * sizeof(BvhNode)
+                        + triangle_counts[node] * sizeof(PagedMesh::Triangle);
+    if (size <= PagedMesh::PAGE_SIZE || nodes[node].is_leaf()) {
+        roots.push_back(node);
+        return;
+    }
+    const uint32_t first = nodes[node].offset;
+    cut_subtrees(nodes, first, node_counts, triangle_counts, roots);
+    cut_subtrees(nodes, first + 1, node_counts, triangle_counts, roots);
+}
+
+// Copy a subtree of a BVH over a set of triangles, the node `node` becoming
+// the node `copy` of the subtree. Its triangles are appended in the order of
+// its leaves.
+static void copy_subtree(const BvhTree & tree,
+                         const std::span<const PagedMesh::Triangle> triangles,
+                         const uint32_t node,
+                         const uint32_t copy,
+                         std::vector<BvhNode> & subtree_nodes,
+                         std::vector<PagedMesh::Triangle> & subtree_triangles) {
+    const BvhNode & source = tree.get_nodes()[node];
+    subtree_nodes[copy] = source;
+    if (source.is_leaf()) {
+        subtree_nodes[copy].offset = subtree_triangles.size();
+        for (uint32_t i = source.offset; i < source.offset + source.count;
+             ++i) {
+            subtree_triangles.push_back(
+                triangles[tree.primitive_indices()[i]]);
+        }
+        return;
+    }
+    // The children are stored next to each other, after their parent
+    const uint32_t children = subtree_nodes.size();
+    subtree_nodes.resize(children + 2);
+    subtree_nodes[copy].offset = children;
+    copy_subtree(tree, triangles, source.offset, children, subtree_nodes,
+                 subtree_triangles);
+    copy_subtree(tree, triangles, source.offset + 1, children + 1,
+                 subtree_nodes, subtree_triangles);
+}
+
+// Pages of a page file being written. The subtrees are packed in pages in
+// the order they are added, and the full pages are written out.
+class PageWriter {
+private:
+    std::ofstream & file;
+    // Page being filled
+    std::vector<std::byte> page;
+    // Bytes of the page in use
+    size_t used = 0;
+    // Number of pages written
+    size_t written = 0;
+    // Subtrees added
+    std::vector<PagedCluster> clusters;
+
+    // Write the page being filled, and start the next one
+    void write_page() {
+        file.write(reinterpret_cast<const char *>(page.data()), page.size());
+        std::fill(page.begin(), page.end(), std::byte(0));
+        used = 0;
+        ++written;
+    }
+
+public:
+    explicit PageWriter(std::ofstream & file)
+        : file(file), page(PagedMesh::PAGE_SIZE) {}
+
+    // Add a subtree, starting a new page if it does not fit in the current
+    // one. Throws if it is larger than a page.
+    void add(const std::span<const BvhNode> nodes,
+             const std::span<const PagedMesh::Triangle> triangles) {
+        const size_t nodes_size = nodes.size() * sizeof(BvhNode);
+        const size_t size = nodes_size + triangles.size_bytes();
+        if (size > PagedMesh::PAGE_SIZE) {
+            // Only leaves of triangles which could not be split can be
+            throw std::string("Could not write pages: leaf larger than a "
+                              "page");
+        }
+        if (used + size > PagedMesh::PAGE_SIZE) {
+            write_page();
+        }
+        std::memcpy(page.data() + used, nodes.data(), nodes_size);
+        std::memcpy(page.data() + used + nodes_size, triangles.data(),
+                    triangles.size_bytes());
+        clusters.push_back(PagedCluster { nodes[0].box, uint32_t(written),
+                                          uint32_t(used),
+                                          uint32_t(nodes.size()),
+                                          uint32_t(triangles.size()) });
+        used += size;
+    }
+
+    // Write the last page, if it holds subtrees
+    void finish() {
+        if (used > 0) {
+            write_page();
+        }
+    }
+
+    // Number of pages written
+    inline size_t page_count() const noexcept { return written; }
+
+    // Subtrees added, in order
+    inline const std::vector<PagedCluster> & get_clusters() const noexcept {
+        return clusters;
+    }
+};
+
+// Stream the vertices and the triangles of a .obj or .ply file to two files.
+// Returns the number of triangles, or throws if a file could not be written.
+static size_t stream_source(const std::string & source_file_name,
+                            const std::string & vertex_file_name,
+                            const std::string & face_file_name) {
+    std::ofstream vertex_file(vertex_file_name, std::ios_base::out
+                                                    | std::ios_base::binary
+                                                    | std::ios_base::trunc);
+    std::ofstream face_file(face_file_name, std::ios_base::out
+                                                | std::ios_base::binary
+                                                | std::ios_base::trunc);
+    size_t triangle_count = 0;
+    const auto write_vertices = [&](const std::span<const Point3> block) {
+        vertex_file.write(reinterpret_cast<const char *>(block.data()),
+                          block.size_bytes());
+    };
+    const auto write_triangles = [&](const std::span<const Mesh::Face> block) {
+        face_file.write(reinterpret_cast<const char *>(block.data()),
+                        block.size_bytes());
+        triangle_count += block.size();
+    };
+    if (vertex_file && face_file) {
+        if (Mesh::is_ply_file(source_file_name)) {
+            PlyFile(source_file_name).stream(write_vertices, write_triangles);
+        } else {
+            ObjFile::stream(source_file_name, write_vertices, write_triangles);
+        }
+    }
+    vertex_file.close();
+    face_file.close();
+    if (!vertex_file || !face_file) {
+        throw "Could not write the geometry of " + source_file_name;
+    }
+    return triangle_count;
+}
+
+// Cell of the bucket grid over `bounds` holding the centroid of a triangle,
+// as a Morton code, so that neighbouring cells have close codes
+static uint32_t bucket_cell(const PagedMesh::Triangle & triangle,
+                            const Aabb & bounds) noexcept {
+    const Point3 centroid = (triangle[0] + triangle[1] + triangle[2]) / 3.0;
+    const Vec3 extent = bounds.diagonal();
+    constexpr double resolution = double(1 << BUCKET_GRID_BITS);
+    uint32_t code = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        // Flat extents give the first cell
+        const double x =
+            extent[axis] > 0.0
+                ? (centroid[axis] - bounds.min[axis]) / extent[axis]
+                      * resolution
+                : 0.0;
+        const uint32_t cell =
+            x > 0.0 ? uint32_t(std::min(x, resolution - 1.0)) : 0;
+        for (uint32_t bit = 0; bit < BUCKET_GRID_BITS; ++bit) {
+            code |= ((cell >> bit) & 1) << (3 * bit + axis);
+        }
+    }
+    return code;
+}
+
+// Sort the triangles in buckets of neighbouring cells of at most
+// `bucket_size` triangles, unless a cell holds more, and write them to a file
+// bucket after bucket. Returns the first triangle of each bucket, followed by
+// the number of triangles. Throws if a file could not be written.
+static std::vector<size_t>
+    sort_triangles(const std::span<const Point3> vertices,
+                   const std::span<const Mesh::Face> faces,
+                   const size_t bucket_size,
+                   const std::string & cell_file_name,
+                   const std::string & file_name) {
+    const auto triangle = [&](const size_t f) {
+        return PagedMesh::Triangle { vertices[faces[f][0]],
+                                     vertices[faces[f][1]],
+                                     vertices[faces[f][2]] };
+    };
+    Aabb bounds;
+    for (const Point3 & vertex : vertices) {
+        bounds.extend(vertex);
+    }
+
+    // The cells are computed once and kept in a file, so that the triangles
+    // are written in the same cells as they are counted
+    std::vector<size_t> cell_counts(BUCKET_GRID_CELLS, 0);
+    {
+        std::ofstream cell_file(cell_file_name, std::ios_base::out
+                                                    | std::ios_base::binary
+                                                    | std::ios_base::trunc);
+        std::vector<uint32_t> cells(SORT_BLOCK_SIZE);
+        for (size_t first = 0; first < faces.size() && cell_file;
+             first += SORT_BLOCK_SIZE) {
+            const size_t count =
+                std::min(SORT_BLOCK_SIZE, faces.size() - first);
+#pragma omp parallel for
+            for (size_t i = 0; i < count; ++i) {
+                cells[i] = bucket_cell(triangle(first + i), bounds);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                ++cell_counts[cells[i]];
+            }
+            cell_file.write(reinterpret_cast<const char *>(cells.data()),
+                            count * sizeof(uint32_t));
+        }
+        cell_file.close();
+        if (!cell_file) {
+            throw "Could not write " + cell_file_name;
+        }
+    }
+
+    // Buckets of consecutive cells
+    std::vector<uint32_t> cell_buckets(BUCKET_GRID_CELLS);
+    std::vector<size_t> bucket_starts(1, 0);
+    size_t bucket_end = 0;
+    for (uint32_t cell = 0; cell < BUCKET_GRID_CELLS; ++cell) {
+        if (bucket_end > bucket_starts.back()
+            && bucket_end - bucket_starts.back() + cell_counts[cell]
+                   > bucket_size) {
+            bucket_starts.push_back(bucket_end);
+        }
+        cell_buckets[cell] = bucket_starts.size() - 1;
+        bucket_end += cell_counts[cell];
+    }
+    bucket_starts.push_back(bucket_end);
+
+    // Triangles are buffered per bucket, and written at the end of their
+    // bucket
+    const size_t bucket_count = bucket_starts.size() - 1;
+    const MappedFile cell_file(cell_file_name);
+    const std::span<const uint32_t> cells(
+        reinterpret_cast<const uint32_t *>(cell_file.data()), faces.size());
+    std::ofstream file(file_name, std::ios_base::out | std::ios_base::binary
+                                      | std::ios_base::trunc);
+    std::vector<size_t> bucket_ends(bucket_starts.begin(),
+                                    bucket_starts.end() - 1);
+    std::vector<std::vector<PagedMesh::Triangle>> buffers(bucket_count);
+    const auto write_buffer = [&](const size_t bucket) {
+        std::vector<PagedMesh::Triangle> & buffer = buffers[bucket];
+        file.seekp(bucket_ends[bucket] * sizeof(PagedMesh::Triangle));
+        file.write(reinterpret_cast<const char *>(buffer.data()),
+                   buffer.size() * sizeof(PagedMesh::Triangle));
+        bucket_ends[bucket] += buffer.size();
+        buffer.clear();
+    };
+    for (size_t f = 0; f < faces.size(); ++f) {
+        const uint32_t bucket = cell_buckets[cells[f]];
+        buffers[bucket].push_back(triangle(f));
+        if (buffers[bucket].size() == BUCKET_BUFFER_SIZE) {
+            write_buffer(bucket);
+        }
+    }
+    for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+        write_buffer(bucket);
+    }
+    file.close();
+    if (!file) {
+        throw "Could not write " + file_name;
+    }
+    return bucket_starts;
+}
+
+// Build the BVH of a bucket of triangles, cut it in subtrees and add them to
+// the pages
+static void write_bucket(const std::span<const PagedMesh::Triangle> triangles,
+                         PageWriter & writer) {
+    if (triangles.empty()) {
+        return;
+    }
+    std::vector<Aabb> boxes(triangles.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        boxes[i] = Aabb::from_point(triangles[i][0]);
+        boxes[i].extend(triangles[i][1]);
+        boxes[i].extend(triangles[i][2]);
+    }
+    // The triangles of the pages are tested one at a time
+    const BvhTree tree(boxes);
+    std::vector<Aabb>().swap(boxes);
+
+    const std::span<const BvhNode> nodes = tree.get_nodes();
+    std::vector<uint32_t> node_counts(nodes.size());
+    std::vector<uint32_t> triangle_counts(nodes.size());
+    std::vector<uint32_t> roots;
+    count_subtree(nodes, 0, node_counts, triangle_counts);
+    cut_subtrees(nodes, 0, node_counts, triangle_counts, roots);
+
+    std::vector<BvhNode> subtree_nodes;
+    std::vector<PagedMesh::Triangle> subtree_triangles;
+    for (const uint32_t root : roots) {
+        subtree_nodes.assign(1, BvhNode());
+        subtree_triangles.clear();
+        copy_subtree(tree, triangles, root, 0, subtree_nodes,
+                     subtree_triangles);
+        writer.add(subtree_nodes, subtree_triangles);
+    }
+}
+
+bool PagedMesh::write_pages(const std::string & source_file_name,
+                            const std::string & file_name,
+                            const uint64_t source_size,
+                            const int64_t source_time,
+                            const size_t memory_budget) {
+    // Temporary files are named after the time, so that concurrent jobs
+    // never share them, and never read a partial page file
+    const std::string tmp_name =
+        file_name + "."
+        + std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count());
+    const TemporaryFile vertex_file { tmp_name + ".vertices.tmp" };
+    const TemporaryFile face_file { tmp_name + ".faces.tmp" };
+    const TemporaryFile cell_file { tmp_name + ".cells.tmp" };
+    const TemporaryFile triangle_file { tmp_name + ".triangles.tmp" };
+    const TemporaryFile page_file { tmp_name + ".tmp" };
+
+    // The geometry is streamed to files and mapped: the system keeps in
+    // memory what fits
+    const size_t triangle_count =
+        stream_source(source_file_name, vertex_file.name, face_file.name);
+    std::vector<size_t> bucket_starts;
+    {
+        const MappedFile vertex_map(vertex_file.name);
+        const MappedFile face_map(face_file.name);
+        const std::span<const Point3> vertices(
+            reinterpret_cast<const Point3 *>(vertex_map.data()),
+            vertex_map.size() / sizeof(Point3));
+        const std::span<const Mesh::Face> faces(
+            reinterpret_cast<const Mesh::Face *>(face_map.data()),
+            triangle_count);
+        // The BVH of a bucket is built in memory
+        const size_t bucket_size = std::max(
+            MIN_BUCKET_SIZE, memory_budget / BUILD_MEMORY_PER_TRIANGLE);
+        bucket_starts = sort_triangles(vertices, faces, bucket_size,
+                                       cell_file.name, triangle_file.name);
+    }
+
+    std::ofstream file(page_file.name, std::ios_base::out
+                                           | std::ios_base::binary
+                                           | std::ios_base::trunc);
+    if (!file) {
+        return false;
+    }
+    // The header is written last, in the first page
+    const std::vector<char> header_page(PAGE_SIZE, 0);
+    file.write(header_page.data(), header_page.size());
+    PageWriter writer(file);
+    {
+        const MappedFile triangle_map(triangle_file.name);
+        const std::span<const Triangle> triangles(
+            reinterpret_cast<const Triangle *>(triangle_map.data()),
+            triangle_count);
+        for (size_t b = 0; b + 1 < bucket_starts.size(); ++b) {
+            write_bucket(triangles.subspan(bucket_starts[b],
+                                           bucket_starts[b + 1]
+                                               - bucket_starts[b]),
+                         writer);
+        }
+    }
+    writer.finish();
+    const std::vector<PagedCluster> & clusters = writer.get_clusters();
+    file.write(reinterpret_cast<const char *>(clusters.data()),
+               clusters.size() * sizeof(PagedCluster));
+
+    PageFileHeader header {};
+    std::memcpy(header.magic, PAGE_FILE_MAGIC, sizeof(header.magic));
+    header.version = PAGE_FILE_VERSION;
+    header.page_size = PAGE_SIZE;
+    header.source_size = source_size;
+    header.source_time = source_time;
+    header.cluster_count = clusters.size();
+    header.page_count = writer.page_count();
+    header.triangle_count = triangle_count;
+    header.node_size = sizeof(BvhNode);
+    header.triangle_size = sizeof(Triangle);
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.close();
+    if (!file) {
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(page_file.name, file_name, error);
+    return !error;
+}
+
+bool PagedMesh::open_pages(const std::string & file_name,
+                           const uint64_t source_size,
+                           const int64_t source_time,
+                           const size_t memory_budget) {
+    std::ifstream file(file_name, std::ios_base::in | std::ios_base::binary);
+    PageFileHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        return false;
+    }
+    std::error_code error;
+    const size_t file_size = std::filesystem::file_size(file_name, error);
+    if (error
+        || std::memcmp(header.magic, PAGE_FILE_MAGIC, sizeof(header.magic))
+               != 0
+        || header.version != PAGE_FILE_VERSION
+        || header.page_size != PAGE_SIZE || header.source_size != source_size
+        || header.source_time != source_time
+        || header.node_size != sizeof(BvhNode)
+        || header.triangle_size != sizeof(Triangle)
+        || header.page_count >= file_size / PAGE_SIZE
+        || header.cluster_count > file_size / sizeof(PagedCluster)
+        || file_size
+               != (1 + header.page_count) * PAGE_SIZE
+                      + header.cluster_count * sizeof(PagedCluster)) {
+        return false;
+    }
+
+    // Only the subtrees are read, the pages are read on demand
+    clusters.resize(header.cluster_count);
+    file.seekg((1 + header.page_count) * PAGE_SIZE);
+    if (!file.read(reinterpret_cast<char *>(clusters.data()),
+                   clusters.size() * sizeof(PagedCluster))) {
+        return false;
+    }
+    for (const PagedCluster & cluster : clusters) {
+        if (cluster.page >= header.page_count || cluster.node_count == 0
+            || cluster.offset + size_t(cluster.node_count) * sizeof(BvhNode)
+                       + size_t(cluster.triangle_count) * sizeof(Triangle)
+                   > PAGE_SIZE) {
+            return false;
+        }
+    }
+    triangle_count = header.triangle_count;
+
+    std::vector<Aabb> boxes(clusters.size());
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        boxes[c] = clusters[c].box;
+    }
+    tree = BvhTree(boxes);
+
+    // Each thread keeps a page in use while it traverses a subtree
+    const size_t slot_count =
+        std::max(memory_budget / PAGE_SIZE,
+                 MIN_PAGES_PER_THREAD * omp_get_max_threads());
+    pages = std::make_unique<PageCache>(file_name, PAGE_SIZE, PAGE_SIZE,
+                                        header.page_count, slot_count);
+    return true;
+}
+
+void PagedMesh::load(const std::string & file_name,
+                     const size_t memory_budget) {
+    const std::string pages_file_name = file_name + ".mesh.pages";
+    // The page file is checked against the source file only, so that the
+    // mesh is never read when it is valid
+    uint64_t source_size;
+    int64_t source_time;
+    if (!file_stamp(file_name, source_size, source_time)) {
+        throw "Could not load " + file_name + ": could not open the file";
+    }
+    if (open_pages(pages_file_name, source_size, source_time,
+                   memory_budget)) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    if (!write_pages(file_name, pages_file_name, source_size, source_time,
+                     memory_budget)
+        || !open_pages(pages_file_name, source_size, source_time,
+                       memory_budget)) {
+        throw "Could not write the pages of " + file_name;
+    }
+    console::log("Wrote " + pages_file_name + " in "
+                 + std::to_string(std::chrono::duration<double, std::milli>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count())
+                 + "ms");
+}
+
+bool PagedMesh::hit(const Ray & ray,
+                    const double tmin,
+                    const double tmax,
+                    HitRecord & hit_record) const noexcept {
+    const WatertightRay watertight_ray(ray);
+    Vec3 closest_normal;
+    double closest_time = tmax;
+    const bool hit = tree.traverse(
+        ray, tmin, tmax, [&](uint32_t index, double & t_max) {
+            const PagedCluster & cluster = clusters[index];
+            const std::byte * const page = pages->acquire(cluster.page);
+            if (page == nullptr) {
+                // The cache failed for good, which fails the render
+                return false;
+            }
+            const BvhNode * const nodes =
+                reinterpret_cast<const BvhNode *>(page + cluster.offset);
+            const Triangle * const triangles =
+                reinterpret_cast<const Triangle *>(nodes + cluster.node_count);
+            const bool hit_cluster = BvhTree::traverse_leaves(
+                std::span<const BvhNode>(nodes, cluster.node_count), ray, tmin,
+                t_max, [&](uint32_t first, uint32_t count, double & leaf_tmax) {
+                    bool hit_leaf = false;
+                    for (uint32_t i = first; i < first + count; ++i) {
+                        const Triangle & t = triangles[i];
+                        double time;
+                        if (watertight_ray.intersect(t[0], t[1], t[2], tmin,
+                                                     leaf_tmax, time)) {
+                            leaf_tmax = time;
+                            closest_time = time;
+                            closest_normal = (t[1] - t[0]).cross(t[2] - t[0]);
+                            hit_leaf = true;
+                        }
+                    }
+                    return hit_leaf;
+                });
+            pages->release(cluster.page);
+            if (hit_cluster) {
+                t_max = closest_time;
+            }
+            return hit_cluster;
+        });
+    if (!hit) {
+        return false;
+    }
+
+    hit_record.time = closest_time;
+    hit_record.hit_point = ray.at(closest_time);
+    hit_record.set_face_normal(ray, closest_normal.unit_vector());
+    hit_record.material = material;
+    return true;
+}
+
+bool PagedMesh::occluded(const Ray & ray,
+                         const double tmin,
+                         const double tmax) const noexcept {
+    const WatertightRay watertight_ray(ray);
+    return tree.traverse_any(ray, tmin, tmax, [&](uint32_t index) {
+        const PagedCluster & cluster = clusters[index];
+        const std::byte * const page = pages->acquire(cluster.page);
+        if (page == nullptr) {
+            // The cache failed for good, which fails the render
+            return false;
+        }
+        const BvhNode * const nodes =
+            reinterpret_cast<const BvhNode *>(page + cluster.offset);
+        const Triangle * const triangles =
+            reinterpret_cast<const Triangle *>(nodes + cluster.node_count);
+        const bool occluded = BvhTree::traverse_any_leaves(
+            std::span<const BvhNode>(nodes, cluster.node_count), ray, tmin,
+            tmax, [&](uint32_t first, uint32_t count) {
+                for (uint32_t i = first; i < first + count; ++i) {
+                    const Triangle & t = triangles[i];
+                    double time;
+                    if (watertight_ray.intersect(t[0], t[1], t[2], tmin, tmax,
+                                                 time)) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+        pages->release(cluster.page);
+        return occluded;
+    });
+}
+
+bool PagedMesh::bounding_box(Aabb & output_box) const noexcept {
+    if (clusters.empty()) {
+        return false;
+    }
+    output_box = tree.bounds();
+    return true;
+}
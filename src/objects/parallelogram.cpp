@@ -1,14 +1,17 @@
+#include <algorithm>
+#include <bit>
 #include <cmath>
 
 // From src/include
 #include <hittable.hpp>
 #include <objects/parallelogram.hpp>
+#include <ray_packet.hpp>
 #include <utils/vec3.hpp>
 
-bool Parallelogram::hit(const Ray & ray,
-                        const double tmin,
-                        const double tmax,
-                        HitRecord & hit_record) const noexcept {
+bool Parallelogram::intersect(const Ray & ray,
+                              const double tmin,
+                              const double tmax,
+                              double & time) const noexcept {
     // Test if the ray's direction is colinear to the parallelogram
     const double determinant = ray.direction.dot(normal);
     if (fabs(determinant) < utils::EPSILON) {
@@ -18,7 +21,7 @@ bool Parallelogram::hit(const Ray & ray,
     const Point3 origin_to_vertex = vertex - ray.origin;
 
     // Finding the time of intersection
-    const double time = scale * origin_to_vertex.dot(normal);
+    time = scale * origin_to_vertex.dot(normal);
     if (time < tmin || tmax < time) {
         return false;
     }
@@ -38,31 +41,186 @@ bool Parallelogram::hit(const Ray & ray,
         return false;
     }
 
+    return true;
+}
+
+void Parallelogram::set_hit_record(const Ray & ray,
+                                   const double time,
+                                   HitRecord & hit_record) const noexcept {
     hit_record.time = time;
     hit_record.hit_point = ray.at(time);
     Vec3 outward_normal = unit_normal;
     hit_record.set_face_normal(ray, outward_normal);
     hit_record.material = material;
+}
+
+bool Parallelogram::hit(const Ray & ray,
+                        const double tmin,
+                        const double tmax,
+                        HitRecord & hit_record) const noexcept {
+    double time;
+    if (!intersect(ray, tmin, tmax, time)) {
+        return false;
+    }
+    set_hit_record(ray, time, hit_record);
     return true;
 }
 
+unsigned Parallelogram::hit_packet(const RayPacket & packet,
+                                   const unsigned mask,
+                                   const double tmin,
+                                   double * tmax,
+                                   HitRecord * records) const noexcept {
+#ifdef __AVX2__
+    __m256d time, u, v;
+    const unsigned in_plane = planar_intersect4(
+        packet, vertex, edge1, edge2, normal, tmin, tmax, time, u, v);
+
+    // Barycentric coordinates test, as in intersect
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d inside = _mm256_and_pd(
+        _mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_GE_OQ),
+                      _mm256_cmp_pd(u, one, _CMP_LE_OQ)),
+        _mm256_and_pd(_mm256_cmp_pd(v, zero, _CMP_GE_OQ),
+                      _mm256_cmp_pd(v, one, _CMP_LE_OQ)));
+    const unsigned hit = in_plane & _mm256_movemask_pd(inside) & mask;
+
+    alignas(32) double times[PACKET_SIZE];
+    _mm256_store_pd(times, time);
+    for (unsigned m = hit; m; m &= m - 1) {
+        const unsigned l = std::countr_zero(m);
+        set_hit_record(packet.rays[l], times[l], records[l]);
+        tmax[l] = times[l];
+    }
+    return hit;
+#else
+    return Hittable::hit_packet(packet, mask, tmin, tmax, records);
+#endif
+}
+
+bool Parallelogram::occluded(const Ray & ray,
+                             const double tmin,
+                             const double tmax) const noexcept {
+    double time;
+    return intersect(ray, tmin, tmax, time);
+}
+
+// Rectangle seen from a point, as a spherical rectangle (Urena, Fajardo and
+// King, 2013). The rectangle is expressed in a frame centred on the point,
+// whose x and y axes follow its edges and where it lies in the plane z = z0.
+struct SphericalRectangle {
+    // Axes of the local frame
+    Vec3 ex, ey, ez;
+    // Bounds of the rectangle in the local frame
+    double x0, y0, x1, y1, z0;
+    // Constants of the sampling, from the angles of the spherical rectangle
+    double b0, b1, k;
+    // Solid angle of the rectangle
+    double solid_angle;
+
+    SphericalRectangle(const Point3 & origin,
+                       const Point3 & corner,
+                       const Vec3 & edge1,
+                       const Vec3 & edge2) noexcept {
+        const double width = edge1.norm();
+        const double height = edge2.norm();
+        ex = edge1 / width;
+        ey = edge2 / height;
+        ez = ex.cross(ey);
+        const Vec3 d = corner - origin;
+        x0 = d.dot(ex);
+        y0 = d.dot(ey);
+        z0 = d.dot(ez);
+        // The rectangle is seen from the negative side
+        if (z0 > 0.0) {
+            z0 = -z0;
+            ez = -ez;
+        }
+        x1 = x0 + width;
+        y1 = y0 + height;
+
+        // Normals of the planes through the origin and each edge
+        const Vec3 n0 = Vec3(0.0, z0, -y0) / sqrt(z0 * z0 + y0 * y0);
+        const Vec3 n1 = Vec3(-z0, 0.0, x1) / sqrt(z0 * z0 + x1 * x1);
+        const Vec3 n2 = Vec3(0.0, -z0, y1) / sqrt(z0 * z0 + y1 * y1);
+        const Vec3 n3 = Vec3(z0, 0.0, -x0) / sqrt(z0 * z0 + x0 * x0);
+        // Interior angles of the spherical rectangle
+        const double g0 = acos(std::clamp(-n0.dot(n1), -1.0, 1.0));
+        const double g1 = acos(std::clamp(-n1.dot(n2), -1.0, 1.0));
+        const double g2 = acos(std::clamp(-n2.dot(n3), -1.0, 1.0));
+        const double g3 = acos(std::clamp(-n3.dot(n0), -1.0, 1.0));
+        b0 = n0.z;
+        b1 = n2.z;
+        k = utils::TAU - g2 - g3;
+        solid_angle = g0 + g1 - k;
+    }
+
+    // Point of the rectangle for uniform numbers u and v, the directions to
+    // the points being uniform in the solid angle
+    Point3 sample(const Point3 & origin,
+                  const double u,
+                  const double v) const noexcept {
+        // Choose the x coordinate, by the solid angle on its left
+        const double au = u * solid_angle + k;
+        const double fu = (cos(au) * b0 - b1) / sin(au);
+        const double cu = std::clamp(
+            std::copysign(1.0, fu) / sqrt(fu * fu + b0 * b0), -1.0, 1.0);
+        const double xu = std::clamp(
+            -cu * z0 / sqrt(std::max(1e-300, 1.0 - cu * cu)), x0, x1);
+
+        // Then the y coordinate, uniformly along the arc
+        const double d = sqrt(xu * xu + z0 * z0);
+        const double h0 = y0 / sqrt(d * d + y0 * y0);
+        const double h1 = y1 / sqrt(d * d + y1 * y1);
+        const double hv = h0 + v * (h1 - h0);
+        const double yv = hv * hv < 1.0 - utils::EPSILON
+                              ? hv * d / sqrt(1.0 - hv * hv)
+                              : y1;
+        return origin + xu * ex + yv * ey + z0 * ez;
+    }
+};
+
 double Parallelogram::pdf_value(const Point3 & origin,
                                 const Vec3 & direction) const noexcept {
-    HitRecord rec;
-    if (!this->hit(Ray(origin, direction), utils::EPSILON, utils::INF, rec)) {
+    double time;
+    if (!intersect(Ray(origin, direction), utils::EPSILON, utils::INF, time)) {
         return 0.0;
     }
 
+    if (rectangular) {
+        const SphericalRectangle rectangle(origin, vertex, edge1, edge2);
+        if (utils::samples_solid_angle(rectangle.solid_angle)) {
+            return 1.0 / rectangle.solid_angle;
+        }
+    }
+
+    // Convert the uniform density on the area to a solid angle density
     const double area = normal.dot(unit_normal);
-    const double distance_squared =
-        rec.time * rec.time * direction.squared_norm();
+    const double squared_norm = direction.squared_norm();
+    const double distance_squared = time * time * squared_norm;
     const double cosine =
-        fabs(direction.dot(rec.surface_normal) / direction.norm());
+        fabs(direction.dot(unit_normal)) / sqrt(squared_norm);
 
     return distance_squared / (cosine * area);
 }
 
 Vec3 Parallelogram::random(const Point3 & origin) const noexcept {
-    return (vertex + rng::gen() * edge1 + rng::gen() * edge2 - origin)
-        .unit_vector();
+    const double u = rng::gen();
+    const double v = rng::gen();
+    if (rectangular) {
+        const SphericalRectangle rectangle(origin, vertex, edge1, edge2);
+        if (utils::samples_solid_angle(rectangle.solid_angle)) {
+            return (rectangle.sample(origin, u, v) - origin).unit_vector();
+        }
+    }
+    return (vertex + u * edge1 + v * edge2 - origin).unit_vector();
+}
+
+bool Parallelogram::bounding_box(Aabb & output_box) const noexcept {
+    output_box = Aabb::from_point(vertex);
+    output_box.extend(vertex + edge1);
+    output_box.extend(vertex + edge2);
+    output_box.extend(vertex + edge1 + edge2);
+    return true;
 }
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <span>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <accelerators/bvh.hpp>
+#include <hittable.hpp>
+#include <objects/quad_mesh.hpp>
+#include <utils/obj_file.hpp>
+#include <utils/vec3.hpp>
+
+// Quads whose vertices are further from their plane, relative to the length
+// of their diagonals, are intersected as bilinear patches
+constexpr double PLANARITY_TOLERANCE = 1e-5;
+
+void QuadMesh::read_quads_from_file(const std::string & obj_file_name,
+                                    std::vector<Point3> & vertices,
+                                    std::vector<Quad> & quads) {
+    const ObjFile obj_file(obj_file_name);
+    vertices = obj_file.vertices();
+    for (size_t f = 0; f < obj_file.face_count(); ++f) {
+        const std::span<const uint32_t> polygon = obj_file.face(f);
+        // Fan of quads, ending with a triangle for an odd number of vertices
+        for (size_t i = 1; i + 1 < polygon.size(); i += 2) {
+            const size_t last = std::min(i + 2, polygon.size() - 1);
+            quads.push_back(
+                { polygon[0], polygon[i], polygon[i + 1], polygon[last] });
+        }
+    }
+}
+
+void QuadMesh::build() {
+    std::vector<Aabb> boxes(quads.size());
+    planar.resize(quads.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < quads.size(); ++i) {
+        const Point3 v[4] = { vertices[quads[i][0]], vertices[quads[i][1]],
+                              vertices[quads[i][2]], vertices[quads[i][3]] };
+        boxes[i] = Aabb::from_point(v[0]);
+        for (int k = 1; k < 4; ++k) {
+            boxes[i].extend(v[k]);
+        }
+
+        // The normal of the diagonals is orthogonal to both of them, so the
+        // quad is planar when its first edge is
+        const Vec3 diagonal1 = v[2] - v[0];
+        const Vec3 diagonal2 = v[3] - v[1];
+        const Vec3 normal = diagonal1.cross(diagonal2);
+        const double normal_norm = normal.norm();
+        if (normal_norm == 0.0) {
+            // Degenerate quad, never hit
+            planar[i] = true;
+            continue;
+        }
+        const double deviation = fabs((v[1] - v[0]).dot(normal)) / normal_norm;
+        bool is_planar =
+            deviation <= PLANARITY_TOLERANCE
+                             * std::max(diagonal1.norm(), diagonal2.norm());
+        for (int k = 0; k < 4 && is_planar; ++k) {
+            const Vec3 edge = v[(k + 1) % 4] - v[k];
+            const Vec3 next_edge = v[(k + 2) % 4] - v[(k + 1) % 4];
+            is_planar = edge.cross(next_edge).dot(normal) >= 0.0;
+        }
+        planar[i] = is_planar;
+    }
+    tree = BvhTree(boxes);
+}
+
+size_t QuadMesh::bilinear_count() const noexcept {
+    return std::count(planar.begin(), planar.end(), uint8_t(0));
+}
+
+bool QuadMesh::intersect_planar(const Quad & quad,
+                                const Ray & ray,
+                                const double tmin,
+                                const double tmax,
+                                double & time,
+                                Vec3 & normal) const noexcept {
+    const Point3 v[4] = { vertices[quad[0]], vertices[quad[1]],
+                          vertices[quad[2]], vertices[quad[3]] };
+    normal = (v[2] - v[0]).cross(v[3] - v[1]);
+
+    // Test if the ray's direction is colinear to the quad
+    const double determinant = ray.direction.dot(normal);
+    if (fabs(determinant) < utils::EPSILON) {
+        return false;
+    }
+    time = (v[0] - ray.origin).dot(normal) / determinant;
+    if (time < tmin || tmax < time) {
+        return false;
+    }
+
+    // The hit point must be on the inner side of the four edges
+    const Point3 point = ray.at(time);
+    for (int k = 0; k < 4; ++k) {
+        const Vec3 edge = v[(k + 1) % 4] - v[k];
+        if (edge.cross(point - v[k]).dot(normal) < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QuadMesh::intersect_bilinear(const Quad & quad,
+                                  const Ray & ray,
+                                  const double tmin,
+                                  const double tmax,
+                                  double & time,
+                                  Vec3 & normal) const noexcept {
+    // Patch P(u, v) = lerp(lerp(q00, q10, u), lerp(q01, q11, u), v), relative
+    // to the origin of the ray
+    const Vec3 q00 = vertices[quad[0]] - ray.origin;
+    const Vec3 q10 = vertices[quad[1]] - ray.origin;
+    const Vec3 q11 = vertices[quad[2]] - ray.origin;
+    const Vec3 q01 = vertices[quad[3]] - ray.origin;
+    const Vec3 & d = ray.direction;
+    const Vec3 e10 = q10 - q00;
+    const Vec3 e00 = q01 - q00;
+    const Vec3 e11 = q11 - q10;
+
+    // The ray crosses the segment of parameter u, from lerp(q00, q10, u) along
+    // lerp(e00, e11, u), when both are coplanar with the direction: quadratic
+    // equation in u
+    const double c0 = q00.cross(e00).dot(d);
+    const double c1 = (q00.cross(e11 - e00) + e10.cross(e00)).dot(d);
+    const double c2 = e10.cross(e11 - e00).dot(d);
+    double roots[2];
+    int root_count = 0;
+    if (fabs(c2) <= utils::EPSILON * fabs(c1)) {
+        // Trapezoid, the equation is linear
+        if (c1 != 0.0) {
+            roots[root_count++] = -c0 / c1;
+        }
+    } else {
+        const double delta = c1 * c1 - 4.0 * c2 * c0;
+        if (delta < 0.0) {
+            return false;
+        }
+        const double q = -0.5 * (c1 + std::copysign(sqrt(delta), c1));
+        roots[root_count++] = q / c2;
+        if (q != 0.0) {
+            roots[root_count++] = c0 / q;
+        }
+    }
+
+    bool hit = false;
+    time = tmax;
+    for (int r = 0; r < root_count; ++r) {
+        const double u = roots[r];
+        if (u < 0.0 || u > 1.0) {
+            continue;
+        }
+        // Closest points of the ray and of the segment
+        const Vec3 pa = q00 + u * e10;
+        const Vec3 pb = e00 + u * (e11 - e00);
+        const Vec3 n = d.cross(pb);
+        const double det = n.squared_norm();
+        if (det == 0.0) {
+            continue;
+        }
+        const Vec3 m = n.cross(pa);
+        const double t = m.dot(pb) / det;
+        const double v = m.dot(d) / det;
+        if (v < 0.0 || v > 1.0 || t < tmin || time <= t) {
+            continue;
+        }
+        time = t;
+        const Vec3 dp_du = (1.0 - v) * e10 + v * (q11 - q01);
+        normal = dp_du.cross(pb);
+        hit = true;
+    }
+    return hit;
+}
+
+bool QuadMesh::hit(const Ray & ray,
+                   const double tmin,
+                   const double tmax,
+                   HitRecord & hit_record) const noexcept {
+    Vec3 closest_normal;
+    double closest_time = tmax;
+    const bool hit = tree.traverse(
+        ray, tmin, tmax, [&](uint32_t index, double & t_max) {
+            double time;
+            Vec3 normal;
+            if (!intersect(index, ray, tmin, t_max, time, normal)) {
+                return false;
+            }
+            closest_time = time;
+            closest_normal = normal;
+            t_max = time;
+            return true;
+        });
+    if (!hit) {
+        return false;
+    }
+
+    hit_record.time = closest_time;
+    hit_record.hit_point = ray.at(closest_time);
+    hit_record.set_face_normal(ray, closest_normal.unit_vector());
+    hit_record.material = material;
+    return true;
+}
+
+bool QuadMesh::occluded(const Ray & ray,
+                        const double tmin,
+                        const double tmax) const noexcept {
+    return tree.traverse_any(ray, tmin, tmax, [&](uint32_t index) {
+        double time;
+        Vec3 normal;
+        return intersect(index, ray, tmin, tmax, time, normal);
+    });
+}
+
+bool QuadMesh::bounding_box(Aabb & output_box) const noexcept {
+    if (quads.empty()) {
+        return false;
+    }
+    output_box = tree.bounds();
+    return true;
+}
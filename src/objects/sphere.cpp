@@ -1,19 +1,25 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
 // From src/include
 #include <hittable.hpp>
 #include <objects/sphere.hpp>
+#include <ray_packet.hpp>
+#include <utils/orthonormal_bases.hpp>
 #include <utils/vec3.hpp>
 
-bool Sphere::hit(const Ray & ray,
-                 const double tmin,
-                 const double tmax,
-                 HitRecord & hit_record) const noexcept {
+bool Sphere::intersect(const Ray & ray,
+                       const double tmin,
+                       const double tmax,
+                       double & time) const noexcept {
     // solving (origin + t * dir - centre)^2 = R^2
     const double a = ray.direction.squared_norm();
     const double b = ray.direction.dot(ray.origin - centre);
     const double c = (ray.origin - centre).squared_norm() - radius * radius;
     const double delta = b * b - a * c;
 
-    double time = tmin - utils::EPSILON;
+    time = tmin - utils::EPSILON;
 
     if (delta >= 0) { // sphere hit
         const double sqrt_delta = sqrt(delta);
@@ -24,52 +30,146 @@ bool Sphere::hit(const Ray & ray,
         }
     }
 
-    if (tmin < time && time < tmax) {
-        // There was a hit in the time window
-        hit_record.time = time;
-        hit_record.hit_point = ray.at(time);
-        Vec3 outward_normal = (hit_record.hit_point - centre) / radius;
-        hit_record.set_face_normal(ray, outward_normal);
-        hit_record.material = material;
-        return true;
-    } else {
-        // No hit between tmin and tmax
+    // Wether there was a hit in the time window
+    return tmin < time && time < tmax;
+}
+
+void Sphere::set_hit_record(const Ray & ray,
+                            const double time,
+                            HitRecord & hit_record) const noexcept {
+    hit_record.time = time;
+    hit_record.hit_point = ray.at(time);
+    Vec3 outward_normal = (hit_record.hit_point - centre) / radius;
+    hit_record.set_face_normal(ray, outward_normal);
+    hit_record.material = material;
+}
+
+bool Sphere::hit(const Ray & ray,
+                 const double tmin,
+                 const double tmax,
+                 HitRecord & hit_record) const noexcept {
+    double time;
+    if (!intersect(ray, tmin, tmax, time)) {
         return false;
     }
+    set_hit_record(ray, time, hit_record);
+    return true;
 }
 
-double Sphere::pdf_value(const Point3 & origin,
-                         const Vec3 & direction) const noexcept {
-    HitRecord rec;
-    if (!this->hit(Ray(origin, direction), utils::EPSILON, utils::INF, rec)) {
-        return 0;
+unsigned Sphere::hit_packet(const RayPacket & packet,
+                            const unsigned mask,
+                            const double tmin,
+                            double * tmax,
+                            HitRecord * records) const noexcept {
+#ifdef __AVX2__
+    // Same computation as intersect, with one ray per lane
+    const __m256d ocx = _mm256_sub_pd(packet.ox, _mm256_set1_pd(centre.x));
+    const __m256d ocy = _mm256_sub_pd(packet.oy, _mm256_set1_pd(centre.y));
+    const __m256d ocz = _mm256_sub_pd(packet.oz, _mm256_set1_pd(centre.z));
+    const __m256d a = _mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(packet.dx, packet.dx),
+                      _mm256_mul_pd(packet.dy, packet.dy)),
+        _mm256_mul_pd(packet.dz, packet.dz));
+    const __m256d b =
+        _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(packet.dx, ocx),
+                                    _mm256_mul_pd(packet.dy, ocy)),
+                      _mm256_mul_pd(packet.dz, ocz));
+    const __m256d c = _mm256_sub_pd(
+        _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx),
+                                    _mm256_mul_pd(ocy, ocy)),
+                      _mm256_mul_pd(ocz, ocz)),
+        _mm256_set1_pd(radius * radius));
+    const __m256d delta =
+        _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(a, c));
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d t_min = _mm256_set1_pd(tmin);
+    const __m256d sqrt_delta = _mm256_sqrt_pd(_mm256_max_pd(delta, zero));
+    const __m256d minus_b = _mm256_sub_pd(zero, b);
+    const __m256d t0 = _mm256_div_pd(_mm256_sub_pd(minus_b, sqrt_delta), a);
+    const __m256d t1 = _mm256_div_pd(_mm256_add_pd(minus_b, sqrt_delta), a);
+    const __m256d time =
+        _mm256_blendv_pd(t0, t1, _mm256_cmp_pd(t0, t_min, _CMP_LE_OQ));
+    const __m256d valid = _mm256_and_pd(
+        _mm256_cmp_pd(delta, zero, _CMP_GE_OQ),
+        _mm256_and_pd(
+            _mm256_cmp_pd(t_min, time, _CMP_LT_OQ),
+            _mm256_cmp_pd(time, _mm256_loadu_pd(tmax), _CMP_LT_OQ)));
+    const unsigned hit = _mm256_movemask_pd(valid) & mask;
+
+    alignas(32) double times[PACKET_SIZE];
+    _mm256_store_pd(times, time);
+    for (unsigned m = hit; m; m &= m - 1) {
+        const unsigned l = std::countr_zero(m);
+        set_hit_record(packet.rays[l], times[l], records[l]);
+        tmax[l] = times[l];
     }
+    return hit;
+#else
+    return Hittable::hit_packet(packet, mask, tmin, tmax, records);
+#endif
+}
 
-    double cos_theta_max =
-        sqrt(1.0 - radius * radius / (centre - origin).squared_norm());
-    double solid_angle = utils::TAU * (1.0 - cos_theta_max);
+bool Sphere::occluded(const Ray & ray,
+                      const double tmin,
+                      const double tmax) const noexcept {
+    double time;
+    return intersect(ray, tmin, tmax, time);
+}
 
-    return 1.0 / solid_angle;
+// 1 - cos(theta_max) for the cone of a sphere seen from outside, given the
+// squared ratio of its radius to the distance to its centre. Computed without
+// cancellation, for small and distant spheres.
+static inline double one_minus_cos_theta_max(const double ratio) noexcept {
+    return ratio / (1.0 + sqrt(1.0 - ratio));
 }
 
-static inline Vec3 random_to_sphere(double radius,
-                                    double distance_squared) noexcept {
-    double r1 = rng::gen();
-    double r2 = rng::gen();
-    double z =
-        1.0 + r2 * (sqrt(1.0 - radius * radius / distance_squared) - 1.0);
+double Sphere::pdf_value(const Point3 & origin,
+                         const Vec3 & direction) const noexcept {
+    const Vec3 to_centre = centre - origin;
+    const double distance_squared = to_centre.squared_norm();
+    const double ratio = radius * radius / distance_squared;
+    if (ratio >= 1.0) {
+        // Inside the sphere, all the directions are sampled
+        return 1.0 / (2.0 * utils::TAU);
+    }
+
+    // The direction hits the sphere if it lies in the cone of the sphere
+    const double cos_theta_max_squared = 1.0 - ratio;
+    const double projection = direction.dot(to_centre);
+    if (projection <= 0.0
+        || projection * projection < cos_theta_max_squared
+                                         * direction.squared_norm()
+                                         * distance_squared) {
+        return 0.0;
+    }
+    return 1.0 / (utils::TAU * one_minus_cos_theta_max(ratio));
+}
 
-    double phi = utils::TAU * r1;
-    double x = cos(phi) * sqrt(1 - z * z);
-    double y = sin(phi) * sqrt(1 - z * z);
+// Random direction in the cone of a sphere, around the z axis
+static inline Vec3 random_to_sphere(const double ratio) noexcept {
+    const double r1 = rng::gen();
+    const double r2 = rng::gen();
+    const double z = 1.0 - r2 * one_minus_cos_theta_max(ratio);
 
-    return Vec3(x, y, z);
+    const double phi = utils::TAU * r1;
+    const double sin_theta = sqrt(std::max(0.0, 1.0 - z * z));
+    return Vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, z);
 }
 
 Vec3 Sphere::random(const Point3 & origin) const noexcept {
-    Vec3 direction = centre - origin;
-    double distance_squared = direction.squared_norm();
-    Onb uvw;
-    uvw.from_unit_normal(direction / sqrt(distance_squared));
-    return uvw.local(random_to_sphere(radius, distance_squared));
+    const Vec3 to_centre = centre - origin;
+    const double distance_squared = to_centre.squared_norm();
+    const double ratio = radius * radius / distance_squared;
+    if (ratio >= 1.0) {
+        return Vec3::random_unit_vector();
+    }
+    const Onb uvw = Onb::from_unit_normal(to_centre / sqrt(distance_squared));
+    return uvw.local(random_to_sphere(ratio));
+}
+
+bool Sphere::bounding_box(Aabb & output_box) const noexcept {
+    const Vec3 extent(radius, radius, radius);
+    output_box = Aabb(centre - extent, centre + extent);
+    return true;
 }
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+// From src/include
+#include <hittable.hpp>
+#include <objects/sphere_set.hpp>
+#include <ray_packet.hpp>
+#include <utils/aabb.hpp>
+#include <utils/vec3.hpp>
+
+static_assert(SphereSet::CAPACITY % PACKET_SIZE == 0);
+
+SphereSet::SphereSet(const Entry * entries, const size_t entry_count)
+    : count(entry_count) {
+    if (entry_count == 0 || entry_count > CAPACITY) {
+        throw "Invalid number of spheres in a sphere set";
+    }
+    // Unused lanes are masked out by the intersection
+    std::fill_n(centre_x, CAPACITY, 0.0);
+    std::fill_n(centre_y, CAPACITY, 0.0);
+    std::fill_n(centre_z, CAPACITY, 0.0);
+    std::fill_n(squared_radius, CAPACITY, -1.0);
+    for (size_t i = 0; i < entry_count; ++i) {
+        const Entry & entry = entries[i];
+        centre_x[i] = entry.centre.x;
+        centre_y[i] = entry.centre.y;
+        centre_z[i] = entry.centre.z;
+        squared_radius[i] = entry.radius * entry.radius;
+        radius[i] = entry.radius;
+        materials[i] = entry.material;
+
+        const Vec3 extent(entry.radius, entry.radius, entry.radius);
+        box.extend(Aabb(entry.centre - extent, entry.centre + extent));
+    }
+}
+
+// Split a range of spheres at the median of its longest axis until it fits
+// in a set
+static void pack_range(SphereSet::Entry * entries,
+                       const size_t entry_count,
+                       std::vector<std::shared_ptr<Hittable>> & sets) {
+    if (entry_count <= SphereSet::CAPACITY) {
+        sets.push_back(std::make_shared<SphereSet>(entries, entry_count));
+        return;
+    }
+
+    Aabb centres;
+    for (size_t i = 0; i < entry_count; ++i) {
+        centres.extend(entries[i].centre);
+    }
+    const Vec3 extent = centres.max - centres.min;
+    const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                         : (extent.y > extent.z ? 1 : 2);
+
+    // Split on a multiple of the capacity, so that only the last set of the
+    // whole range is partially filled
+    const size_t sets_count =
+        (entry_count + SphereSet::CAPACITY - 1) / SphereSet::CAPACITY;
+    const size_t middle = sets_count / 2 * SphereSet::CAPACITY;
+    std::nth_element(entries, entries + middle, entries + entry_count,
+                     [axis](const SphereSet::Entry & a,
+                            const SphereSet::Entry & b) {
+                         return a.centre[axis] < b.centre[axis];
+                     });
+    pack_range(entries, middle, sets);
+    pack_range(entries + middle, entry_count - middle, sets);
+}
+
+std::vector<std::shared_ptr<Hittable>>
+    SphereSet::pack(std::vector<Entry> & entries) {
+    std::vector<std::shared_ptr<Hittable>> sets;
+    if (!entries.empty()) {
+        sets.reserve((entries.size() + CAPACITY - 1) / CAPACITY);
+        pack_range(entries.data(), entries.size(), sets);
+    }
+    return sets;
+}
+
+int SphereSet::intersect(const Ray & ray,
+                         const double tmin,
+                         const double tmax,
+                         double & time) const noexcept {
+    int index = -1;
+    time = tmax;
+
+#ifdef __AVX2__
+    // Same computation as Sphere::intersect, with one sphere per lane
+    const double a = ray.direction.squared_norm();
+    const __m256d dx = _mm256_set1_pd(ray.direction.x);
+    const __m256d dy = _mm256_set1_pd(ray.direction.y);
+    const __m256d dz = _mm256_set1_pd(ray.direction.z);
+    const __m256d ox = _mm256_set1_pd(ray.origin.x);
+    const __m256d oy = _mm256_set1_pd(ray.origin.y);
+    const __m256d oz = _mm256_set1_pd(ray.origin.z);
+    const __m256d va = _mm256_set1_pd(a);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d t_min = _mm256_set1_pd(tmin);
+
+    for (size_t base = 0; base < count; base += PACKET_SIZE) {
+        const unsigned used = count - base >= PACKET_SIZE
+                                  ? PACKET_MASK
+                                  : (1u << (count - base)) - 1;
+        const __m256d ocx =
+            _mm256_sub_pd(ox, _mm256_load_pd(centre_x + base));
+        const __m256d ocy =
+            _mm256_sub_pd(oy, _mm256_load_pd(centre_y + base));
+        const __m256d ocz =
+            _mm256_sub_pd(oz, _mm256_load_pd(centre_z + base));
+        const __m256d b = _mm256_add_pd(
+            _mm256_add_pd(_mm256_mul_pd(dx, ocx), _mm256_mul_pd(dy, ocy)),
+            _mm256_mul_pd(dz, ocz));
+        const __m256d c = _mm256_sub_pd(
+            _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx),
+                                        _mm256_mul_pd(ocy, ocy)),
+                          _mm256_mul_pd(ocz, ocz)),
+            _mm256_load_pd(squared_radius + base));
+        const __m256d delta =
+            _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(va, c));
+        const __m256d hit_sphere = _mm256_cmp_pd(delta, zero, _CMP_GE_OQ);
+        if ((_mm256_movemask_pd(hit_sphere) & used) == 0) {
+            continue;
+        }
+        const __m256d sqrt_delta = _mm256_sqrt_pd(_mm256_max_pd(delta, zero));
+        const __m256d minus_b = _mm256_sub_pd(zero, b);
+        const __m256d t0 =
+            _mm256_div_pd(_mm256_sub_pd(minus_b, sqrt_delta), va);
+        const __m256d t1 =
+            _mm256_div_pd(_mm256_add_pd(minus_b, sqrt_delta), va);
+        const __m256d times =
+            _mm256_blendv_pd(t0, t1, _mm256_cmp_pd(t0, t_min, _CMP_LE_OQ));
+        const __m256d valid = _mm256_and_pd(
+            hit_sphere,
+            _mm256_and_pd(
+                _mm256_cmp_pd(t_min, times, _CMP_LT_OQ),
+                _mm256_cmp_pd(times, _mm256_set1_pd(time), _CMP_LT_OQ)));
+        const unsigned lanes = _mm256_movemask_pd(valid) & used;
+        if (lanes == 0) {
+            continue;
+        }
+
+        alignas(32) double lane_times[PACKET_SIZE];
+        _mm256_store_pd(lane_times, times);
+        for (unsigned m = lanes; m; m &= m - 1) {
+            const unsigned l = std::countr_zero(m);
+            if (lane_times[l] < time) {
+                time = lane_times[l];
+                index = int(base + l);
+            }
+        }
+    }
+#else
+    const double a = ray.direction.squared_norm();
+    for (size_t i = 0; i < count; ++i) {
+        const Vec3 oc =
+            ray.origin - Point3(centre_x[i], centre_y[i], centre_z[i]);
+        const double b = ray.direction.dot(oc);
+        const double c = oc.squared_norm() - squared_radius[i];
+        const double delta = b * b - a * c;
+        if (delta < 0) {
+            continue;
+        }
+        const double sqrt_delta = sqrt(delta);
+        double t = (-b - sqrt_delta) / a;
+        if (t <= tmin) {
+            t = (-b + sqrt_delta) / a;
+        }
+        if (tmin < t && t < time) {
+            time = t;
+            index = int(i);
+        }
+    }
+#endif
+
+    return index;
+}
+
+void SphereSet::set_hit_record(const Ray & ray,
+                               const int index,
+                               const double time,
+                               HitRecord & hit_record) const noexcept {
+    hit_record.time = time;
+    hit_record.hit_point = ray.at(time);
+    const Point3 centre(centre_x[index], centre_y[index], centre_z[index]);
+    Vec3 outward_normal = (hit_record.hit_point - centre) / radius[index];
+    hit_record.set_face_normal(ray, outward_normal);
+    hit_record.material = *materials[index];
+}
+
+bool SphereSet::hit(const Ray & ray,
+                    const double tmin,
+                    const double tmax,
+                    HitRecord & hit_record) const noexcept {
+    double time;
+    const int index = intersect(ray, tmin, tmax, time);
+    if (index < 0) {
+        return false;
+    }
+    set_hit_record(ray, index, time, hit_record);
+    return true;
+}
+
+unsigned SphereSet::hit_packet(const RayPacket & packet,
+                               const unsigned mask,
+                               const double tmin,
+                               double * tmax,
+                               HitRecord * records) const noexcept {
+#ifdef __AVX2__
+    // Same computation as Sphere::hit_packet, one sphere at a time against
+    // all the rays. The closest hit of each lane is kept in registers, and
+    // its record only written at the end.
+    const __m256d a = _mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(packet.dx, packet.dx),
+                      _mm256_mul_pd(packet.dy, packet.dy)),
+        _mm256_mul_pd(packet.dz, packet.dz));
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d t_min = _mm256_set1_pd(tmin);
+    __m256d closest = _mm256_loadu_pd(tmax);
+    __m256d closest_index = _mm256_set1_pd(-1.0);
+    __m256d hit = zero;
+
+    for (size_t i = 0; i < count; ++i) {
+        const __m256d ocx =
+            _mm256_sub_pd(packet.ox, _mm256_set1_pd(centre_x[i]));
+        const __m256d ocy =
+            _mm256_sub_pd(packet.oy, _mm256_set1_pd(centre_y[i]));
+        const __m256d ocz =
+            _mm256_sub_pd(packet.oz, _mm256_set1_pd(centre_z[i]));
+        const __m256d b =
+            _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(packet.dx, ocx),
+                                        _mm256_mul_pd(packet.dy, ocy)),
+                          _mm256_mul_pd(packet.dz, ocz));
+        const __m256d c = _mm256_sub_pd(
+            _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx),
+                                        _mm256_mul_pd(ocy, ocy)),
+                          _mm256_mul_pd(ocz, ocz)),
+            _mm256_set1_pd(squared_radius[i]));
+        const __m256d delta =
+            _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(a, c));
+        const __m256d hit_sphere = _mm256_cmp_pd(delta, zero, _CMP_GE_OQ);
+        if (_mm256_movemask_pd(hit_sphere) == 0) {
+            continue;
+        }
+
+        const __m256d sqrt_delta = _mm256_sqrt_pd(_mm256_max_pd(delta, zero));
+        const __m256d minus_b = _mm256_sub_pd(zero, b);
+        const __m256d t0 =
+            _mm256_div_pd(_mm256_sub_pd(minus_b, sqrt_delta), a);
+        const __m256d t1 =
+            _mm256_div_pd(_mm256_add_pd(minus_b, sqrt_delta), a);
+        const __m256d time =
+            _mm256_blendv_pd(t0, t1, _mm256_cmp_pd(t0, t_min, _CMP_LE_OQ));
+        const __m256d valid = _mm256_and_pd(
+            hit_sphere,
+            _mm256_and_pd(_mm256_cmp_pd(t_min, time, _CMP_LT_OQ),
+                          _mm256_cmp_pd(time, closest, _CMP_LT_OQ)));
+        closest = _mm256_blendv_pd(closest, time, valid);
+        closest_index = _mm256_blendv_pd(
+            closest_index, _mm256_set1_pd(double(i)), valid);
+        hit = _mm256_or_pd(hit, valid);
+    }
+
+    const unsigned hit_lanes = _mm256_movemask_pd(hit) & mask;
+    alignas(32) double times[PACKET_SIZE];
+    alignas(32) double indices[PACKET_SIZE];
+    _mm256_store_pd(times, closest);
+    _mm256_store_pd(indices, closest_index);
+    for (unsigned m = hit_lanes; m; m &= m - 1) {
+        const unsigned l = std::countr_zero(m);
+        set_hit_record(packet.rays[l], int(indices[l]), times[l], records[l]);
+        tmax[l] = times[l];
+    }
+    return hit_lanes;
+#else
+    return Hittable::hit_packet(packet, mask, tmin, tmax, records);
+#endif
+}
+
+bool SphereSet::occluded(const Ray & ray,
+                         const double tmin,
+                         const double tmax) const noexcept {
+    double time;
+    return intersect(ray, tmin, tmax, time) >= 0;
+}
+
+bool SphereSet::bounding_box(Aabb & output_box) const noexcept {
+    output_box = box;
+    return true;
+}
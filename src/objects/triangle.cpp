@@ -1,14 +1,17 @@
+#include <algorithm>
+#include <bit>
 #include <cmath>
 
 // From src/include
 #include <hittable.hpp>
 #include <objects/triangle.hpp>
+#include <ray_packet.hpp>
 #include <utils/vec3.hpp>
 
-bool Triangle::hit(const Ray & ray,
-                   const double tmin,
-                   const double tmax,
-                   HitRecord & hit_record) const noexcept {
+bool Triangle::intersect(const Ray & ray,
+                         const double tmin,
+                         const double tmax,
+                         double & time) const noexcept {
     // Test if the ray's direction is colinear to the triangle
     const double determinant = ray.direction.dot(normal);
     if (fabs(determinant) < utils::EPSILON) {
@@ -18,7 +21,7 @@ bool Triangle::hit(const Ray & ray,
     const Point3 origin_to_vertex = vertex - ray.origin;
 
     // Finding the time of intersection
-    const double time = scale * origin_to_vertex.dot(normal);
+    time = scale * origin_to_vertex.dot(normal);
     if (time < tmin || tmax < time) {
         return false;
     }
@@ -38,32 +41,166 @@ bool Triangle::hit(const Ray & ray,
         return false;
     }
 
+    return true;
+}
+
+void Triangle::set_hit_record(const Ray & ray,
+                              const double time,
+                              HitRecord & hit_record) const noexcept {
     hit_record.time = time;
     hit_record.hit_point = ray.at(time);
     Vec3 outward_normal = unit_normal;
     hit_record.set_face_normal(ray, outward_normal);
     hit_record.material = material;
+}
+
+bool Triangle::hit(const Ray & ray,
+                   const double tmin,
+                   const double tmax,
+                   HitRecord & hit_record) const noexcept {
+    double time;
+    if (!intersect(ray, tmin, tmax, time)) {
+        return false;
+    }
+    set_hit_record(ray, time, hit_record);
     return true;
 }
 
+unsigned Triangle::hit_packet(const RayPacket & packet,
+                              const unsigned mask,
+                              const double tmin,
+                              double * tmax,
+                              HitRecord * records) const noexcept {
+#ifdef __AVX2__
+    __m256d time, u, v;
+    const unsigned in_plane = planar_intersect4(
+        packet, vertex, edge1, edge2, normal, tmin, tmax, time, u, v);
+
+    // Barycentric coordinates test, as in intersect
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d inside = _mm256_and_pd(
+        _mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_GE_OQ),
+                      _mm256_cmp_pd(v, zero, _CMP_GE_OQ)),
+        _mm256_cmp_pd(_mm256_add_pd(u, v), one, _CMP_LE_OQ));
+    const unsigned hit = in_plane & _mm256_movemask_pd(inside) & mask;
+
+    alignas(32) double times[PACKET_SIZE];
+    _mm256_store_pd(times, time);
+    for (unsigned m = hit; m; m &= m - 1) {
+        const unsigned l = std::countr_zero(m);
+        set_hit_record(packet.rays[l], times[l], records[l]);
+        tmax[l] = times[l];
+    }
+    return hit;
+#else
+    return Hittable::hit_packet(packet, mask, tmin, tmax, records);
+#endif
+}
+
+bool Triangle::occluded(const Ray & ray,
+                        const double tmin,
+                        const double tmax) const noexcept {
+    double time;
+    return intersect(ray, tmin, tmax, time);
+}
+
+// Solid angle of the spherical triangle of three unit vectors (Van Oosterom
+// and Strackee, 1983)
+static inline double solid_angle(const Vec3 & a,
+                                 const Vec3 & b,
+                                 const Vec3 & c) noexcept {
+    return fabs(2.0
+                * atan2(a.dot(b.cross(c)),
+                        1.0 + a.dot(b) + a.dot(c) + b.dot(c)));
+}
+
+// Angle between two unit vectors, accurate for small and large angles
+static inline double angle_between(const Vec3 & u, const Vec3 & v) noexcept {
+    if (u.dot(v) < 0.0) {
+        return utils::PI - 2.0 * asin(std::min(1.0, (u + v).norm() / 2.0));
+    }
+    return 2.0 * asin(std::min(1.0, (v - u).norm() / 2.0));
+}
+
+// Component of v orthogonal to the unit vector w, normalized
+static inline Vec3 orthogonal_part(const Vec3 & v, const Vec3 & w) noexcept {
+    return (v - v.dot(w) * w).unit_vector();
+}
+
 double Triangle::pdf_value(const Point3 & origin,
                            const Vec3 & direction) const noexcept {
-    HitRecord rec;
-    if (!this->hit(Ray(origin, direction), utils::EPSILON, utils::INF, rec)) {
+    double time;
+    if (!intersect(Ray(origin, direction), utils::EPSILON, utils::INF, time)) {
         return 0.0;
     }
 
+    const double omega = solid_angle((vertex - origin).unit_vector(),
+                                     (vertex + edge1 - origin).unit_vector(),
+                                     (vertex + edge2 - origin).unit_vector());
+    if (utils::samples_solid_angle(omega)) {
+        return 1.0 / omega;
+    }
+
+    // Convert the uniform density on the area to a solid angle density
     const double area = 0.5 * normal.dot(unit_normal);
-    const double distance_squared =
-        rec.time * rec.time * direction.squared_norm();
+    const double squared_norm = direction.squared_norm();
+    const double distance_squared = time * time * squared_norm;
     const double cosine =
-        fabs(direction.dot(rec.surface_normal) / direction.norm());
+        fabs(direction.dot(unit_normal)) / sqrt(squared_norm);
 
     return distance_squared / (cosine * area);
 }
 
 Vec3 Triangle::random(const Point3 & origin) const noexcept {
-    double alpha = rng::gen();
-    double beta = rng::gen() * alpha;
-    return (vertex + alpha * edge1 + beta * edge2 - origin).unit_vector();
+    const Vec3 a = (vertex - origin).unit_vector();
+    const Vec3 b = (vertex + edge1 - origin).unit_vector();
+    const Vec3 c = (vertex + edge2 - origin).unit_vector();
+    const double omega = solid_angle(a, b, c);
+    const double u1 = rng::gen();
+    const double u2 = rng::gen();
+
+    if (!utils::samples_solid_angle(omega)) {
+        // Uniform point on the triangle
+        const double s = sqrt(u1);
+        return (vertex + s * (1.0 - u2) * edge1 + s * u2 * edge2 - origin)
+            .unit_vector();
+    }
+
+    // Uniform direction in the spherical triangle (Arvo, 1995): the area of
+    // the sub-triangle a, b, c' is chosen first, which places c' on the arc
+    // from a to c, then the direction is chosen on the arc from b to c'
+    const Vec3 n_ab = a.cross(b).unit_vector();
+    const Vec3 n_bc = b.cross(c).unit_vector();
+    const Vec3 n_ca = c.cross(a).unit_vector();
+    const double alpha = angle_between(n_ab, -n_ca);
+    const double beta = angle_between(n_bc, -n_ab);
+    const double gamma = angle_between(n_ca, -n_bc);
+
+    const double sub_area = utils::PI + u1 * (alpha + beta + gamma - utils::PI);
+    const double cos_alpha = cos(alpha);
+    const double sin_alpha = sin(alpha);
+    const double sin_phi =
+        sin(sub_area) * cos_alpha - cos(sub_area) * sin_alpha;
+    const double cos_phi =
+        cos(sub_area) * cos_alpha + sin(sub_area) * sin_alpha;
+    const double k1 = cos_phi + cos_alpha;
+    const double k2 = sin_phi - sin_alpha * a.dot(b);
+    const double cos_b = std::clamp(
+        (k2 + (k2 * cos_phi - k1 * sin_phi) * cos_alpha)
+            / ((k2 * sin_phi + k1 * cos_phi) * sin_alpha),
+        -1.0, 1.0);
+    const double sin_b = sqrt(std::max(0.0, 1.0 - cos_b * cos_b));
+    const Vec3 c_prime = cos_b * a + sin_b * orthogonal_part(c, a);
+
+    const double cos_theta = 1.0 - u2 * (1.0 - c_prime.dot(b));
+    const double sin_theta = sqrt(std::max(0.0, 1.0 - cos_theta * cos_theta));
+    return cos_theta * b + sin_theta * orthogonal_part(c_prime, b);
+}
+
+bool Triangle::bounding_box(Aabb & output_box) const noexcept {
+    output_box = Aabb::from_point(vertex);
+    output_box.extend(vertex + edge1);
+    output_box.extend(vertex + edge2);
+    return true;
 }
@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+// From src/include
+#include <objects/triangle_batch.hpp>
+#include <ray.hpp>
+#include <utils/vec3.hpp>
+
+// This file is compiled with -fno-fast-math -ffp-contract=off. Fused
+// multiply-adds, reassociation or ignored signed zeros would change the signs
+// of the edge functions differently for the two triangles sharing an edge.
+
+WatertightRay::WatertightRay(const Ray & ray) noexcept : origin(ray.origin) {
+    const Vec3 & d = ray.direction;
+    const double ax = std::abs(d.x);
+    const double ay = std::abs(d.y);
+    const double az = std::abs(d.z);
+    kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+    kx = kz == 2 ? 0 : kz + 1;
+    ky = kx == 2 ? 0 : kx + 1;
+    // Keep the winding of the triangles
+    if (d[kz] < 0) {
+        std::swap(kx, ky);
+    }
+    sx = d[kx] / d[kz];
+    sy = d[ky] / d[kz];
+    sz = 1.0 / d[kz];
+}
+
+bool WatertightRay::intersect(const Point3 & a,
+                              const Point3 & b,
+                              const Point3 & c,
+                              const double tmin,
+                              const double tmax,
+                              double & time) const noexcept {
+    // Vertices relative to the origin, in the sheared frame
+    const Point3 * const vertices[3] = { &a, &b, &c };
+    double x[3], y[3], z[3];
+    for (int v = 0; v < 3; ++v) {
+        const Point3 & p = *vertices[v];
+        const double vz = p[kz] - origin[kz];
+        x[v] = (p[kx] - origin[kx]) - sx * vz;
+        y[v] = (p[ky] - origin[ky]) - sy * vz;
+        z[v] = sz * vz;
+    }
+
+    // Edge functions, the ray hits the triangle when they share a sign
+    const double u = x[2] * y[1] - y[2] * x[1];
+    const double v = x[0] * y[2] - y[0] * x[2];
+    const double w = x[1] * y[0] - y[1] * x[0];
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) {
+        return false;
+    }
+    const double determinant = u + v + w;
+    if (determinant == 0) {
+        return false;
+    }
+
+    time = (u * z[0] + v * z[1] + w * z[2]) / determinant;
+    return tmin <= time && time <= tmax;
+}
+
+size_t TriangleBatch::pack(const std::span<const uint32_t> triangles,
+                           const std::vector<std::array<Point3, 3>> & vertices,
+                           std::vector<TriangleBatch> & batches) {
+    const size_t batch_count = (triangles.size() + SIZE - 1) / SIZE;
+    for (size_t b = 0; b < batch_count; ++b) {
+        TriangleBatch batch {};
+        for (size_t l = 0; l < SIZE; ++l) {
+            const size_t i = b * SIZE + l;
+            if (i >= triangles.size()) {
+                batch.index[l] = NO_TRIANGLE;
+                continue;
+            }
+            batch.index[l] = triangles[i];
+            for (int v = 0; v < 3; ++v) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    batch.vertices[v][axis][l] =
+                        vertices[triangles[i]][v][axis];
+                }
+            }
+        }
+        batches.push_back(batch);
+    }
+    return batch_count;
+}
+
+size_t TriangleBatch::gather(
+    const std::span<const uint32_t> triangles,
+    const std::span<const Point3> vertices,
+    const std::span<const std::array<uint32_t, 3>> faces,
+    TriangleBatch * batches) noexcept {
+    const size_t batch_count = (triangles.size() + SIZE - 1) / SIZE;
+    for (size_t b = 0; b < batch_count; ++b) {
+        TriangleBatch & batch = batches[b];
+        for (size_t l = 0; l < SIZE; ++l) {
+            const size_t i = std::min(b * SIZE + l, triangles.size() - 1);
+            batch.index[l] = i == b * SIZE + l ? triangles[i] : NO_TRIANGLE;
+            const std::array<uint32_t, 3> & face = faces[triangles[i]];
+            for (int v = 0; v < 3; ++v) {
+                const Point3 & p = vertices[face[v]];
+                batch.vertices[v][0][l] = p.x;
+                batch.vertices[v][1][l] = p.y;
+                batch.vertices[v][2][l] = p.z;
+            }
+        }
+    }
+    return batch_count;
+}
+
+uint32_t TriangleBatch::intersect(const WatertightRay & ray,
+                                  const TriangleBatch * batches,
+                                  const size_t batch_count,
+                                  const double tmin,
+                                  const double tmax,
+                                  double & time) noexcept {
+    uint32_t hit = NO_TRIANGLE;
+    time = tmax;
+
+#ifdef __AVX2__
+    const __m256d sx = _mm256_set1_pd(ray.sx);
+    const __m256d sy = _mm256_set1_pd(ray.sy);
+    const __m256d sz = _mm256_set1_pd(ray.sz);
+    const __m256d ox = _mm256_set1_pd(ray.origin[ray.kx]);
+    const __m256d oy = _mm256_set1_pd(ray.origin[ray.ky]);
+    const __m256d oz = _mm256_set1_pd(ray.origin[ray.kz]);
+    const __m256d zero = _mm256_setzero_pd();
+
+    for (size_t b = 0; b < batch_count; ++b) {
+        const TriangleBatch & batch = batches[b];
+
+        // Vertices relative to the origin, in the sheared frame
+        __m256d x[3], y[3], z[3];
+        for (int v = 0; v < 3; ++v) {
+            const __m256d vz =
+                _mm256_sub_pd(_mm256_load_pd(batch.vertices[v][ray.kz]), oz);
+            x[v] = _mm256_sub_pd(
+                _mm256_sub_pd(_mm256_load_pd(batch.vertices[v][ray.kx]), ox),
+                _mm256_mul_pd(sx, vz));
+            y[v] = _mm256_sub_pd(
+                _mm256_sub_pd(_mm256_load_pd(batch.vertices[v][ray.ky]), oy),
+                _mm256_mul_pd(sy, vz));
+            z[v] = _mm256_mul_pd(sz, vz);
+        }
+
+        // Edge functions, the ray hits the triangle when they share a sign
+        const __m256d u = _mm256_sub_pd(_mm256_mul_pd(x[2], y[1]),
+                                        _mm256_mul_pd(y[2], x[1]));
+        const __m256d v = _mm256_sub_pd(_mm256_mul_pd(x[0], y[2]),
+                                        _mm256_mul_pd(y[0], x[2]));
+        const __m256d w = _mm256_sub_pd(_mm256_mul_pd(x[1], y[0]),
+                                        _mm256_mul_pd(y[1], x[0]));
+        const __m256d negative = _mm256_or_pd(
+            _mm256_or_pd(_mm256_cmp_pd(u, zero, _CMP_LT_OQ),
+                         _mm256_cmp_pd(v, zero, _CMP_LT_OQ)),
+            _mm256_cmp_pd(w, zero, _CMP_LT_OQ));
+        const __m256d positive = _mm256_or_pd(
+            _mm256_or_pd(_mm256_cmp_pd(u, zero, _CMP_GT_OQ),
+                         _mm256_cmp_pd(v, zero, _CMP_GT_OQ)),
+            _mm256_cmp_pd(w, zero, _CMP_GT_OQ));
+        const __m256d determinant = _mm256_add_pd(_mm256_add_pd(u, v), w);
+        const __m256d inside = _mm256_andnot_pd(
+            _mm256_and_pd(negative, positive),
+            _mm256_cmp_pd(determinant, zero, _CMP_NEQ_OQ));
+        if (_mm256_movemask_pd(inside) == 0) {
+            continue;
+        }
+
+        // Hit times, computed for the triangles hit only
+        const __m256d scaled_time =
+            _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(u, z[0]),
+                                        _mm256_mul_pd(v, z[1])),
+                          _mm256_mul_pd(w, z[2]));
+        const __m256d times = _mm256_div_pd(scaled_time, determinant);
+        const __m256d valid = _mm256_and_pd(
+            inside,
+            _mm256_and_pd(
+                _mm256_cmp_pd(times, _mm256_set1_pd(tmin), _CMP_GE_OQ),
+                _mm256_cmp_pd(times, _mm256_set1_pd(time), _CMP_LE_OQ)));
+        const unsigned lanes = _mm256_movemask_pd(valid);
+        if (lanes == 0) {
+            continue;
+        }
+
+        alignas(32) double lane_times[SIZE];
+        _mm256_store_pd(lane_times, times);
+        for (unsigned m = lanes; m; m &= m - 1) {
+            const unsigned l = std::countr_zero(m);
+            if (batch.index[l] != NO_TRIANGLE && lane_times[l] <= time) {
+                time = lane_times[l];
+                hit = batch.index[l];
+            }
+        }
+    }
+#else
+    for (size_t b = 0; b < batch_count; ++b) {
+        const TriangleBatch & batch = batches[b];
+        for (size_t l = 0; l < SIZE; ++l) {
+            if (batch.index[l] == NO_TRIANGLE) {
+                continue;
+            }
+            Point3 vertices[3];
+            for (int v = 0; v < 3; ++v) {
+                vertices[v] = Point3(batch.vertices[v][0][l],
+                                     batch.vertices[v][1][l],
+                                     batch.vertices[v][2][l]);
+            }
+            double t;
+            if (ray.intersect(vertices[0], vertices[1], vertices[2], tmin,
+                              time, t)) {
+                time = t;
+                hit = batch.index[l];
+            }
+        }
+    }
+#endif
+
+    return hit;
+}
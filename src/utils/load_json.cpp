@@ -19,11 +19,19 @@
 #include <materials/metal.hpp>
 #include <materials/plastic.hpp>
 #include <objects/cylinder.hpp>
+#include <objects/instance.hpp>
+#include <objects/mesh.hpp>
+#include <objects/object.hpp>
+#include <objects/paged_mesh.hpp>
 #include <objects/parallelogram.hpp>
+#include <objects/quad_mesh.hpp>
 #include <objects/sphere.hpp>
+#include <objects/sphere_set.hpp>
 #include <objects/triangle.hpp>
 #include <utils/load_json.hpp>
+#include <utils/transform.hpp>
 #include <utils/vec3.hpp>
+#include <utils/weld.hpp>
 
 using namespace nlohmann;
 using namespace std;
@@ -56,6 +64,101 @@ static ImageInfo load_image_info(const json & j) {
     return ImageInfo { height, max_bounces, spp, aspect_ratio };
 }
 
+static AccelerationInfo load_acceleration_info(const json & j) {
+    AccelerationInfo info;
+    const string structure = j.at("structure").get<string>();
+
+    if (structure == "bvh") {
+        info.structure = AccelerationStructure::Bvh;
+
+    } else if (structure == "wide_bvh") {
+        info.structure = AccelerationStructure::WideBvh;
+        if (j.contains("width")) {
+            info.width = j.at("width").get<int>();
+        }
+        if (info.width != 4 && info.width != 8) {
+            throw ParseJsonException(
+                "Invalid JSON: wide BVH width must be 4 or 8.");
+        }
+        if (j.contains("quantization")) {
+            info.quantization = j.at("quantization").get<int>();
+        }
+        if (info.quantization != 0 && info.quantization != 8
+            && info.quantization != 16) {
+            throw ParseJsonException(
+                "Invalid JSON: wide BVH quantization must be 0, 8 or 16.");
+        }
+
+    } else if (structure == "grid") {
+        info.structure = AccelerationStructure::Grid;
+        if (j.contains("density")) {
+            info.density = j.at("density").get<double>();
+        }
+        if (!(info.density > 0.0)) {
+            throw ParseJsonException(
+                "Invalid JSON: grid density must be positive.");
+        }
+
+    } else {
+        throw ParseJsonException("Invalid acceleration structure!");
+    }
+
+    if (j.contains("packets")) {
+        info.packets = j.at("packets").get<bool>();
+    }
+    if (j.contains("streams")) {
+        info.streams = j.at("streams").get<bool>();
+    }
+    return info;
+}
+
+static SpatialSplitInfo load_split_info(const json & j) {
+    SpatialSplitInfo info;
+    if (j.contains("split")) {
+        const string split = j.at("split").get<string>();
+        if (split == "spatial") {
+            info.enabled = true;
+        } else if (split != "object") {
+            throw ParseJsonException(
+                "Invalid JSON: split must be \"object\" or \"spatial\".");
+        }
+    }
+    if (j.contains("split_budget")) {
+        info.memory_budget = j.at("split_budget").get<double>();
+        if (info.memory_budget < 0.0) {
+            throw ParseJsonException(
+                "Invalid JSON: split_budget must be positive.");
+        }
+    }
+    return info;
+}
+
+static WeldInfo load_weld_info(const json & j) {
+    WeldInfo info;
+    info.enabled = j.value("weld", false);
+    if (j.contains("weld_tolerance")) {
+        info.tolerance = j.at("weld_tolerance").get<double>();
+        if (info.tolerance < 0.0) {
+            throw ParseJsonException(
+                "Invalid JSON: weld_tolerance must be positive.");
+        }
+    }
+    return info;
+}
+
+// Log the sizes of a mesh before and after welding, if it was welded
+static void log_weld_stats(const string & file_name, const WeldStats & stats) {
+    if (!stats.welded) {
+        return;
+    }
+    console::log("Welded " + file_name + ": "
+                 + to_string(stats.vertices_before) + " vertices into "
+                 + to_string(stats.vertices_after) + ", "
+                 + to_string(stats.triangles_before - stats.triangles_after)
+                 + " degenerate triangles dropped in "
+                 + to_string(stats.millis) + "ms");
+}
+
 static Camera load_cam(const json & j, const ImageInfo & image_info) {
     Point3 origin = load_vec3(j.at("origin"));
     Point3 look_at = load_vec3(j.at("look_at"));
@@ -180,9 +283,103 @@ static unordered_map<string, shared_ptr<Material>>
     return materials;
 }
 
+// Mesh shared by instances
+struct MeshEntry {
+    // The mesh and its BVH
+    shared_ptr<const Object> object;
+    // Wether the mesh has its own material
+    bool has_material;
+};
+
+// Load a .obj mesh and build its BVH, or load it from its cache
+static shared_ptr<Object> load_object_file(const json & j,
+                                           const Material & material) {
+    const string file_name = j.at("file").get<string>();
+    const SpatialSplitInfo split_info = load_split_info(j);
+    const bool use_cache = j.value("cache", true);
+
+    shared_ptr<Object> object = make_shared<Object>(
+        file_name, material, split_info, use_cache, load_weld_info(j));
+    log_weld_stats(file_name, object->weld_statistics());
+    const BvhTree & tree = object->get_tree();
+    console::log("Loaded " + file_name + ": " + to_string(object->size())
+                 + " triangles, " + (split_info.enabled ? "SBVH" : "BVH")
+                 + (object->loaded_from_cache() ? " read from cache in "
+                                                : " built in ")
+                 + to_string(tree.build_time()) + "ms, "
+                 + to_string(tree.primitive_indices().size())
+                 + " references, " + to_string(tree.node_count())
+                 + " nodes, depth " + to_string(tree.depth()));
+    return object;
+}
+
+static unordered_map<string, MeshEntry>
+    load_meshes(const json & j,
+                const unordered_map<string, shared_ptr<Material>> & materials) {
+    if (!j.is_object()) {
+        throw ParseJsonException(
+            "Invalid JSON: meshes must be a map of mesh objects.");
+    }
+
+    unordered_map<string, MeshEntry> meshes;
+    for (const auto & [key, mesh] : j.items()) {
+        if (!mesh.is_object()) {
+            throw ParseJsonException(
+                "Invalid JSON: meshes must be a map of mesh objects.");
+        }
+
+        if (mesh.contains("material")) {
+            const string material_name = mesh.at("material").get<string>();
+            meshes.insert_or_assign(
+                key,
+                MeshEntry { load_object_file(
+                                mesh, (const Material &)*materials.at(
+                                          material_name)),
+                            true });
+        } else {
+            meshes.insert_or_assign(
+                key, MeshEntry { load_object_file(mesh, _DummyMaterial::d),
+                                 false });
+        }
+    }
+    return meshes;
+}
+
+// Load the object to world transform of an instance: scale, then rotation
+// around the x, y and z axes (in degrees), then translation
+static Transform load_transform(const json & j) {
+    Transform transform;
+    if (j.contains("scale")) {
+        const json & scale = j.at("scale");
+        transform = Transform::scale(scale.is_array()
+                                         ? load_vec3(scale)
+                                         : Vec3(scale.get<double>(),
+                                                scale.get<double>(),
+                                                scale.get<double>()));
+    }
+    if (j.contains("rotation")) {
+        const Vec3 angles = load_vec3(j.at("rotation"));
+        transform = Transform::rotate(vec3::X, utils::to_radians(angles.x))
+                    * transform;
+        transform = Transform::rotate(vec3::Y, utils::to_radians(angles.y))
+                    * transform;
+        transform = Transform::rotate(vec3::Z, utils::to_radians(angles.z))
+                    * transform;
+    }
+    if (j.contains("translation")) {
+        transform =
+            Transform::translate(load_vec3(j.at("translation"))) * transform;
+    }
+    if (transform.determinant() == 0.0) {
+        throw ParseJsonException("Invalid JSON: singular instance transform.");
+    }
+    return transform;
+}
+
 static pair<vector<shared_ptr<Hittable>>, vector<size_t>> load_objects(
     const json & j,
-    const unordered_map<string, shared_ptr<Material>> & materials) {
+    const unordered_map<string, shared_ptr<Material>> & materials,
+    const unordered_map<string, MeshEntry> & meshes) {
     if (!j.is_array()) {
         throw ParseJsonException(
             "Invalid JSON: objects must be an array of Hittable objects.");
@@ -190,9 +387,10 @@ static pair<vector<shared_ptr<Hittable>>, vector<size_t>> load_objects(
 
     vector<shared_ptr<Hittable>> objects;
     vector<size_t> sampled_objects;
+    // Spheres which are not sampled are packed into sphere sets
+    vector<SphereSet::Entry> spheres;
     string object_type;
     string material_name;
-    size_t index = 0;
 
     for (const json & obj : j) {
         if (!obj.is_object()) {
@@ -201,12 +399,23 @@ static pair<vector<shared_ptr<Hittable>>, vector<size_t>> load_objects(
         }
 
         object_type = obj.at("object_type").get<string>();
-        material_name = obj.at("material").get<string>();
+        // Instances may keep the materials of their mesh
+        material_name = object_type == "instance"
+                            ? obj.value("material", string())
+                            : obj.at("material").get<string>();
+
+        const bool sampled =
+            obj.contains("sampled") && obj.at("sampled").get<bool>();
 
         if (object_type == "sphere") {
             Vec3 center = load_vec3(obj.at("center"));
             double radius = obj.at("radius").get<double>();
 
+            if (!sampled) {
+                spheres.push_back(SphereSet::Entry {
+                    center, radius, materials.at(material_name).get() });
+                continue;
+            }
             objects.push_back(make_unique<Sphere>(
                 center, radius,
                 (const Material &)*materials.at(material_name)));
@@ -239,14 +448,92 @@ static pair<vector<shared_ptr<Hittable>>, vector<size_t>> load_objects(
                 base, axis, radius, height,
                 (const Material &)*materials.at(material_name)));
 
+        } else if (object_type == "object") {
+            objects.push_back(load_object_file(
+                obj, (const Material &)*materials.at(material_name)));
+
+        } else if (object_type == "mesh") {
+            const string file_name = obj.at("file").get<string>();
+            shared_ptr<Mesh> mesh = make_shared<Mesh>(
+                file_name, (const Material &)*materials.at(material_name),
+                obj.value("cache", true), load_weld_info(obj));
+            log_weld_stats(file_name, mesh->weld_statistics());
+            console::log("Loaded " + file_name + ": " + to_string(mesh->size())
+                         + " triangles, " + to_string(mesh->vertex_count())
+                         + " vertices"
+                         + (mesh->loaded_from_cache() ? " from cache" : "")
+                         + " in " + to_string(mesh->load_time()) + "ms, "
+                         + to_string(mesh->memory_usage()
+                                     / std::max<size_t>(1, mesh->size()))
+                         + " bytes per triangle");
+            objects.push_back(std::move(mesh));
+
+        } else if (object_type == "quad_mesh") {
+            const string file_name = obj.at("file").get<string>();
+            shared_ptr<QuadMesh> mesh = make_shared<QuadMesh>(
+                file_name, (const Material &)*materials.at(material_name));
+            console::log("Loaded " + file_name + ": " + to_string(mesh->size())
+                         + " quads, " + to_string(mesh->bilinear_count())
+                         + " bilinear patches, "
+                         + to_string(mesh->vertex_count()) + " vertices");
+            objects.push_back(std::move(mesh));
+
+        } else if (object_type == "paged_mesh") {
+            const string file_name = obj.at("file").get<string>();
+            // Memory budget of the pages, in MB
+            const double memory_budget =
+                obj.value("memory_budget", PagedMesh::DEFAULT_MEMORY_BUDGET
+                                               / double(1 << 20));
+            if (memory_budget < 0.0) {
+                throw ParseJsonException(
+                    "Invalid JSON: memory_budget must be positive.");
+            }
+            shared_ptr<PagedMesh> mesh = make_shared<PagedMesh>(
+                file_name, (const Material &)*materials.at(material_name),
+                size_t(memory_budget * (1 << 20)));
+            const PageCache & pages = mesh->get_pages();
+            console::log("Loaded " + file_name + ": " + to_string(mesh->size())
+                         + " triangles in " + to_string(pages.page_count())
+                         + " pages of " + to_string(pages.get_page_size())
+                         + " bytes, " + to_string(mesh->cluster_count())
+                         + " subtrees, "
+                         + to_string(mesh->resident_memory_usage())
+                         + " bytes resident, "
+                         + to_string(pages.slot_count())
+                         + " pages in memory");
+            objects.push_back(std::move(mesh));
+
+        } else if (object_type == "instance") {
+            const string mesh_name = obj.at("mesh").get<string>();
+            if (!meshes.contains(mesh_name)) {
+                throw ParseJsonException("Invalid JSON: unknown mesh!");
+            }
+            const MeshEntry & mesh = meshes.at(mesh_name);
+            const Transform transform = load_transform(obj);
+
+            if (!material_name.empty()) {
+                objects.push_back(make_unique<Instance>(
+                    mesh.object, transform,
+                    (const Material &)*materials.at(material_name)));
+            } else if (mesh.has_material) {
+                objects.push_back(
+                    make_unique<Instance>(mesh.object, transform));
+            } else {
+                throw ParseJsonException("Invalid JSON: instances of a mesh "
+                                         "without material need a material.");
+            }
+
         } else {
             throw ParseJsonException("Invalid object type!");
         }
 
-        if (obj.contains("sampled") && obj.at("sampled").get<bool>()) {
-            sampled_objects.push_back(index);
+        if (sampled) {
+            sampled_objects.push_back(objects.size() - 1);
         }
-        ++index;
+    }
+
+    for (shared_ptr<Hittable> & set : SphereSet::pack(spheres)) {
+        objects.push_back(std::move(set));
     }
 
     return make_pair(objects, sampled_objects);
@@ -263,6 +550,11 @@ Params Params::load_params(const char * file_name) {
 
     ImageInfo info = load_image_info(j.at("image"));
 
+    AccelerationInfo acceleration;
+    if (j.contains("acceleration")) {
+        acceleration = load_acceleration_info(j.at("acceleration"));
+    }
+
     Camera cam = load_cam(j.at("camera"), info);
 
     vector<GlobalIllumination> global_lights = load_lights(j.at("lights"));
@@ -270,10 +562,16 @@ Params Params::load_params(const char * file_name) {
     unordered_map<string, shared_ptr<Material>> materials =
         load_materials(j.at("materials"));
 
-    auto [objects, sampled_objects] = load_objects(j.at("objects"), materials);
+    unordered_map<string, MeshEntry> meshes;
+    if (j.contains("meshes")) {
+        meshes = load_meshes(j.at("meshes"), materials);
+    }
+
+    auto [objects, sampled_objects] =
+        load_objects(j.at("objects"), materials, meshes);
 
     file.close();
 
-    return Params { cam,       info,    global_lights,
+    return Params { cam,       info,    acceleration,   global_lights,
                     materials, objects, sampled_objects };
 }
@@ -0,0 +1,84 @@
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+    #include <fstream>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// From src/include
+#include <utils/mapped_file.hpp>
+
+bool file_stamp(const std::string & file_name,
+                uint64_t & size,
+                int64_t & time) noexcept {
+    std::error_code error;
+    size = std::filesystem::file_size(file_name, error);
+    if (error) {
+        return false;
+    }
+    const std::filesystem::file_time_type last_write =
+        std::filesystem::last_write_time(file_name, error);
+    time = last_write.time_since_epoch().count();
+    return !error;
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string & file_name) {
+    std::ifstream file(file_name, std::ios_base::in | std::ios_base::binary
+                                      | std::ios_base::ate);
+    if (!file) {
+        throw "Could not map file: could not open " + file_name;
+    }
+    file_size = file.tellg();
+    buffer.resize(file_size);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(buffer.data()), file_size)) {
+        throw "Could not map file: could not read " + file_name;
+    }
+    bytes = buffer.data();
+}
+
+MappedFile::~MappedFile() noexcept {}
+
+#else
+
+MappedFile::MappedFile(const std::string & file_name) {
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw "Could not map file: could not open " + file_name;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw "Could not map file: could not stat " + file_name;
+    }
+    file_size = file_stat.st_size;
+    if (file_size != 0) {
+        // Private writable mapping: pages are only copied when written to
+        void * address = mmap(nullptr, file_size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            close(fd);
+            throw "Could not map file: could not map " + file_name;
+        }
+        bytes = static_cast<std::byte *>(address);
+    }
+    // The mapping stays valid after the file is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() noexcept {
+    if (bytes != nullptr) {
+        munmap(bytes, file_size);
+    }
+}
+
+#endif
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+// From src/include
+#include <utils.hpp>
+#include <utils/mapped_file.hpp>
+#include <utils/obj_file.hpp>
+#include <utils/vec3.hpp>
+
+// Size of the chunks parsed in parallel, in bytes
+constexpr size_t CHUNK_SIZE = size_t(1) << 22;
+// Number of chunks per thread parsed at once when a file is streamed
+constexpr size_t STREAM_CHUNKS_PER_THREAD = 2;
+
+// Geometry of a chunk of the file. Vertex indices are made absolute once the
+// number of vertices before the chunk is known.
+struct ObjChunk {
+    // Vertex positions
+    std::vector<Point3> vertices;
+    // Vertex indices of the face corners, relative to the first vertex of
+    // the chunk for negative indices, absolute otherwise
+    std::vector<int64_t> corners;
+    // Positions in `corners` of the relative indices
+    std::vector<size_t> relative_corners;
+    // Number of corners of each face
+    std::vector<uint32_t> face_sizes;
+    // Largest absolute index minus the number of vertices of the chunk read
+    // before its face. Faces may only reference vertices read before them,
+    // so it must be below the number of vertices before the chunk.
+    int64_t forward_reach = INT64_MIN;
+    // Wether a number could not be parsed
+    bool invalid = false;
+};
+
+static inline bool is_blank(const char c) noexcept {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Skip the blanks of a line
+static inline const char * skip_blanks(const char * p,
+                                       const char * end) noexcept {
+    while (p < end && is_blank(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+// Parse a number, allowing a leading '+' which from_chars rejects
+template <class T>
+static inline const char *
+    parse_number(const char * p, const char * end, T & value) noexcept {
+    if (p < end && *p == '+') {
+        ++p;
+    }
+    const std::from_chars_result result = std::from_chars(p, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+// Parse the lines of a chunk. The chunk starts at the beginning of a line and
+// ends after a newline or at the end of the file.
+static void parse_chunk(const char * p, const char * end, ObjChunk & chunk) {
+    while (p < end) {
+        const char * line_end =
+            static_cast<const char *>(memchr(p, '\n', end - p));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        p = skip_blanks(p, line_end);
+
+        if (line_end - p > 1 && p[0] == 'v' && is_blank(p[1])) {
+            double coordinates[3];
+            ++p;
+            for (double & c : coordinates) {
+                p = parse_number(skip_blanks(p, line_end), line_end, c);
+                if (p == nullptr) {
+                    chunk.invalid = true;
+                    return;
+                }
+            }
+            chunk.vertices.emplace_back(coordinates[0], coordinates[1],
+                                        coordinates[2]);
+
+        } else if (line_end - p > 1 && p[0] == 'f' && is_blank(p[1])) {
+            // Corners v, v/vt, v//vn or v/vt/vn: only v is kept. Negative
+            // indices are relative to the end of the vertex list.
+            uint32_t size = 0;
+            p = skip_blanks(p + 1, line_end);
+            while (p < line_end) {
+                int64_t index;
+                p = parse_number(p, line_end, index);
+                if (p == nullptr) {
+                    chunk.invalid = true;
+                    return;
+                }
+                if (index < 0) {
+                    chunk.relative_corners.push_back(chunk.corners.size());
+                    index += int64_t(chunk.vertices.size());
+                } else if (index > 0) {
+                    --index;
+                    chunk.forward_reach =
+                        std::max(chunk.forward_reach,
+                                 index - int64_t(chunk.vertices.size()));
+                } else {
+                    chunk.invalid = true;
+                    return;
+                }
+                chunk.corners.push_back(index);
+                ++size;
+                while (p < line_end && !is_blank(*p)) {
+                    ++p;
+                }
+                p = skip_blanks(p, line_end);
+            }
+            chunk.face_sizes.push_back(size);
+        }
+        // Other lines (comments, vt, vn, groups, materials) are skipped
+
+        p = line_end + 1;
+    }
+}
+
+// Split a file in chunks of about CHUNK_SIZE bytes, moving their boundaries
+// forward to the start of the next line. Returns the boundaries.
+static std::vector<const char *> split_chunks(const char * const begin,
+                                              const char * const end) {
+    const size_t chunk_count = std::max<size_t>(
+        1, (size_t(end - begin) + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    std::vector<const char *> bounds(chunk_count + 1, end);
+    bounds[0] = begin;
+    for (size_t c = 1; c < chunk_count; ++c) {
+        const char * p = std::max(begin + c * CHUNK_SIZE, bounds[c - 1]);
+        const char * newline =
+            static_cast<const char *>(memchr(p, '\n', end - p));
+        bounds[c] = newline == nullptr ? end : newline + 1;
+    }
+    return bounds;
+}
+
+// Make the vertex indices of a chunk absolute, given the number of vertices
+// before it. Returns false if a face references a missing vertex, or a vertex
+// read after the face.
+static bool resolve_chunk(ObjChunk & chunk, const size_t vertex_base) noexcept {
+    for (const size_t i : chunk.relative_corners) {
+        chunk.corners[i] += int64_t(vertex_base);
+    }
+    if (chunk.forward_reach >= int64_t(vertex_base)) {
+        return false;
+    }
+    const int64_t vertex_end = int64_t(vertex_base + chunk.vertices.size());
+    for (const int64_t index : chunk.corners) {
+        if (index < 0 || index >= vertex_end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ObjFile::ObjFile(const std::string & file_name) {
+    const auto start = std::chrono::steady_clock::now();
+    const MappedFile file(file_name);
+    file_size = file.size();
+    const char * const begin = reinterpret_cast<const char *>(file.data());
+    const char * const end = begin + file_size;
+
+    const std::vector<const char *> bounds = split_chunks(begin, end);
+    const size_t chunk_count = bounds.size() - 1;
+
+    std::vector<ObjChunk> chunks(chunk_count);
+#pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < chunk_count; ++c) {
+        parse_chunk(bounds[c], bounds[c + 1], chunks[c]);
+    }
+
+    // First vertex, corner and face of each chunk
+    std::vector<size_t> vertex_bases(chunk_count + 1, 0);
+    std::vector<size_t> corner_bases(chunk_count + 1, 0);
+    std::vector<size_t> face_bases(chunk_count + 1, 0);
+    for (size_t c = 0; c < chunk_count; ++c) {
+        if (chunks[c].invalid) {
+            throw "Could not parse " + file_name + ": invalid number";
+        }
+        vertex_bases[c + 1] = vertex_bases[c] + chunks[c].vertices.size();
+        corner_bases[c + 1] = corner_bases[c] + chunks[c].corners.size();
+        face_bases[c + 1] = face_bases[c] + chunks[c].face_sizes.size();
+    }
+    const size_t vertex_count = vertex_bases[chunk_count];
+    if (vertex_count > UINT32_MAX) {
+        throw "Could not parse " + file_name + ": too many vertices";
+    }
+
+    vertex_storage.resize(vertex_count);
+    corners.resize(corner_bases[chunk_count]);
+    face_offsets.resize(face_bases[chunk_count] + 1);
+    face_offsets.back() = corners.size();
+    bool invalid_index = false;
+#pragma omp parallel for schedule(dynamic) reduction(|| : invalid_index)
+    for (size_t c = 0; c < chunk_count; ++c) {
+        ObjChunk & chunk = chunks[c];
+        std::copy(chunk.vertices.begin(), chunk.vertices.end(),
+                  vertex_storage.begin() + vertex_bases[c]);
+        if (!resolve_chunk(chunk, vertex_bases[c])) {
+            invalid_index = true;
+        }
+        for (size_t i = 0; i < chunk.corners.size() && !invalid_index; ++i) {
+            corners[corner_bases[c] + i] = uint32_t(chunk.corners[i]);
+        }
+        size_t offset = corner_bases[c];
+        for (size_t f = 0; f < chunk.face_sizes.size(); ++f) {
+            face_offsets[face_bases[c] + f] = offset;
+            offset += chunk.face_sizes[f];
+        }
+        chunk = ObjChunk();
+    }
+    if (invalid_index) {
+        throw "Could not parse " + file_name + ": invalid vertex index";
+    }
+
+    parse_millis = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    console::log("Parsed " + file_name + ": "
+                 + std::to_string(file_size / 1000000.0) + " MB in "
+                 + std::to_string(parse_millis) + "ms ("
+                 + std::to_string(throughput()) + " MB/s)");
+}
+
+void ObjFile::stream(const std::string & file_name,
+                     const VertexBlockFunction & vertex_block,
+                     const TriangleBlockFunction & triangle_block) {
+    const auto start = std::chrono::steady_clock::now();
+    const MappedFile file(file_name);
+    const char * const begin = reinterpret_cast<const char *>(file.data());
+    const std::vector<const char *> bounds =
+        split_chunks(begin, begin + file.size());
+    const size_t chunk_count = bounds.size() - 1;
+
+    // Groups of chunks are parsed in parallel, then passed on in order, so
+    // that only a group is in memory
+    const size_t group_size = STREAM_CHUNKS_PER_THREAD * omp_get_max_threads();
+    std::vector<ObjChunk> chunks(group_size);
+    std::vector<std::array<uint32_t, 3>> triangles;
+    size_t vertex_count = 0;
+    for (size_t first = 0; first < chunk_count; first += group_size) {
+        const size_t count = std::min(group_size, chunk_count - first);
+#pragma omp parallel for schedule(dynamic)
+        for (size_t c = 0; c < count; ++c) {
+            chunks[c] = ObjChunk();
+            parse_chunk(bounds[first + c], bounds[first + c + 1], chunks[c]);
+        }
+
+        for (size_t c = 0; c < count; ++c) {
+            ObjChunk & chunk = chunks[c];
+            if (chunk.invalid) {
+                throw "Could not parse " + file_name + ": invalid number";
+            }
+            if (!resolve_chunk(chunk, vertex_count)) {
+                throw "Could not parse " + file_name + ": invalid vertex index";
+            }
+            vertex_count += chunk.vertices.size();
+            if (vertex_count > UINT32_MAX) {
+                throw "Could not parse " + file_name + ": too many vertices";
+            }
+            vertex_block(chunk.vertices);
+
+            // Faces are split in triangle fans
+            triangles.clear();
+            size_t corner = 0;
+            for (const uint32_t size : chunk.face_sizes) {
+                for (size_t i = 2; i < size; ++i) {
+                    triangles.push_back(
+                        { uint32_t(chunk.corners[corner]),
+                          uint32_t(chunk.corners[corner + i - 1]),
+                          uint32_t(chunk.corners[corner + i]) });
+                }
+                corner += size;
+            }
+            triangle_block(triangles);
+        }
+    }
+
+    const double millis = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+    console::log("Parsed " + file_name + ": "
+                 + std::to_string(file.size() / 1000000.0) + " MB in "
+                 + std::to_string(millis) + "ms ("
+                 + std::to_string(file.size() / (1000.0 * millis))
+                 + " MB/s)");
+}
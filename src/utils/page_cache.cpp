@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #include <fstream>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include <omp.h>
+
+// From src/include
+#include <utils.hpp>
+#include <utils/page_cache.hpp>
+
+PageCache::PageCache(const std::string & file_name,
+                     const size_t first_page_offset,
+                     const size_t page_size,
+                     const size_t page_count,
+                     const size_t slot_count)
+    : name(file_name), first_page_offset(first_page_offset),
+      page_size(page_size), pages_in_file(page_count),
+      slots_in_pool(std::max<size_t>(1, std::min(slot_count, page_count))),
+      page_slots(new std::atomic<uint32_t>[page_count]),
+      slots(new Slot[slots_in_pool]),
+      hit_counters(new HitCounter[omp_get_max_threads()]),
+      hit_counter_count(omp_get_max_threads()) {
+#ifdef _WIN32
+    file.open(file_name, std::ios_base::in | std::ios_base::binary);
+    if (!file) {
+        throw "Could not open pages: could not open " + file_name;
+    }
+#else
+    fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw "Could not open pages: could not open " + file_name;
+    }
+#endif
+    memory.resize(slots_in_pool * page_size);
+    for (size_t page = 0; page < page_count; ++page) {
+        page_slots[page].store(NONE, std::memory_order_relaxed);
+    }
+}
+
+PageCache::~PageCache() noexcept {
+#ifndef _WIN32
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+bool PageCache::read_page(const uint32_t page, std::byte * destination) {
+    const size_t offset = first_page_offset + size_t(page) * page_size;
+#ifdef _WIN32
+    // Called under the lock
+    file.clear();
+    file.seekg(offset);
+    return bool(file.read(reinterpret_cast<char *>(destination), page_size));
+#else
+    size_t done = 0;
+    while (done < page_size) {
+        const ssize_t size =
+            pread(fd, destination + done, page_size - done, offset + done);
+        if (size <= 0) {
+            return false;
+        }
+        done += size;
+    }
+    return true;
+#endif
+}
+
+uint32_t PageCache::pin_resident(const uint32_t page) noexcept {
+    const uint32_t slot = page_slots[page].load(std::memory_order_acquire);
+    if (slot == NONE) {
+        return NONE;
+    }
+    // The slot may be refilled with another page until it is pinned, so the
+    // page is checked again after
+    Slot & s = slots[slot];
+    const uint32_t pins = s.pins.fetch_add(1, std::memory_order_acquire);
+    if ((pins & LOADING) != 0
+        || s.page.load(std::memory_order_relaxed) != page) {
+        s.pins.fetch_sub(1, std::memory_order_release);
+        return NONE;
+    }
+    // Written only when needed, so that the line stays shared between the
+    // threads using the page
+    if (!s.referenced.load(std::memory_order_relaxed)) {
+        s.referenced.store(true, std::memory_order_relaxed);
+    }
+    hit_counters[omp_get_thread_num() % hit_counter_count].count.fetch_add(
+        1, std::memory_order_relaxed);
+    return slot;
+}
+
+uint32_t PageCache::claim_slot() noexcept {
+    // Recently used slots get a second chance: the hand clears their
+    // reference bit, and takes them on its next turn if still unused
+    for (size_t step = 0; step < 2 * slots_in_pool; ++step) {
+        const uint32_t slot = clock_hand;
+        clock_hand = (clock_hand + 1) % slots_in_pool;
+        Slot & s = slots[slot];
+        if (s.pins.load(std::memory_order_relaxed) != 0
+            || s.referenced.exchange(false, std::memory_order_relaxed)) {
+            continue;
+        }
+        uint32_t unused = 0;
+        if (s.pins.compare_exchange_strong(unused, LOADING,
+                                           std::memory_order_acquire)) {
+            return slot;
+        }
+    }
+    return NONE;
+}
+
+const std::byte * PageCache::fault(const uint32_t page) noexcept {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint32_t slot;
+    while (true) {
+        if (failed()) {
+            return nullptr;
+        }
+        slot = pin_resident(page);
+        if (slot != NONE) {
+            // Read by another thread meanwhile
+            return memory.data() + slot * page_size;
+        }
+        const uint32_t loading_slot =
+            page_slots[page].load(std::memory_order_acquire);
+        if (loading_slot != NONE) {
+            // Being read by another thread
+            changed.wait(lock);
+            continue;
+        }
+        slot = claim_slot();
+        if (slot != NONE) {
+            break;
+        }
+        // All the pages are in use, for a short while since each thread
+        // only pins one page at a time
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+    }
+
+    ++fault_count;
+    Slot & s = slots[slot];
+    const uint32_t evicted = s.page.load(std::memory_order_relaxed);
+    if (evicted != NONE) {
+        ++eviction_count;
+        page_slots[evicted].store(NONE, std::memory_order_relaxed);
+    }
+    s.page.store(page, std::memory_order_relaxed);
+    page_slots[page].store(slot, std::memory_order_release);
+
+    std::byte * const destination = memory.data() + slot * page_size;
+#ifdef _WIN32
+    const bool read = read_page(page, destination);
+#else
+    // Other pages stay available while this one is read
+    lock.unlock();
+    const bool read = read_page(page, destination);
+    lock.lock();
+#endif
+    if (read) {
+        // LOADING becomes the pin of this thread
+        s.pins.fetch_sub(LOADING - 1, std::memory_order_release);
+    } else {
+        page_slots[page].store(NONE, std::memory_order_relaxed);
+        s.page.store(NONE, std::memory_order_relaxed);
+        s.pins.fetch_sub(LOADING, std::memory_order_release);
+    }
+    changed.notify_all();
+    if (!read) {
+        // Only the first failure is reported: the render is wrong anyway
+        if (!read_failed.exchange(true)) {
+            console::error("Could not read page " + std::to_string(page)
+                           + " of " + name);
+        }
+        return nullptr;
+    }
+    return destination;
+}
+
+uint64_t PageCache::hits() const noexcept {
+    uint64_t count = 0;
+    for (size_t i = 0; i < hit_counter_count; ++i) {
+        count += hit_counters[i].count.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t PageCache::faults() const noexcept {
+    const std::lock_guard<std::mutex> lock(mutex);
+    return fault_count;
+}
+
+uint64_t PageCache::evictions() const noexcept {
+    const std::lock_guard<std::mutex> lock(mutex);
+    return eviction_count;
+}
+
+double PageCache::hit_rate() const noexcept {
+    const uint64_t hit_count = hits();
+    const uint64_t accesses = hit_count + faults();
+    return accesses == 0 ? 1.0 : double(hit_count) / double(accesses);
+}
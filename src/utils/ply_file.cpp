@@ -0,0 +1,538 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// From src/include
+#include <utils.hpp>
+#include <utils/ply_file.hpp>
+#include <utils/vec3.hpp>
+
+// Size of the buffer the data is streamed through, in bytes
+constexpr size_t BUFFER_SIZE = size_t(1) << 20;
+// Names of the vertex properties decoded: the position, then the normal
+constexpr const char * VERTEX_PROPERTIES[6] = { "x",  "y",  "z",
+                                                 "nx", "ny", "nz" };
+
+// Number of vertices or triangles in the blocks of a streamed file
+constexpr size_t STREAM_BLOCK_SIZE = size_t(1) << 16;
+
+// Size of a value of a given type, in bytes
+static constexpr size_t type_size(const PlyType type) noexcept {
+    switch (type) {
+        case PlyType::INT8:
+        case PlyType::UINT8:
+            return 1;
+        case PlyType::INT16:
+        case PlyType::UINT16:
+            return 2;
+        case PlyType::INT32:
+        case PlyType::UINT32:
+        case PlyType::FLOAT32:
+            return 4;
+        case PlyType::FLOAT64:
+            return 8;
+    }
+    return 0;
+}
+
+// Read an unaligned value
+template <class T>
+static inline T load(const char * p) noexcept {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+// Read a value as a real number
+static inline double read_real(const PlyType type, const char * p) noexcept {
+    switch (type) {
+        case PlyType::INT8:
+            return load<int8_t>(p);
+        case PlyType::UINT8:
+            return load<uint8_t>(p);
+        case PlyType::INT16:
+            return load<int16_t>(p);
+        case PlyType::UINT16:
+            return load<uint16_t>(p);
+        case PlyType::INT32:
+            return load<int32_t>(p);
+        case PlyType::UINT32:
+            return load<uint32_t>(p);
+        case PlyType::FLOAT32:
+            return load<float>(p);
+        case PlyType::FLOAT64:
+            return load<double>(p);
+    }
+    return 0.0;
+}
+
+// Read a value as an integer. Real numbers are truncated.
+static inline int64_t read_integer(const PlyType type,
+                                   const char * p) noexcept {
+    switch (type) {
+        case PlyType::INT8:
+            return load<int8_t>(p);
+        case PlyType::UINT8:
+            return load<uint8_t>(p);
+        case PlyType::INT16:
+            return load<int16_t>(p);
+        case PlyType::UINT16:
+            return load<uint16_t>(p);
+        case PlyType::INT32:
+            return load<int32_t>(p);
+        case PlyType::UINT32:
+            return load<uint32_t>(p);
+        case PlyType::FLOAT32:
+            return int64_t(load<float>(p));
+        case PlyType::FLOAT64:
+            return int64_t(load<double>(p));
+    }
+    return 0;
+}
+
+// Size of a record of an element, or 0 if it holds lists and its size varies
+static size_t record_size(const PlyElement & element) noexcept {
+    size_t size = 0;
+    for (const PlyProperty & property : element.properties) {
+        if (property.is_list) {
+            return 0;
+        }
+        size += type_size(property.type);
+    }
+    return size;
+}
+
+// Data of a file, read through a fixed size buffer
+class PlyStream {
+private:
+    std::ifstream & file;
+    const std::string & name;
+    std::vector<char> buffer;
+    // Bytes of the buffer not read yet
+    size_t begin = 0;
+    size_t end = 0;
+
+    // Move the bytes not read yet to the start of the buffer and fill the
+    // rest, so that at least `size` bytes are available
+    void refill(const size_t size) {
+        if (size > buffer.size()) {
+            throw "Could not parse " + name + ": record too large";
+        }
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        file.read(buffer.data() + end, buffer.size() - end);
+        end += file.gcount();
+        if (end < size) {
+            throw "Could not parse " + name + ": unexpected end of file";
+        }
+    }
+
+public:
+    PlyStream(std::ifstream & file, const std::string & name)
+        : file(file), name(name), buffer(BUFFER_SIZE) {}
+
+    // The next `size` bytes, valid until the next call. Throws at the end of
+    // the file.
+    inline const char * take(const size_t size) {
+        if (end - begin < size) {
+            refill(size);
+        }
+        const char * const p = buffer.data() + begin;
+        begin += size;
+        return p;
+    }
+
+    // Skip `size` bytes
+    inline void skip(size_t size) {
+        while (size > 0) {
+            const size_t step = std::min(size, BUFFER_SIZE);
+            take(step);
+            size -= step;
+        }
+    }
+
+    // Skip a property of a record
+    inline void skip(const PlyProperty & property) {
+        if (!property.is_list) {
+            take(type_size(property.type));
+            return;
+        }
+        const int64_t count = read_integer(
+            property.count_type, take(type_size(property.count_type)));
+        if (count < 0) {
+            throw "Could not parse " + name + ": invalid list size";
+        }
+        skip(size_t(count) * type_size(property.type));
+    }
+};
+
+// Find a property of an element by name. Returns its index, or -1.
+static int find_property(const PlyElement & element,
+                         const std::string & property_name) noexcept {
+    for (size_t i = 0; i < element.properties.size(); ++i) {
+        if (element.properties[i].name == property_name) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
+// Read the vertices, and their normals if `with_normals`. Only the properties
+// in VERTEX_PROPERTIES are decoded. `store(v, position, normal)` is called for
+// each vertex, in order.
+template <class F>
+static void read_vertices(PlyStream & stream,
+                          const PlyElement & element,
+                          const bool with_normals,
+                          const F & store) {
+    // Index in VERTEX_PROPERTIES of each property, or -1 to skip it
+    std::vector<int> slots(element.properties.size(), -1);
+    const int slot_count = with_normals ? 6 : 3;
+    for (int slot = 0; slot < slot_count; ++slot) {
+        slots[find_property(element, VERTEX_PROPERTIES[slot])] = slot;
+    }
+
+    double values[6] = {};
+    const size_t size = record_size(element);
+    if (size != 0) {
+        // Records of fixed size: the decoded values are at fixed offsets
+        struct Field {
+            size_t offset;
+            PlyType type;
+            int slot;
+        };
+        std::vector<Field> fields;
+        size_t offset = 0;
+        for (size_t i = 0; i < element.properties.size(); ++i) {
+            if (slots[i] >= 0) {
+                fields.push_back({ offset, element.properties[i].type,
+                                   slots[i] });
+            }
+            offset += type_size(element.properties[i].type);
+        }
+        for (size_t v = 0; v < element.count; ++v) {
+            const char * const record = stream.take(size);
+            for (const Field & field : fields) {
+                values[field.slot] =
+                    read_real(field.type, record + field.offset);
+            }
+            store(v, Point3(values[0], values[1], values[2]),
+                  Vec3(values[3], values[4], values[5]));
+        }
+        return;
+    }
+
+    for (size_t v = 0; v < element.count; ++v) {
+        for (size_t i = 0; i < element.properties.size(); ++i) {
+            const PlyProperty & property = element.properties[i];
+            if (slots[i] < 0) {
+                stream.skip(property);
+            } else {
+                values[slots[i]] = read_real(
+                    property.type, stream.take(type_size(property.type)));
+            }
+        }
+        store(v, Point3(values[0], values[1], values[2]),
+              Vec3(values[3], values[4], values[5]));
+    }
+}
+
+// Read the faces, split in triangle fans. `emit(triangle)` is called for each
+// triangle, in order. Returns false if a face references a missing vertex.
+template <class F>
+static bool read_faces(PlyStream & stream,
+                       const PlyElement & element,
+                       const int index_property,
+                       const size_t vertex_count,
+                       const F & emit) {
+    const PlyProperty & indices = element.properties[index_property];
+    const size_t count_size = type_size(indices.count_type);
+    const size_t index_size = type_size(indices.type);
+    bool valid = true;
+    for (size_t f = 0; f < element.count; ++f) {
+        for (size_t i = 0; i < element.properties.size(); ++i) {
+            if (int(i) != index_property) {
+                stream.skip(element.properties[i]);
+                continue;
+            }
+            const int64_t count =
+                read_integer(indices.count_type, stream.take(count_size));
+            if (count < 0) {
+                return false;
+            }
+            const char * const p = stream.take(size_t(count) * index_size);
+            uint32_t polygon[3];
+            for (int64_t k = 0; k < count; ++k) {
+                const int64_t index =
+                    read_integer(indices.type, p + k * index_size);
+                valid &= 0 <= index && uint64_t(index) < vertex_count;
+                polygon[std::min<int64_t>(k, 2)] = uint32_t(index);
+                if (k >= 2) {
+                    emit(std::array<uint32_t, 3> { polygon[0], polygon[1],
+                                                   polygon[2] });
+                    polygon[1] = polygon[2];
+                }
+            }
+        }
+    }
+    return valid;
+}
+
+// Read the elements of a file, the vertices with `store_vertex` and the faces
+// with `emit_triangle`. The other elements are skipped.
+template <class F, class G>
+static void read_elements(PlyStream & stream,
+                          const std::vector<PlyElement> & elements,
+                          const std::string & name,
+                          const size_t vertex_count,
+                          const bool with_normals,
+                          const F & store_vertex,
+                          const G & emit_triangle) {
+    for (const PlyElement & element : elements) {
+        if (element.name == "vertex") {
+            read_vertices(stream, element, with_normals, store_vertex);
+        } else if (element.name == "face") {
+            int index_property = find_property(element, "vertex_indices");
+            if (index_property < 0) {
+                index_property = find_property(element, "vertex_index");
+            }
+            if (!read_faces(stream, element, index_property, vertex_count,
+                            emit_triangle)) {
+                throw "Could not parse " + name + ": invalid vertex index";
+            }
+        } else {
+            // Other elements, such as edges or materials, are skipped
+            const size_t size = record_size(element);
+            if (size != 0) {
+                stream.skip(element.count * size);
+            } else {
+                for (size_t r = 0; r < element.count; ++r) {
+                    for (const PlyProperty & property : element.properties) {
+                        stream.skip(property);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Log the time spent parsing a file since `start`
+static void log_parsed(const std::string & name,
+                       const size_t file_size,
+                       const std::chrono::steady_clock::time_point start) {
+    const double millis = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+    console::log("Parsed " + name + ": "
+                 + std::to_string(file_size / 1000000.0) + " MB in "
+                 + std::to_string(millis) + "ms ("
+                 + std::to_string(file_size / (1000.0 * millis)) + " MB/s)");
+}
+
+PlyFile::PlyFile(const std::string & file_name)
+    : name(file_name),
+      file(file_name, std::ios_base::in | std::ios_base::binary) {
+    if (!file) {
+        throw "Could not parse " + name + ": could not open the file";
+    }
+    if constexpr (std::endian::native != std::endian::little) {
+        throw "Could not parse " + name + ": big endian hosts not supported";
+    }
+    std::error_code error;
+    file_size = std::filesystem::file_size(file_name, error);
+    read_header();
+}
+
+PlyType PlyFile::parse_type(const std::string & type_name) const {
+    if (type_name == "char" || type_name == "int8") {
+        return PlyType::INT8;
+    }
+    if (type_name == "uchar" || type_name == "uint8") {
+        return PlyType::UINT8;
+    }
+    if (type_name == "short" || type_name == "int16") {
+        return PlyType::INT16;
+    }
+    if (type_name == "ushort" || type_name == "uint16") {
+        return PlyType::UINT16;
+    }
+    if (type_name == "int" || type_name == "int32") {
+        return PlyType::INT32;
+    }
+    if (type_name == "uint" || type_name == "uint32") {
+        return PlyType::UINT32;
+    }
+    if (type_name == "float" || type_name == "float32") {
+        return PlyType::FLOAT32;
+    }
+    if (type_name == "double" || type_name == "float64") {
+        return PlyType::FLOAT64;
+    }
+    throw "Could not parse " + name + ": unknown type " + type_name;
+}
+
+void PlyFile::read_header() {
+    std::string line, keyword;
+    if (!std::getline(file, line) || line.substr(0, 3) != "ply") {
+        throw "Could not parse " + name + ": not a .ply file";
+    }
+
+    bool binary_little_endian = false;
+    while (true) {
+        if (!std::getline(file, line)) {
+            throw "Could not parse " + name + ": unexpected end of header";
+        }
+        std::istringstream words(line);
+        if (!(words >> keyword) || keyword == "comment"
+            || keyword == "obj_info") {
+            continue;
+        }
+        if (keyword == "end_header") {
+            break;
+        }
+
+        if (keyword == "format") {
+            std::string format;
+            words >> format;
+            binary_little_endian = format == "binary_little_endian";
+        } else if (keyword == "element") {
+            PlyElement element;
+            if (!(words >> element.name >> element.count)) {
+                throw "Could not parse " + name + ": invalid element";
+            }
+            elements.push_back(std::move(element));
+        } else if (keyword == "property") {
+            PlyProperty property;
+            std::string type_name, count_type_name;
+            if (!(words >> type_name) || elements.empty()) {
+                throw "Could not parse " + name + ": invalid property";
+            }
+            property.is_list = type_name == "list";
+            if (property.is_list) {
+                words >> count_type_name >> type_name;
+                property.count_type = parse_type(count_type_name);
+            } else {
+                property.count_type = PlyType::UINT8;
+            }
+            property.type = parse_type(type_name);
+            if (!(words >> property.name)) {
+                throw "Could not parse " + name + ": invalid property";
+            }
+            elements.back().properties.push_back(std::move(property));
+        } else {
+            throw "Could not parse " + name + ": unknown keyword " + keyword;
+        }
+    }
+    if (!binary_little_endian) {
+        throw "Could not parse " + name
+            + ": only binary little endian files are supported";
+    }
+
+    bool has_vertices = false, has_faces = false;
+    for (const PlyElement & element : elements) {
+        if (element.name == "vertex") {
+            has_vertices = true;
+            // Wether the element has a scalar property of a given name
+            const auto has_scalar = [&](const char * property_name) {
+                const int i = find_property(element, property_name);
+                return i >= 0 && !element.properties[i].is_list;
+            };
+            for (int slot = 0; slot < 3; ++slot) {
+                if (!has_scalar(VERTEX_PROPERTIES[slot])) {
+                    throw "Could not parse " + name
+                        + ": missing vertex property "
+                        + VERTEX_PROPERTIES[slot];
+                }
+            }
+            normals_in_file = has_scalar(VERTEX_PROPERTIES[3])
+                              && has_scalar(VERTEX_PROPERTIES[4])
+                              && has_scalar(VERTEX_PROPERTIES[5]);
+            vertices_in_file = element.count;
+            // Guards against corrupted counts before allocating
+            if (element.count > UINT32_MAX || element.count > file_size
+                || element.count * record_size(element) > file_size) {
+                throw "Could not parse " + name + ": too many vertices";
+            }
+        } else if (element.name == "face") {
+            const int i = find_property(element, "vertex_indices");
+            const int j = find_property(element, "vertex_index");
+            has_faces = (i >= 0 && element.properties[i].is_list)
+                        || (j >= 0 && element.properties[j].is_list);
+            faces_in_file = element.count;
+            if (element.count > file_size) {
+                throw "Could not parse " + name + ": too many faces";
+            }
+        }
+    }
+    if (!has_vertices || !has_faces) {
+        throw "Could not parse " + name + ": missing vertices or faces";
+    }
+}
+
+void PlyFile::read(std::vector<Point3> & vertices,
+                   std::vector<std::array<uint32_t, 3>> & triangles,
+                   std::vector<Vec3> & normals) {
+    const auto start = std::chrono::steady_clock::now();
+    // The arrays are allocated once, and filled in place
+    vertices.assign(vertices_in_file, Point3());
+    normals.assign(normals_in_file ? vertices_in_file : 0, Vec3());
+    triangles.clear();
+    triangles.reserve(faces_in_file);
+
+    PlyStream stream(file, name);
+    read_elements(
+        stream, elements, name, vertices_in_file, normals_in_file,
+        [&](const size_t v, const Point3 & position, const Vec3 & normal) {
+            vertices[v] = position;
+            if (!normals.empty()) {
+                normals[v] = normal;
+            }
+        },
+        [&](const std::array<uint32_t, 3> & triangle) {
+            triangles.push_back(triangle);
+        });
+    log_parsed(name, file_size, start);
+}
+
+void PlyFile::stream(const VertexBlockFunction & vertex_block,
+                     const TriangleBlockFunction & triangle_block) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<Point3> vertices;
+    std::vector<std::array<uint32_t, 3>> triangles;
+    vertices.reserve(STREAM_BLOCK_SIZE);
+    triangles.reserve(STREAM_BLOCK_SIZE);
+
+    PlyStream stream(file, name);
+    read_elements(
+        stream, elements, name, vertices_in_file, false,
+        [&](const size_t, const Point3 & position, const Vec3 &) {
+            vertices.push_back(position);
+            if (vertices.size() == STREAM_BLOCK_SIZE) {
+                vertex_block(vertices);
+                vertices.clear();
+            }
+        },
+        [&](const std::array<uint32_t, 3> & triangle) {
+            triangles.push_back(triangle);
+            if (triangles.size() == STREAM_BLOCK_SIZE) {
+                triangle_block(triangles);
+                triangles.clear();
+            }
+        });
+    if (!vertices.empty()) {
+        vertex_block(vertices);
+    }
+    if (!triangles.empty()) {
+        triangle_block(triangles);
+    }
+    log_parsed(name, file_size, start);
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// From src/include
+#include <utils.hpp>
+#include <utils/vec3.hpp>
+#include <utils/weld.hpp>
+
+// Normals of merged vertices must be closer than this
+constexpr double NORMAL_TOLERANCE = 1e-6;
+
+// Cell of the spatial hash holding a point, and the side of the cell the point
+// is closest to along each axis. Cells are twice as wide as the tolerance, so
+// the vertices close to a point are in the 8 cells around the corner it is
+// closest to. The coordinates of the cells stay floating point, which cannot
+// overflow.
+static inline std::array<double, 3>
+    cell_of(const Point3 & p,
+            const double tolerance,
+            std::array<int, 3> & sides) noexcept {
+    if (tolerance == 0.0) {
+        sides = { 0, 0, 0 };
+        return { p.x, p.y, p.z };
+    }
+    const double scale = 0.5 / tolerance;
+    std::array<double, 3> cell;
+    for (int axis = 0; axis < 3; ++axis) {
+        const double x = p[axis] * scale;
+        cell[axis] = std::floor(x);
+        sides[axis] = x - cell[axis] < 0.5 ? -1 : 1;
+    }
+    return cell;
+}
+
+// Bits of a cell coordinate. -0 and +0 must share their cell: their sign is
+// cleared on the bits, since fast math lets the compiler drop the floating
+// point operations which would do it, such as adding 0.
+static inline uint64_t coordinate_bits(const double x) noexcept {
+    const uint64_t bits = std::bit_cast<uint64_t>(x);
+    return bits << 1 == 0 ? 0 : bits;
+}
+
+static inline uint64_t hash_cell(const double x,
+                                 const double y,
+                                 const double z) noexcept {
+    uint64_t hash = utils::hash_mix(0, coordinate_bits(x));
+    hash = utils::hash_mix(hash, coordinate_bits(y));
+    hash = utils::hash_mix(hash, coordinate_bits(z));
+    return utils::hash_finalize(hash);
+}
+
+WeldStats weld_vertices(std::vector<Point3> & vertices,
+                        std::vector<std::array<uint32_t, 3>> & triangles,
+                        std::vector<Vec3> & normals,
+                        const double tolerance) {
+    const auto start = std::chrono::steady_clock::now();
+    WeldStats stats;
+    stats.welded = true;
+    stats.vertices_before = vertices.size();
+    stats.triangles_before = triangles.size();
+    const size_t vertex_count = vertices.size();
+
+    // Vertices of each bucket of the spatial hash, sorted by index
+    const size_t bucket_mask =
+        std::bit_ceil(std::max<size_t>(1, 2 * vertex_count)) - 1;
+    std::vector<uint64_t> hashes(vertex_count);
+#pragma omp parallel for
+    for (size_t i = 0; i < vertex_count; ++i) {
+        std::array<int, 3> sides;
+        const std::array<double, 3> cell =
+            cell_of(vertices[i], tolerance, sides);
+        hashes[i] = hash_cell(cell[0], cell[1], cell[2]);
+    }
+    std::vector<uint32_t> bucket_starts(bucket_mask + 2, 0);
+    for (const uint64_t hash : hashes) {
+        ++bucket_starts[(hash & bucket_mask) + 1];
+    }
+    for (size_t b = 1; b < bucket_starts.size(); ++b) {
+        bucket_starts[b] += bucket_starts[b - 1];
+    }
+    std::vector<uint32_t> bucket_vertices(vertex_count);
+    {
+        std::vector<uint32_t> ends(bucket_starts.begin(),
+                                   bucket_starts.end() - 1);
+        for (size_t i = 0; i < vertex_count; ++i) {
+            bucket_vertices[ends[hashes[i] & bucket_mask]++] = i;
+        }
+    }
+    std::vector<uint64_t>().swap(hashes);
+
+    // Each vertex is merged into an earlier vertex close to it, if any.
+    // Duplicates are usually in the cell of the vertex, searched first. Exact
+    // welding only searches this cell.
+    const double squared_tolerance = tolerance * tolerance;
+    const int corner_count = tolerance == 0.0 ? 1 : 8;
+    // Whether two vertices may be merged
+    const auto close = [&](const size_t i, const size_t j) {
+        return (vertices[j] - vertices[i]).squared_norm() <= squared_tolerance
+               && (normals.empty()
+                   || (normals[j] - normals[i]).squared_norm()
+                          <= NORMAL_TOLERANCE * NORMAL_TOLERANCE);
+    };
+    std::vector<uint32_t> merged(vertex_count);
+#pragma omp parallel for schedule(dynamic, 4096)
+    for (size_t i = 0; i < vertex_count; ++i) {
+        const Point3 & p = vertices[i];
+        std::array<int, 3> sides;
+        const std::array<double, 3> cell = cell_of(p, tolerance, sides);
+        uint32_t first = i;
+        for (int corner = 0; corner < corner_count && first == i; ++corner) {
+            const int dx = corner & 1 ? sides[0] : 0;
+            const int dy = corner & 2 ? sides[1] : 0;
+            const int dz = corner & 4 ? sides[2] : 0;
+            const uint64_t bucket =
+                hash_cell(cell[0] + dx, cell[1] + dy, cell[2] + dz)
+                & bucket_mask;
+            for (uint32_t k = bucket_starts[bucket];
+                 k < bucket_starts[bucket + 1]; ++k) {
+                const uint32_t j = bucket_vertices[k];
+                if (j >= i) {
+                    break;
+                }
+                if (close(i, j)) {
+                    first = j;
+                    break;
+                }
+            }
+        }
+        merged[i] = first;
+    }
+    std::vector<uint32_t>().swap(bucket_vertices);
+    std::vector<uint32_t>().swap(bucket_starts);
+
+    // Follow the chains of merged vertices. A vertex is always merged into
+    // an earlier one, already resolved. Along a chain, the first vertex may be
+    // further than the tolerance: the vertex is then kept, so that merged
+    // vertices never move by more than the tolerance.
+    for (size_t i = 0; i < vertex_count; ++i) {
+        const uint32_t first = merged[merged[i]];
+        merged[i] = close(i, first) ? first : i;
+    }
+
+    // Drop the degenerate triangles
+    std::vector<uint8_t> degenerate(triangles.size());
+#pragma omp parallel for
+    for (size_t t = 0; t < triangles.size(); ++t) {
+        std::array<uint32_t, 3> & triangle = triangles[t];
+        for (uint32_t & index : triangle) {
+            index = merged[index];
+        }
+        degenerate[t] =
+            triangle[0] == triangle[1] || triangle[1] == triangle[2]
+            || triangle[2] == triangle[0]
+            || (vertices[triangle[1]] - vertices[triangle[0]])
+                       .cross(vertices[triangle[2]] - vertices[triangle[0]])
+                       .squared_norm()
+                   == 0.0;
+    }
+    size_t triangle_count = 0;
+    std::vector<uint32_t> new_indices(vertex_count, 0);
+    for (size_t t = 0; t < triangles.size(); ++t) {
+        if (!degenerate[t]) {
+            for (const uint32_t index : triangles[t]) {
+                new_indices[index] = 1;
+            }
+            triangles[triangle_count++] = triangles[t];
+        }
+    }
+    triangles.resize(triangle_count);
+    triangles.shrink_to_fit();
+
+    // Keep the vertices used by the triangles, in order
+    size_t kept = 0;
+    for (size_t i = 0; i < vertex_count; ++i) {
+        if (new_indices[i]) {
+            new_indices[i] = kept;
+            vertices[kept] = vertices[i];
+            if (!normals.empty()) {
+                normals[kept] = normals[i];
+            }
+            ++kept;
+        }
+    }
+    vertices.resize(kept);
+    vertices.shrink_to_fit();
+    if (!normals.empty()) {
+        normals.resize(kept);
+        normals.shrink_to_fit();
+    }
+#pragma omp parallel for
+    for (size_t t = 0; t < triangles.size(); ++t) {
+        for (uint32_t & index : triangles[t]) {
+            index = new_indices[index];
+        }
+    }
+
+    stats.vertices_after = vertices.size();
+    stats.triangles_after = triangles.size();
+    stats.millis = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    return stats;
+}